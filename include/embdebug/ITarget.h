@@ -9,6 +9,7 @@
 #ifndef EMBDEBUG_ITARGET_H
 #define EMBDEBUG_ITARGET_H
 
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
 #include <iostream>
@@ -30,7 +31,7 @@ class ITarget {
 public:
   //! The version number of the ITarget interface, used to verify that targets
   //! and the library are kept in sync.
-  static const uint64_t CURRENT_API_VERSION = 0x1ULL;
+  static const uint64_t CURRENT_API_VERSION = 0x9ULL;
 
   //! The type of action which will be performed when a core is resumed.
   enum class ResumeType : int {
@@ -41,7 +42,11 @@ public:
     CONTINUE = 1,
 
     //! Do nothing.
-    NONE = 2
+    NONE = 2,
+
+    //! Single step until the PC leaves the range given to setStepRange(),
+    //! then stop. Only requested of cores whose range the target accepted.
+    RANGE_STEP = 3
   };
 
   //! Result after a core is resumed and has come to a halt
@@ -86,6 +91,13 @@ public:
     TIMEOUT = 2,
   };
 
+  //! Registers with a special role, which the server needs to identify
+  enum class RegisterRole : int {
+    PC = 0, //!< Program counter
+    SP = 1, //!< Stack pointer
+    FP = 2, //!< Frame pointer
+  };
+
   //! The location that an argument to a syscall can be found
   enum class SyscallArgLocType : int {
     REGISTER,
@@ -114,6 +126,12 @@ public:
     }
   };
 
+  //! A range of target memory, for use with readv() and writev()
+  struct MemoryRange {
+    uint_addr_t addr; //!< Start address of the range
+    std::size_t size; //!< Number of bytes in the range
+  };
+
   //! \brief Constant that can be used by multi-cpu targets to indicate that no
   //! valid cpu is currently selected.
   //!
@@ -150,6 +168,24 @@ public:
                                  std::vector<SyscallArgLoc> &syscallArgLocs,
                                  SyscallArgLoc &syscallReturnLoc) const = 0;
 
+  //! \brief Get the number of the register with a given role
+  //!
+  //! The default implementation knows of no such registers.
+  //!
+  //! \param[in] role The role of the register
+  //! \return The number of the register, as used by GDB, or -1 if there is
+  //!         no such register.
+  virtual int getRegisterNumber(const RegisterRole role) const;
+
+  //! \brief Get the registers to report when a core stops
+  //!
+  //! The values of these registers are sent to GDB with each stop, saving it
+  //! from asking for them. The PC, SP and FP (if known) are always sent, so
+  //! need not be included. The default implementation adds no registers.
+  //!
+  //! \param[out] regs The numbers of the registers, as used by GDB.
+  virtual void getExpeditedRegisters(std::vector<int> &regs) const;
+
   //! \brief Read contents of a target register.
   //!
   //! \param[in]  reg   The register to read
@@ -190,6 +226,100 @@ public:
   virtual std::size_t write(const uint_addr_t addr, const uint8_t *buffer,
                             const std::size_t size) = 0;
 
+  //! \brief Read the contents of a range of target registers
+  //!
+  //! Targets which can read several registers more cheaply than one at a
+  //! time (for example in a single scan) should override this. The default
+  //! implementation calls readRegister() for each register.
+  //!
+  //! \param[in]  firstReg The first register to read
+  //! \param[in]  count    The number of registers to read
+  //! \param[out] values   Array of \p count values, each zero extended to the
+  //!                      size of uint_reg_t.
+  //! \param[out] sizes    Array of \p count sizes of the registers in bytes.
+  //! \return The number of registers read, starting with \p firstReg.
+  virtual int readRegisters(const int firstReg, const int count,
+                            uint_reg_t *values, std::size_t *sizes);
+
+  //! \brief Write the contents of a range of target registers
+  //!
+  //! Targets which can write several registers more cheaply than one at a
+  //! time should override this. The default implementation calls
+  //! writeRegister() for each register.
+  //!
+  //! \param[in]  firstReg The first register to write
+  //! \param[in]  count    The number of registers to write
+  //! \param[in]  values   Array of \p count values to write, each zero
+  //!                      extended to the size of uint_reg_t.
+  //! \param[out] sizes    Array of \p count sizes of the registers written,
+  //!                      in bytes.
+  //! \return The number of registers written, starting with \p firstReg.
+  virtual int writeRegisters(const int firstReg, const int count,
+                             const uint_reg_t *values, std::size_t *sizes);
+
+  //! \brief Read several ranges of target memory
+  //!
+  //! Targets which can batch memory accesses should override this. The
+  //! default implementation calls read() for each range, stopping at the
+  //! first which is not read completely.
+  //!
+  //! \param[in]  ranges  Array of \p count ranges to read.
+  //! \param[in]  count   The number of ranges
+  //! \param[out] buffer  Buffer that the read memory will be written to, the
+  //!                     data of each range following that of the previous
+  //!                     range. Must be large enough to hold all the ranges.
+  //! \return The total number of bytes read.
+  virtual std::size_t readv(const MemoryRange *ranges, const std::size_t count,
+                            uint8_t *buffer);
+
+  //! \brief Write several ranges of target memory
+  //!
+  //! Targets which can batch memory accesses should override this. The
+  //! default implementation calls write() for each range, stopping at the
+  //! first which is not written completely.
+  //!
+  //! \param[in] ranges  Array of \p count ranges to write.
+  //! \param[in] count   The number of ranges
+  //! \param[in] buffer  Buffer that the memory to write will be read from,
+  //!                    the data of each range following that of the
+  //!                    previous range.
+  //! \return The total number of bytes written.
+  virtual std::size_t writev(const MemoryRange *ranges,
+                             const std::size_t count, const uint8_t *buffer);
+
+  //! \brief Whether a range of target memory may be cached
+  //!
+  //! While the target is stopped the server may cache memory it has read,
+  //! and satisfy later reads from the cache until the target is resumed.
+  //! The cache is filled a page at a time, with read-ahead, so memory next
+  //! to what the client asked for is read too. Targets may override this
+  //! to return true for memory which may be cached, but not for memory whose
+  //! contents may change while the target is stopped, such as memory mapped
+  //! I/O, or where reading has side effects. The default implementation
+  //! allows no memory to be cached, so only what the client asks for is
+  //! read.
+  //!
+  //! \param[in] addr  The start of the range
+  //! \param[in] size  The size of the range in bytes
+  //! \return True if the whole range may be cached.
+  virtual bool isCacheable(const uint_addr_t addr,
+                           const std::size_t size) const;
+
+  //! \brief Set the range of addresses the current CPU range steps within
+  //!
+  //! Called before prepare() for each CPU which is to be resumed with
+  //! ResumeType::RANGE_STEP. The CPU should single step until it stops at
+  //! an address outside the range, or for any other reason, and report the
+  //! stop as ResumeRes::STEPPED if it left the range. Targets which can do
+  //! this faster than the server stepping them one instruction at a time
+  //! should override this. The default implementation declines, and the
+  //! server steps the CPU itself.
+  //!
+  //! \param[in] start  The first address of the range
+  //! \param[in] end    The address just after the range
+  //! \return True if the target will range step the CPU.
+  virtual bool setStepRange(const uint_addr_t start, const uint_addr_t end);
+
   // Insert and remove a matchpoint (breakpoint or watchpoint) at the given
   // address.  Return value indicates whether the operation was successful.
 
@@ -291,6 +421,73 @@ public:
   //!         Failure to halt will generally be a fatal error.
   virtual bool halt(void) = 0;
 
+  //! \brief Get a file descriptor which signals stop events
+  //!
+  //! A target whose cores run independently of the server (hardware, or a
+  //! model in another thread) may provide a file descriptor, such as an
+  //! eventfd, which is readable whenever wait() has a stop event to return.
+  //! The server then sleeps in poll() on this and the client connection,
+  //! rather than calling wait() repeatedly. wait() must clear the event,
+  //! and must return WaitRes::TIMEOUT at once when there is none. The
+  //! default implementation provides no file descriptor, and wait() is
+  //! polled.
+  //!
+  //! \return The file descriptor, or -1 if there is none.
+  virtual int getEventFd(void);
+
+  //! \brief Ask wait() to return soon
+  //!
+  //! Called from another thread when the client has sent something, such as
+  //! a break, while the server may be in wait(), so must be thread safe
+  //! (for example by setting an atomic flag which wait() checks). A target
+  //! which runs for long periods in wait() before returning WaitRes::TIMEOUT
+  //! should override this to make wait() return at once, so that the client
+  //! is served promptly. The call may arrive just after wait() has returned,
+  //! in which case the next wait() may return WaitRes::TIMEOUT at once. The
+  //! default implementation does nothing, so the client is served when
+  //! wait() next returns.
+  virtual void interruptWait(void);
+
+  //! \brief Set how long wait() may run before returning WaitRes::TIMEOUT
+  //!
+  //! wait() should return WaitRes::TIMEOUT once the cores have run
+  //! \p instructions instructions, or \p time has passed, whichever comes
+  //! first, so that the server can check for a break from the client. The
+  //! server adapts the number of instructions to how fast the target runs,
+  //! so that little time is spent checking, while \p time is the longest
+  //! the client is prepared to wait for a break to take effect. The budget
+  //! is set before any wait() in which it changes. A target which returns
+  //! false chooses its own quantum, and is not told again.
+  //!
+  //! \param[in] instructions  The number of instructions to run
+  //! \param[in] time          The longest time to run
+  //! \return True if the target takes the budget.
+  virtual bool setWaitBudget(const uint64_t instructions,
+                             const std::chrono::duration<double> time);
+
+  //! \brief Select whether cores stop and resume independently
+  //!
+  //! In non-stop mode, wait() returns as soon as any core stops, leaving the
+  //! other cores running, with ResumeRes::NONE for each core which has not
+  //! stopped. prepare() with ResumeType::NONE leaves a core as it is, so
+  //! resume() only resumes the cores given some other action, and
+  //! haltCpu() halts a single core. Targets which can run like this should
+  //! override this. The default implementation only allows all-stop mode,
+  //! in which all cores are halted when any one stops.
+  //!
+  //! \param[in] enable  True to select non-stop mode, false for all-stop
+  //! \return True if the mode was selected.
+  virtual bool setNonStop(const bool enable);
+
+  //! \brief Halt one running core, leaving the others running
+  //!
+  //! Only used in non-stop mode. Once halted, the core is not reported by
+  //! wait() until it is next resumed. The default implementation fails.
+  //!
+  //! \param[in] index  The index of the CPU to halt
+  //! \return True if the core was halted.
+  virtual bool haltCpu(const unsigned int index);
+
   //! \brief Determine whether the target supports XML descriptions
   //!
   //! \return True if XML target descriptions are supported.
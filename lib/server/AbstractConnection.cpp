@@ -14,7 +14,13 @@
 #include <csignal>
 #include <cstring>
 
+#ifndef _WIN32
+#include <poll.h>
+#include <unistd.h>
+#endif
+
 #include "AbstractConnection.h"
+#include "RspCodec.h"
 #include "Utils.h"
 
 using std::cerr;
@@ -28,29 +34,43 @@ using std::setw;
 
 using namespace EmbDebug;
 
+//! Destructor
+
+AbstractConnection::~AbstractConnection() {
+  stopWatch();
+#ifndef _WIN32
+  for (int fd : mWakeFds)
+    if (fd >= 0)
+      close(fd);
+#endif
+}
+
 //! Get the next packet from the RSP connection
 
-//! Modeled on the stub version supplied with GDB. This allows the user to
-//! replace the character read function, which is why we get stuff a character
-//! at at time.
+//! Modeled on the stub version supplied with GDB. The packet is parsed in
+//! place in the receive buffer, which is filled in bulk by the OS specific
+//! read function. The packet returned is a view of the data in the receive
+//! buffer, with the '#' replaced by a terminating zero. It remains valid until
+//! the next call to ::getPkt ().
 
 //! Unlike the reference implementation, we don't deal with sequence
 //! numbers. GDB has never used them, and this implementation is only intended
 //! for use with GDB 6.8 or later. Sequence numbers were removed from the RSP
 //! standard at GDB 5.0.
 
-//! @param[in] pkt  The packet for storing the result.
-
 //! @return  bool:      TRUE to indicate success, FALSE otherwise (means a
 //!                     communications failure)
 //!          RspPacket: Valid packet if first return value is TRUE, empty packet
 //!                     otherwise
 std::pair<bool, RspPacket> AbstractConnection::getPkt() {
-  RspPacketBuilder newPkt;
+  // The previous packet is finished with, so may now be overwritten.
+  mRxBuf.unpin();
+  mRxBuf.rewind();
 
   // Keep getting packets, until one is found with a valid checksum
   while (true) {
     unsigned char checksum; // The checksum we have computed
+    std::size_t len;        // Number of chars of packet data
     int ch;                 // Current character
 
     // Wait around for the start character ('$'). Ignore all other
@@ -64,86 +84,94 @@ std::pair<bool, RspPacket> AbstractConnection::getPkt() {
       }
     }
 
-    // Read until a '#' or end of buffer is found
+    // Scan for a '#' or end of buffer, without consuming anything
     checksum = 0;
-    while (newPkt.getRemaining()) {
-      ch = getRspChar();
-
-      if (-1 == ch) {
+    len = 0;
+    ch = -1;
+    while (len <= RspPacket::getMaxPacketSize()) {
+      if ((len == mRxBuf.size()) && !fillRxBuf(true)) {
         return {false, RspPacket()}; // Connection failed
       }
 
+      std::size_t avail;
+      const char *data = mRxBuf.readRegion(len, avail);
+      const char *end = static_cast<const char *>(memchr(data, '#', avail));
+      std::size_t i = (end == nullptr) ? avail : end - data;
+
       // If we hit a start of line char begin all over again
-      if ('$' == ch) {
+      const char *start = static_cast<const char *>(memchr(data, '$', i));
+      if (start != nullptr) {
+        mRxBuf.drop(len + (start - data) + 1);
         checksum = 0;
-        newPkt.erase();
-
+        len = 0;
         continue;
       }
 
+      checksum = checksum + RspCodec::checksum(data, i);
+      len += i;
+
       // Break out if we get the end of line char
-      if ('#' == ch) {
+      if (end != nullptr) {
+        ch = '#';
         break;
       }
-
-      // Update the checksum and add the char to the buffer
-      checksum = checksum + (unsigned char)ch;
-      newPkt += (char)ch;
     }
 
     // If we have a valid end of packet char, validate the checksum. If we
     // don't it's because we ran out of buffer in the previous loop.
-    if ('#' == ch) {
-      unsigned char xmitcsum; // The checksum in the packet
-
-      ch = getRspChar();
-      if (-1 == ch) {
-        return {false, RspPacket()}; // Connection failed
-      }
-      assert(Utils::isHexStr((char *)&ch, 1));
-      xmitcsum = Utils::char2Hex(ch) << 4;
+    if ('#' != ch) {
+      cerr << "Warning: RSP packet overran buffer" << endl;
+      mRxBuf.drop(len);
+      continue;
+    }
 
-      ch = getRspChar();
-      if (-1 == ch) {
+    // Wait for the checksum chars
+    while (mRxBuf.size() < len + 3) {
+      if (!fillRxBuf(true)) {
         return {false, RspPacket()}; // Connection failed
       }
+    }
 
-      assert(Utils::isHexStr((char *)&ch, 1));
-      xmitcsum += Utils::char2Hex(ch);
-
-      // If the checksums don't match print a warning, and put the
-      // negative ack back to the client. Otherwise put a positive ack.
-      if (mNoAckMode) {
-        RspPacket pkt(newPkt);
-        if (traceFlags->traceRsp()) {
-          cout << "RSP trace: getPkt: " << pkt << endl;
-        }
-        return {true, pkt};
-      }
+    unsigned char xmitcsum; // The checksum in the packet
+    ch = mRxBuf.at(len + 1);
+    assert(Utils::isHexStr((char *)&ch, 1));
+    xmitcsum = Utils::char2Hex(ch) << 4;
+    ch = mRxBuf.at(len + 2);
+    assert(Utils::isHexStr((char *)&ch, 1));
+    xmitcsum += Utils::char2Hex(ch);
+
+    // If the checksums don't match print a warning, and put the
+    // negative ack back to the client. Otherwise put a positive ack.
+    if (!mNoAckMode) {
       if (checksum != xmitcsum) {
         cerr << "Warning: Bad RSP checksum: Computed 0x" << setw(2)
              << setfill('0') << hex << checksum << ", received 0x" << xmitcsum
              << setfill(' ') << dec << endl;
+        mRxBuf.drop(len + 3);
         if (!putRspChar('-')) // Failed checksum
         {
           return {false, RspPacket()}; // Comms failure
         }
-      } else {
-        if (!putRspChar('+')) // successful transfer
-        {
-          return {false, RspPacket()}; // Comms failure
-        } else {
-          RspPacket pkt(newPkt);
-          if (traceFlags->traceRsp()) {
-            cout << "RSP trace: getPkt: " << pkt << endl;
-          }
-
-          return {true, pkt}; // Success
-        }
+        continue;
       }
-    } else {
-      cerr << "Warning: RSP packet overran buffer" << endl;
+      if (!putRspChar('+')) // successful transfer
+      {
+        return {false, RspPacket()}; // Comms failure
+      }
+    }
+
+    // Terminate the data in place and keep it until the next packet.
+    char *data = mRxBuf.linearize(len + 1);
+    data[len] = '\0';
+    mRxBuf.pin();
+    mRxBuf.drop(len + 3);
+
+    RspPacket pkt = RspPacket::CreateView(data, len);
+    if (traceFlags->traceRsp()) {
+      cout << "RSP trace: getPkt: " << pkt << endl;
     }
+
+    return {true, std::move(pkt)}; // Success
   }
 }
 
@@ -154,59 +182,108 @@ std::pair<bool, RspPacket> AbstractConnection::getPkt() {
 //! are escaped by preceding them with '}' and then XORing the character with
 //! 0x20.
 
+//! The complete frame is built in the transmit buffer, so that it can be sent
+//! (and if necessary resent) with a single write.
+
+//! If enabled, runs of repeated chars are then run-length encoded.
+
 //! @param[in] pkt  The Packet to transmit
 
 //! @return  TRUE to indicate success, FALSE otherwise (means a communications
 //!          failure).
 bool AbstractConnection::putPkt(const RspPacket &pkt) {
-  std::size_t len = pkt.getLen();
-  int ch; // Ack char
+  if (!putFrame('$', pkt.getRawData(), pkt.getLen()))
+    return false;
 
-  // Construct $<packet info>#<checksum>. Repeat until the GDB client
-  // acknowledges satisfactory receipt.
-  do {
-    unsigned char checksum = 0; // Computed checksum
-    std::size_t count = 0;      // Index into the buffer
+  if (traceFlags->traceRsp()) {
+    cout << "RSP trace: putPkt: " << pkt << endl;
+  }
 
-    if (!putRspChar('$')) // Start char
-    {
-      return false; // Comms failure
-    }
+  return true;
+}
 
-    // Body of the packet
-    for (count = 0; count < len; count++) {
-      unsigned char ch = pkt.getData()[count];
+//! Put the contents of a packet builder out on the RSP connection
 
-      // Check for escaped chars
-      if (('$' == ch) || ('#' == ch) || ('*' == ch) || ('}' == ch)) {
-        ch ^= 0x20;
-        checksum += (unsigned char)'}';
-        if (!putRspChar('}')) {
-          return false; // Comms failure
-        }
-      }
+//! This avoids having to copy the builder's data into a packet first.
 
-      checksum += ch;
-      if (!putRspChar(ch)) {
-        return false; // Comms failure
-      }
-    }
+//! @param[in] builder  The packet data to transmit
 
-    if (!putRspChar('#')) // End char
-    {
-      return false; // Comms failure
-    }
+//! @return  TRUE to indicate success, FALSE otherwise (means a communications
+//!          failure).
+bool AbstractConnection::putPkt(const RspPacketBuilder &builder) {
+  if (!putFrame('$', builder.getRawData(), builder.getSize()))
+    return false;
 
-    // Computed checksum
-    if (!putRspChar(Utils::hex2Char(checksum >> 4))) {
-      return false; // Comms failure
-    }
-    if (!putRspChar(Utils::hex2Char(checksum % 16))) {
+  if (traceFlags->traceRsp()) {
+    cout << "RSP trace: putPkt: " << RspPacket(builder) << endl;
+  }
+
+  return true;
+}
+
+//! Put a notification out on the RSP connection
+
+//! Notifications are framed like packets, but start with '%' and are not
+//! acknowledged by the client, which may send them at any time. They are
+//! used in non-stop mode to tell the client of stops.
+
+//! @param[in] builder  The notification data to transmit
+
+//! @return  TRUE to indicate success, FALSE otherwise (means a communications
+//!          failure).
+bool AbstractConnection::putNotification(const RspPacketBuilder &builder) {
+  if (!putFrame('%', builder.getRawData(), builder.getSize()))
+    return false;
+
+  if (traceFlags->traceRsp()) {
+    cout << "RSP trace: putNotification: " << RspPacket(builder) << endl;
+  }
+
+  return true;
+}
+
+//! Frame and transmit packet data, waiting for the acknowledgement
+
+//! @param[in] start  The start char, '$' for a packet or '%' for a
+//!                   notification, which is not acknowledged
+//! @param[in] data   The packet data
+//! @param[in] len    The number of chars of packet data
+
+//! @return  TRUE to indicate success, FALSE otherwise (means a communications
+//!          failure).
+bool AbstractConnection::putFrame(char start, const char *data,
+                                  std::size_t len) {
+  int ch; // Ack char
+
+  // Construct $<packet info>#<checksum>. Worst case every char is escaped.
+  // The buffer only grows, to avoid reinitializing it on every packet.
+  if (mTxBuf.size() < len * 2 + 4)
+    mTxBuf.resize(len * 2 + 4);
+  char *frame = mTxBuf.data();
+  frame[0] = start; // Start char
+
+  // Body of the packet, optionally compressed. The checksum covers the body
+  // as sent.
+  std::size_t frameLen = 1 + RspCodec::escape(data, len, &frame[1]);
+  if (mRunLengthEncoding)
+    frameLen = 1 + RspCodec::runLengthEncode(&frame[1], frameLen - 1);
+  unsigned char checksum = RspCodec::checksum(&frame[1], frameLen - 1);
+
+  frame[frameLen++] = '#'; // End char
+
+  // Computed checksum
+  frame[frameLen++] = Utils::hex2Char(checksum >> 4);
+  frame[frameLen++] = Utils::hex2Char(checksum % 16);
+
+  // Send the frame. Repeat until the GDB client acknowledges satisfactory
+  // receipt.
+  do {
+    if (!putRspCharsRaw(frame, frameLen)) {
       return false; // Comms failure
     }
 
     // Check for ack of connection failure
-    if (mNoAckMode)
+    if (mNoAckMode || (start == '%'))
       break;
     ch = getRspChar();
     if (-1 == ch) {
@@ -221,10 +298,6 @@ bool AbstractConnection::putPkt(const RspPacket &pkt) {
     }
   } while ('+' != ch);
 
-  if (traceFlags->traceRsp()) {
-    cout << "RSP trace: putPkt: " << pkt << endl;
-  }
-
   return true;
 }
 
@@ -236,35 +309,48 @@ bool AbstractConnection::putPkt(const RspPacket &pkt) {
 //! @param[in] c  The character to put out
 //! @return  TRUE if char sent OK, FALSE if not (communications failure)
 
-bool AbstractConnection::putRspChar(char c) { return putRspCharRaw(c); }
+bool AbstractConnection::putRspChar(char c) { return putRspCharsRaw(&c, 1); }
 
 //! Get a single character from the RSP connection with buffering
 
-//! Utility routine for use by other functions.  This is built on the raw
-//! read function.
-
-//! This function will first return the possibly buffered character (buffering
-//! caused by calling 'haveBreak'.
+//! Utility routine for use by other functions.  Characters are served from
+//! the receive buffer, which is refilled with a single (blocking) bulk read
+//! when it runs dry.
 
 //! @return  The character received or -1 on failure
 
 int AbstractConnection::getRspChar() {
-  int ch;
+  // It's tempting to think we can check for BREAK_CHAR here.  DON'T!
+  // This method is used when reading in whole packets, and the
+  // BREAK_CHAR is only special when it arrives outside of a packet.
+  if (mRxBuf.empty() && !fillRxBuf(true))
+    return -1;
 
-  if (mNumGetBufChars > 1)
-    cerr << "Warning: Too many cached characters (" << dec << mNumGetBufChars
-         << ")" << endl;
+  return mRxBuf.pop();
+}
 
-  if (mNumGetBufChars > 0) {
-    ch = mGetCharBuf;
-    mNumGetBufChars = 0;
-  } else
-    // It's tempting to think we can check for BREAK_CHAR here.  DON'T!
-    // This method is used when reading in whole packets, and the
-    // BREAK_CHAR is only special when it arrives outside of a packet.
-    ch = getRspCharRaw(true);
+//! Refill the receive buffer from the connection
+
+//! Reads as many characters as are available (up to the contiguous free space
+//! in the buffer) with a single call to the OS specific routine.
+
+//! @param[in] blocking  True if we should wait for at least one character.
+//! @return  TRUE if any characters were added to the buffer, FALSE otherwise
+//!          (including on communications failure).
+
+bool AbstractConnection::fillRxBuf(bool blocking) {
+  std::size_t len;
+  char *buf = mRxBuf.writeRegion(len);
 
-  return ch;
+  if (len == 0)
+    return false;
+
+  int count = getRspCharsRaw(buf, len, blocking);
+  if (count <= 0)
+    return false;
+
+  mRxBuf.commit(static_cast<std::size_t>(count));
+  return true;
 }
 
 //! Have we received a break character.
@@ -272,23 +358,25 @@ int AbstractConnection::getRspChar() {
 //! Since we only check fo this between packets, we don't have to worry about
 //! being in the middle of a packet.
 
-//! @Note  We only peek, so no character is actually consumed from the input.
+//! @Note  Only a BREAK at the head of the receive buffer is consumed, any other
+//!        character is left for the next call to ::getPkt ().
 
 //! @return  TRUE if we have received a break character, FALSE otherwise.
 
 bool AbstractConnection::haveBreak() {
-  if (!mHavePendingBreak && mNumGetBufChars == 0) {
-    // Non-blocking read to possibly get a character.
+  // Nothing has arrived while the watcher is still waiting
+  if (watching())
+    return false;
 
-    int nextChar = getRspCharRaw(false);
+  if (!mHavePendingBreak) {
+    // Non-blocking read to possibly get some more characters.
 
-    if (nextChar != -1) {
-      if (nextChar == BREAK_CHAR)
-        mHavePendingBreak = true;
-      else {
-        mGetCharBuf = nextChar;
-        mNumGetBufChars = 1;
-      }
+    if (mRxBuf.empty())
+      (void)fillRxBuf(false);
+
+    if (!mRxBuf.empty() && mRxBuf.front() == BREAK_CHAR) {
+      mRxBuf.pop();
+      mHavePendingBreak = true;
     }
   }
 
@@ -298,3 +386,182 @@ bool AbstractConnection::haveBreak() {
   } else
     return false;
 }
+
+//! Has a packet started to arrive
+
+//! Used to serve the client while the target runs, so never blocks. Chars
+//! before the start of a packet are discarded, noting any break, so that
+//! ::getPkt () will not wait for a packet which is not coming.
+
+//! @return  TRUE if the start of a packet has been received, FALSE otherwise.
+
+bool AbstractConnection::havePkt() {
+  if (watching())
+    return false;
+
+  while (true) {
+    if (mRxBuf.empty() && !fillRxBuf(false))
+      return false;
+
+    if (mRxBuf.front() == '$')
+      return true;
+
+    if (mRxBuf.pop() == BREAK_CHAR)
+      mHavePendingBreak = true;
+  }
+}
+
+//! Sleep until the client or another file descriptor has input
+
+//! Used while the target runs, so that the server does not spin checking
+//! for a break. Returns at once if input is already buffered, or if either
+//! file descriptor cannot be polled, in which case the caller is left to
+//! poll.
+
+//! @param[in] fd         The other file descriptor to wait for
+//! @param[in] timeoutMs  The longest time to wait in milliseconds, or -1 to
+//!                       wait for ever
+
+void AbstractConnection::waitForInput(int fd, int timeoutMs) {
+#ifdef _WIN32
+  (void)fd;
+  (void)timeoutMs;
+#else
+  int clientFd = getPollFd();
+  if (mHavePendingBreak || !mRxBuf.empty() || (fd < 0) || (clientFd < 0))
+    return;
+
+  struct pollfd fds[2];
+  fds[0].fd = clientFd;
+  fds[0].events = POLLIN;
+  fds[0].revents = 0;
+  fds[1].fd = fd;
+  fds[1].events = POLLIN;
+  fds[1].revents = 0;
+
+  // An interrupted or failed poll just returns early, leaving the caller to
+  // check for events as it would have done anyway.
+  if ((poll(fds, 2, timeoutMs) < 0) && (errno != EINTR))
+    cerr << "Warning: poll failed: " << strerror(errno) << endl;
+#endif
+}
+
+//! Start watching for client input from another thread
+
+//! Used while the target runs, when it cannot signal its events for
+//! ::waitForInput (). The watcher calls \p onInput as soon as the client
+//! sends anything, such as a break, and then finishes, so that the target
+//! can be interrupted rather than the input noticed only when the target
+//! next returns. Until then, ::haveBreak () and ::havePkt () know that
+//! nothing has arrived without reading the connection. Does nothing if
+//! already watching.
+
+//! @param[in] onInput  Called from the watcher thread when input arrives
+//! @return  TRUE if watching, FALSE if input is already buffered or the
+//!          connection cannot be polled, so the caller must poll.
+
+bool AbstractConnection::startWatch(std::function<void()> onInput) {
+  if (watching())
+    return true;
+
+#ifdef _WIN32
+  (void)onInput;
+  return false;
+#else
+  int clientFd = getPollFd();
+  if (mHavePendingBreak || !mRxBuf.empty() || (clientFd < 0))
+    return false;
+
+  if ((mWakeFds[0] < 0) && (pipe(mWakeFds) != 0)) {
+    mWakeFds[0] = -1;
+    mWakeFds[1] = -1;
+    return false;
+  }
+
+  mWatchDone = false;
+  mWatcher = std::thread(&AbstractConnection::watchInput, this, clientFd,
+                         std::move(onInput));
+  return true;
+#endif
+}
+
+//! Stop watching for client input
+
+//! Must be called before the connection is closed, and before whatever the
+//! watcher's callback uses is destroyed.
+
+void AbstractConnection::stopWatch() {
+  if (!mWatcher.joinable())
+    return;
+
+#ifndef _WIN32
+  // The watcher never reads the pipe, so anything written is read back.
+  bool woken = !mWatchDone && (write(mWakeFds[1], "x", 1) == 1);
+  mWatcher.join();
+  char c;
+  if (woken)
+    (void)read(mWakeFds[0], &c, 1);
+#endif
+}
+
+//! Is the watcher still waiting for client input?
+
+//! A watcher which has finished is joined.
+
+//! @return  TRUE if the watcher is running and has seen no input.
+
+bool AbstractConnection::watching() {
+  if (!mWatcher.joinable())
+    return false;
+
+  if (!mWatchDone)
+    return true;
+
+  mWatcher.join();
+  return false;
+}
+
+//! Body of the watcher thread
+
+//! Sleeps until the client has input, or the watcher is stopped. An error
+//! or hang up on the connection counts as input, leaving the caller to find
+//! it when reading.
+
+//! @param[in] clientFd  The file descriptor on which client input arrives
+//! @param[in] onInput   Called when input arrives
+
+void AbstractConnection::watchInput(int clientFd,
+                                    std::function<void()> onInput) {
+#ifdef _WIN32
+  (void)clientFd;
+  (void)onInput;
+#else
+  struct pollfd fds[2];
+  fds[0].fd = clientFd;
+  fds[0].events = POLLIN;
+  fds[1].fd = mWakeFds[0];
+  fds[1].events = POLLIN;
+
+  for (;;) {
+    fds[0].revents = 0;
+    fds[1].revents = 0;
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+
+    if (fds[1].revents != 0)
+      break;
+
+    // Finish before the callback, so that once it has interrupted the
+    // target, the caller knows to look at the input.
+    if (fds[0].revents != 0) {
+      mWatchDone = true;
+      onInput();
+      return;
+    }
+  }
+#endif
+  mWatchDone = true;
+}
@@ -9,6 +9,13 @@
 #ifndef ABSTRACT_CONNECTION_H
 #define ABSTRACT_CONNECTION_H
 
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "RingBuffer.h"
 #include "RspPacket.h"
 #include "TraceFlags.h"
 
@@ -19,6 +26,10 @@ namespace EmbDebug {
 //! This class is entirely passive. It is up to the caller to determine that a
 //! packet will become available before calling ::getPkt ().
 
+//! While the target runs, a thread may watch for client input, so that the
+//! target can be interrupted at once. The thread only polls the connection,
+//! leaving all reading to the caller.
+
 class AbstractConnection {
 public:
   // Constructor and Destructor
@@ -36,29 +47,62 @@ public:
 
   virtual std::pair<bool, RspPacket> getPkt();
   virtual bool putPkt(const RspPacket &pkt);
+  bool putPkt(const RspPacketBuilder &builder);
+  bool putNotification(const RspPacketBuilder &builder);
 
   // Check for a break (ctrl-C)
 
   virtual bool haveBreak();
 
+  // Check, without blocking, whether a packet has started to arrive
+
+  bool havePkt();
+
+  // Sleep until the client or another file descriptor has input
+
+  void waitForInput(int fd, int timeoutMs);
+
+  // Watch for client input from another thread while the target runs
+
+  bool startWatch(std::function<void()> onInput);
+  void stopWatch();
+
   // Disable packet acknowledgements
   void setNoAckMode(bool ackMode) { mNoAckMode = ackMode; }
 
+  // Run-length encode outgoing packets
+  void setRunLengthEncoding(bool rle) { mRunLengthEncoding = rle; }
+  bool getRunLengthEncoding() const { return mRunLengthEncoding; }
+
 protected:
   //! Trace flags
 
   TraceFlags *traceFlags;
 
-  // Internal OS specific routines to handle individual chars.
+  // Internal OS specific routines to handle blocks of chars.
+
+  virtual bool putRspCharsRaw(const char *buf, std::size_t len) = 0;
+  virtual int getRspCharsRaw(char *buf, std::size_t len, bool blocking) = 0;
+
+  //! File descriptor on which client input arrives, for waitForInput, or -1
+  //! if it cannot be polled.
+
+  virtual int getPollFd() { return -1; }
+
+  // Throw away any buffered input, e.g. on a new connection
 
-  virtual bool putRspCharRaw(char c) = 0;
-  virtual int getRspCharRaw(bool blocking) = 0;
+  void discardInput() { mRxBuf.clear(); }
 
 private:
   //! The BREAK character
 
   static const int BREAK_CHAR = 3;
 
+  //! Minimum size of the receive buffer. It is made larger if necessary to
+  //! hold a complete packet, which is parsed in place.
+
+  static const std::size_t RX_BUF_SIZE = 65536;
+
   //! Has a BREAK arrived?
 
   bool mHavePendingBreak;
@@ -67,25 +111,49 @@ private:
 
   bool mNoAckMode;
 
-  //! The buffered char for get RspChar
-  int mGetCharBuf;
+  //! Are outgoing packets run-length encoded
+
+  bool mRunLengthEncoding;
+
+  //! Buffered input, filled in blocks and drained by getRspChar
+  RingBuffer mRxBuf;
+
+  //! Buffer in which outgoing packets are framed. Reused for every packet.
+  std::vector<char> mTxBuf;
+
+  //! Thread watching for client input, which only polls the connection, so
+  //! never touches the receive buffer.
+  std::thread mWatcher;
+
+  //! Has the watcher seen input (and so finished)?
+  std::atomic<bool> mWatchDone;
 
-  //! Count of how many buffered chars we have
-  int mNumGetBufChars;
+  //! Pipe written to wake the watcher when it is stopped
+  int mWakeFds[2];
+
+  // Watch for client input
+
+  bool watching();
+  void watchInput(int clientFd, std::function<void()> onInput);
+
+  // Internal routine to frame and send packet data
+
+  bool putFrame(char start, const char *data, std::size_t len);
 
   // Internal routines to handle individual chars
 
   bool putRspChar(char c);
   int getRspChar();
+  bool fillRxBuf(bool blocking);
 };
 
-// Default implementation of the destructor.
-
-inline AbstractConnection::~AbstractConnection() {}
-
 inline AbstractConnection::AbstractConnection(TraceFlags *_traceFlags)
     : traceFlags(_traceFlags), mHavePendingBreak(false), mNoAckMode(false),
-      mNumGetBufChars(0) {}
+      mRunLengthEncoding(false),
+      mRxBuf(RspPacket::getMaxPacketSize() + 4 > RX_BUF_SIZE
+                 ? RspPacket::getMaxPacketSize() + 4
+                 : RX_BUF_SIZE),
+      mWatchDone(true), mWakeFds{-1, -1} {}
 
 } // namespace EmbDebug
 
@@ -0,0 +1,739 @@
+// GDB agent expression evaluator: implementation
+//
+// This file is part of the Embecosm GDB Server.
+//
+// Copyright (C) 2019 Embecosm Limited
+// SPDX-License-Identifier: GPL-3.0-or-later
+// ----------------------------------------------------------------------------
+
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+
+#include "AgentExpr.h"
+#include "RspCodec.h"
+
+using namespace EmbDebug;
+
+//! State of an evaluation
+
+struct AgentExpr::State {
+  //! One past the top of the stack
+  uint64_t *sp;
+
+  //! The first instruction, for jumps
+  const Insn *code;
+
+  //! The printf format strings
+  const std::vector<std::string> *formats;
+
+  //! Access to the target
+  Context *ctx;
+
+  //! Number of backward jumps taken
+  std::size_t jumps;
+
+  //! The result, set by the end instruction
+  uint64_t result;
+  bool done;
+};
+
+//! Constructor
+
+//! The expression is initially empty, and fails to evaluate.
+
+AgentExpr::AgentExpr() : mInsns(), mFormats() {}
+
+//! Destructor
+
+AgentExpr::~AgentExpr() {}
+
+//! Set the bytecode of the expression
+
+//! The bytecode is compiled, ready to be evaluated.
+
+//! @param[in] hex  The bytecode, as pairs of hex digits
+//! @param[in] len  The number of bytes of bytecode
+//! @return  TRUE if the bytecode is valid, FALSE otherwise, in which case the
+//!          expression is left empty.
+
+bool AgentExpr::parse(const char *hex, std::size_t len) {
+  std::vector<uint8_t> code(len);
+  if (!RspCodec::hex2Bin(hex, len, code.data()) || !compile(code) ||
+      !checkStack()) {
+    mInsns.clear();
+    mFormats.clear();
+    return false;
+  }
+
+  return true;
+}
+
+//! Evaluate the expression
+
+//! Evaluation fails if the bytecode does something invalid, such as dividing
+//! by zero, reading a register or memory which cannot be read, or looping for
+//! too long.
+
+//! @param[in]  ctx     Access to the target
+//! @param[out] result  The value on top of the stack at the end
+//! @return  TRUE if the expression was evaluated, FALSE otherwise
+
+bool AgentExpr::evaluate(Context &ctx, uint64_t &result) const {
+  if (mInsns.empty())
+    return false;
+
+  uint64_t stack[STACK_SIZE];
+  State state = {stack, mInsns.data(), &mFormats, &ctx, 0, 0, false};
+  const Insn *insn = state.code;
+  while (insn != nullptr)
+    insn = insn->handler(insn, state);
+
+  result = state.result;
+  return state.done;
+}
+
+//! Compile bytecode
+
+//! Every bytecode must be supported and have its operand present, widths
+//! given to ext and zero_ext must be between 1 and 64, jumps must land
+//! on a bytecode, and printf formats must match their arguments.
+
+//! @param[in] code  The bytecode
+//! @return  TRUE if the bytecode was compiled, FALSE if it is invalid
+
+bool AgentExpr::compile(const std::vector<uint8_t> &code) {
+  // Index of the instruction at each offset, or -1 within an operand
+  std::vector<long> index(code.size(), -1);
+  mInsns.clear();
+  mFormats.clear();
+
+  std::size_t pc = 0;
+  while (pc < code.size()) {
+    uint8_t op = code[pc];
+    int opSize = operandSize(op);
+    if ((opSize < 0) || (pc + 1 + opSize > code.size()))
+      return false;
+
+    // Operands are big endian
+    uint64_t arg = 0;
+    for (int i = 0; i < opSize; i++)
+      arg = (arg << 8) | code[pc + 1 + i];
+    if (((op == OP_EXT) || (op == OP_ZERO_EXT)) && ((arg == 0) || (arg > 64)))
+      return false;
+
+    // The format string of printf follows its number of arguments and the
+    // length of the string, including its terminating NUL.
+    if (op == OP_PRINTF) {
+      std::size_t nargs = static_cast<std::size_t>(arg >> 16);
+      std::size_t slen = static_cast<std::size_t>(arg & 0xffff);
+      if ((slen == 0) || (pc + 4 + slen > code.size()) ||
+          (code[pc + 3 + slen] != 0))
+        return false;
+
+      std::string fmt(reinterpret_cast<const char *>(&code[pc + 4]),
+                      slen - 1);
+      if ((fmt.find('\0') != std::string::npos) ||
+          !format(fmt, nullptr, nargs, nullptr, nullptr))
+        return false;
+
+      arg = (static_cast<uint64_t>(mFormats.size()) << 8) | nargs;
+      mFormats.push_back(fmt);
+      opSize += static_cast<int>(slen);
+    }
+
+    index[pc] = static_cast<long>(mInsns.size());
+    mInsns.push_back(Insn{handler(op), arg, op});
+    pc += 1 + opSize;
+  }
+
+  for (Insn &insn : mInsns) {
+    if ((insn.op == OP_IF_GOTO) || (insn.op == OP_GOTO)) {
+      if ((insn.arg >= code.size()) || (index[insn.arg] < 0))
+        return false;
+      insn.arg = static_cast<uint64_t>(index[insn.arg]);
+    }
+  }
+
+  return true;
+}
+
+//! Check the use of the stack by compiled bytecode
+
+//! The depth of the stack at each instruction must be the same however it
+//! is reached, must be enough for the instruction, and must not grow beyond
+//! the size of the stack. Evaluation must not run off the end of the code.
+//! The depth of the stack is recorded for each end instruction.
+
+//! @return  TRUE if the stack is used correctly, FALSE otherwise
+
+bool AgentExpr::checkStack() {
+  if (mInsns.empty())
+    return false;
+
+  std::vector<int> depth(mInsns.size(), -1);
+  std::vector<std::size_t> work(1, 0);
+  depth[0] = 0;
+  while (!work.empty()) {
+    std::size_t i = work.back();
+    work.pop_back();
+
+    const Insn &insn = mInsns[i];
+    int needed;
+    int change;
+    switch (insn.op) {
+    case OP_CONST8:
+    case OP_CONST16:
+    case OP_CONST32:
+    case OP_CONST64:
+    case OP_REG:
+      needed = 0;
+      change = 1;
+      break;
+    case OP_GOTO:
+      needed = 0;
+      change = 0;
+      break;
+    case OP_IF_GOTO:
+    case OP_POP:
+      needed = 1;
+      change = -1;
+      break;
+    case OP_DUP:
+      needed = 1;
+      change = 1;
+      break;
+    case OP_LOG_NOT:
+    case OP_BIT_NOT:
+    case OP_EXT:
+    case OP_ZERO_EXT:
+    case OP_REF8:
+    case OP_REF16:
+    case OP_REF32:
+    case OP_REF64:
+      needed = 1;
+      change = 0;
+      break;
+    case OP_END:
+      // Commands such as printf leave nothing on the stack
+      needed = 0;
+      change = 0;
+      mInsns[i].arg = static_cast<uint64_t>(depth[i]);
+      break;
+    case OP_SWAP:
+      needed = 2;
+      change = 0;
+      break;
+    case OP_ROT:
+      needed = 3;
+      change = 0;
+      break;
+    case OP_PICK:
+      needed = static_cast<int>(insn.arg) + 1;
+      change = 1;
+      break;
+    case OP_PRINTF:
+      // The arguments, the function and the channel
+      needed = static_cast<int>(insn.arg & 0xff) + 2;
+      change = -needed;
+      break;
+    default:
+      needed = 2;
+      change = -1;
+      break;
+    }
+
+    int d = depth[i];
+    if ((d < needed) || (d + change > STACK_SIZE))
+      return false;
+
+    // The instructions which may follow
+    std::size_t next[2];
+    std::size_t numNext = 0;
+    if ((insn.op == OP_IF_GOTO) || (insn.op == OP_GOTO))
+      next[numNext++] = static_cast<std::size_t>(insn.arg);
+    if ((insn.op != OP_GOTO) && (insn.op != OP_END)) {
+      if (i + 1 >= mInsns.size())
+        return false;
+      next[numNext++] = i + 1;
+    }
+
+    for (std::size_t n = 0; n < numNext; n++) {
+      if (depth[next[n]] < 0) {
+        depth[next[n]] = d + change;
+        work.push_back(next[n]);
+      } else if (depth[next[n]] != d + change) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+//! The size of the operand of a bytecode
+
+//! @param[in] op  The bytecode
+//! @return  The number of bytes of operand, or -1 if the bytecode is not
+//!          supported
+
+int AgentExpr::operandSize(uint8_t op) {
+  switch (op) {
+  case OP_EXT:
+  case OP_ZERO_EXT:
+  case OP_CONST8:
+  case OP_PICK:
+    return 1;
+  case OP_IF_GOTO:
+  case OP_GOTO:
+  case OP_CONST16:
+  case OP_REG:
+    return 2;
+  case OP_CONST32:
+    return 4;
+  case OP_CONST64:
+    return 8;
+  case OP_PRINTF:
+    // The format string follows
+    return 3;
+  default:
+    return (handler(op) == nullptr) ? -1 : 0;
+  }
+}
+
+//! The function which executes a bytecode
+
+//! @param[in] op  The bytecode
+//! @return  The function, or nullptr if the bytecode is not supported
+
+AgentExpr::Handler AgentExpr::handler(uint8_t op) {
+  switch (op) {
+  case OP_ADD:
+    return &exec<OP_ADD>;
+  case OP_SUB:
+    return &exec<OP_SUB>;
+  case OP_MUL:
+    return &exec<OP_MUL>;
+  case OP_DIV_SIGNED:
+    return &exec<OP_DIV_SIGNED>;
+  case OP_DIV_UNSIGNED:
+    return &exec<OP_DIV_UNSIGNED>;
+  case OP_REM_SIGNED:
+    return &exec<OP_REM_SIGNED>;
+  case OP_REM_UNSIGNED:
+    return &exec<OP_REM_UNSIGNED>;
+  case OP_LSH:
+    return &exec<OP_LSH>;
+  case OP_RSH_SIGNED:
+    return &exec<OP_RSH_SIGNED>;
+  case OP_RSH_UNSIGNED:
+    return &exec<OP_RSH_UNSIGNED>;
+  case OP_LOG_NOT:
+    return &exec<OP_LOG_NOT>;
+  case OP_BIT_AND:
+    return &exec<OP_BIT_AND>;
+  case OP_BIT_OR:
+    return &exec<OP_BIT_OR>;
+  case OP_BIT_XOR:
+    return &exec<OP_BIT_XOR>;
+  case OP_BIT_NOT:
+    return &exec<OP_BIT_NOT>;
+  case OP_EQUAL:
+    return &exec<OP_EQUAL>;
+  case OP_LESS_SIGNED:
+    return &exec<OP_LESS_SIGNED>;
+  case OP_LESS_UNSIGNED:
+    return &exec<OP_LESS_UNSIGNED>;
+  case OP_EXT:
+    return &exec<OP_EXT>;
+  case OP_REF8:
+    return &exec<OP_REF8>;
+  case OP_REF16:
+    return &exec<OP_REF16>;
+  case OP_REF32:
+    return &exec<OP_REF32>;
+  case OP_REF64:
+    return &exec<OP_REF64>;
+  case OP_IF_GOTO:
+    return &exec<OP_IF_GOTO>;
+  case OP_GOTO:
+    return &exec<OP_GOTO>;
+  case OP_CONST8:
+  case OP_CONST16:
+  case OP_CONST32:
+  case OP_CONST64:
+    // The constant is already decoded, whatever its size
+    return &exec<OP_CONST8>;
+  case OP_REG:
+    return &exec<OP_REG>;
+  case OP_END:
+    return &exec<OP_END>;
+  case OP_DUP:
+    return &exec<OP_DUP>;
+  case OP_POP:
+    return &exec<OP_POP>;
+  case OP_ZERO_EXT:
+    return &exec<OP_ZERO_EXT>;
+  case OP_SWAP:
+    return &exec<OP_SWAP>;
+  case OP_PICK:
+    return &exec<OP_PICK>;
+  case OP_ROT:
+    return &exec<OP_ROT>;
+  case OP_PRINTF:
+    return &exec<OP_PRINTF>;
+  default:
+    return nullptr;
+  }
+}
+
+//! Execute an instruction
+
+//! The stack has already been checked to be deep enough, and to have room
+//! for any values pushed. Each instantiation only keeps its own case of the
+//! switch.
+
+//! @param[in]     insn   The instruction
+//! @param[in,out] state  The state of the evaluation
+//! @return  The next instruction, or nullptr if evaluation has finished or
+//!          failed
+
+template <uint8_t OP>
+const AgentExpr::Insn *AgentExpr::exec(const Insn *insn, State &state) {
+  uint64_t *sp = state.sp;
+  switch (OP) {
+  case OP_ADD:
+    sp[-2] += sp[-1];
+    state.sp = sp - 1;
+    break;
+  case OP_SUB:
+    sp[-2] -= sp[-1];
+    state.sp = sp - 1;
+    break;
+  case OP_MUL:
+    sp[-2] *= sp[-1];
+    state.sp = sp - 1;
+    break;
+  case OP_DIV_SIGNED:
+  case OP_REM_SIGNED: {
+    int64_t a = static_cast<int64_t>(sp[-2]);
+    int64_t b = static_cast<int64_t>(sp[-1]);
+    if (b == 0)
+      return nullptr;
+    // The one overflowing case
+    if ((b == -1) && (a == INT64_MIN))
+      sp[-2] = (OP == OP_DIV_SIGNED) ? sp[-2] : 0;
+    else
+      sp[-2] = static_cast<uint64_t>((OP == OP_DIV_SIGNED) ? a / b : a % b);
+    state.sp = sp - 1;
+    break;
+  }
+  case OP_DIV_UNSIGNED:
+    if (sp[-1] == 0)
+      return nullptr;
+    sp[-2] /= sp[-1];
+    state.sp = sp - 1;
+    break;
+  case OP_REM_UNSIGNED:
+    if (sp[-1] == 0)
+      return nullptr;
+    sp[-2] %= sp[-1];
+    state.sp = sp - 1;
+    break;
+  case OP_LSH:
+    sp[-2] = (sp[-1] < 64) ? sp[-2] << sp[-1] : 0;
+    state.sp = sp - 1;
+    break;
+  case OP_RSH_SIGNED: {
+    int64_t a = static_cast<int64_t>(sp[-2]);
+    sp[-2] = static_cast<uint64_t>(a >> (sp[-1] < 64 ? sp[-1] : 63));
+    state.sp = sp - 1;
+    break;
+  }
+  case OP_RSH_UNSIGNED:
+    sp[-2] = (sp[-1] < 64) ? sp[-2] >> sp[-1] : 0;
+    state.sp = sp - 1;
+    break;
+  case OP_LOG_NOT:
+    sp[-1] = (sp[-1] == 0) ? 1 : 0;
+    break;
+  case OP_BIT_AND:
+    sp[-2] &= sp[-1];
+    state.sp = sp - 1;
+    break;
+  case OP_BIT_OR:
+    sp[-2] |= sp[-1];
+    state.sp = sp - 1;
+    break;
+  case OP_BIT_XOR:
+    sp[-2] ^= sp[-1];
+    state.sp = sp - 1;
+    break;
+  case OP_BIT_NOT:
+    sp[-1] = ~sp[-1];
+    break;
+  case OP_EQUAL:
+    sp[-2] = (sp[-2] == sp[-1]) ? 1 : 0;
+    state.sp = sp - 1;
+    break;
+  case OP_LESS_SIGNED:
+    sp[-2] =
+        (static_cast<int64_t>(sp[-2]) < static_cast<int64_t>(sp[-1])) ? 1 : 0;
+    state.sp = sp - 1;
+    break;
+  case OP_LESS_UNSIGNED:
+    sp[-2] = (sp[-2] < sp[-1]) ? 1 : 0;
+    state.sp = sp - 1;
+    break;
+  case OP_EXT:
+    if (insn->arg < 64) {
+      uint64_t signBit = static_cast<uint64_t>(1) << (insn->arg - 1);
+      uint64_t mask = (static_cast<uint64_t>(1) << insn->arg) - 1;
+      sp[-1] = ((sp[-1] & mask) ^ signBit) - signBit;
+    }
+    break;
+  case OP_ZERO_EXT:
+    if (insn->arg < 64)
+      sp[-1] &= (static_cast<uint64_t>(1) << insn->arg) - 1;
+    break;
+  case OP_REF8:
+  case OP_REF16:
+  case OP_REF32:
+  case OP_REF64: {
+    std::size_t bytes = static_cast<std::size_t>(1) << ((OP - OP_REF8) & 3);
+    uint8_t buf[8];
+    if (!state.ctx->readMemory(sp[-1], buf, bytes))
+      return nullptr;
+
+    // Target memory is little endian
+    uint64_t value = 0;
+    for (std::size_t i = bytes; i > 0; i--)
+      value = (value << 8) | buf[i - 1];
+    sp[-1] = value;
+    break;
+  }
+  case OP_IF_GOTO:
+  case OP_GOTO: {
+    if (OP == OP_IF_GOTO) {
+      state.sp = sp - 1;
+      if (sp[-1] == 0)
+        break;
+    }
+
+    const Insn *target = state.code + insn->arg;
+    if ((target <= insn) && (++state.jumps > MAX_JUMPS))
+      return nullptr;
+    return target;
+  }
+  case OP_CONST8:
+    sp[0] = insn->arg;
+    state.sp = sp + 1;
+    break;
+  case OP_REG: {
+    uint_reg_t value;
+    if (!state.ctx->readRegister(static_cast<int>(insn->arg), value))
+      return nullptr;
+    sp[0] = value;
+    state.sp = sp + 1;
+    break;
+  }
+  case OP_END:
+    state.result = (insn->arg > 0) ? sp[-1] : 0;
+    state.done = true;
+    return nullptr;
+  case OP_DUP:
+    sp[0] = sp[-1];
+    state.sp = sp + 1;
+    break;
+  case OP_POP:
+    state.sp = sp - 1;
+    break;
+  case OP_SWAP: {
+    uint64_t tmp = sp[-2];
+    sp[-2] = sp[-1];
+    sp[-1] = tmp;
+    break;
+  }
+  case OP_PICK:
+    sp[0] = sp[-1 - static_cast<std::ptrdiff_t>(insn->arg)];
+    state.sp = sp + 1;
+    break;
+  case OP_ROT: {
+    // a b c => c a b
+    uint64_t c = sp[-1];
+    sp[-1] = sp[-2];
+    sp[-2] = sp[-3];
+    sp[-3] = c;
+    break;
+  }
+  case OP_PRINTF: {
+    // The arguments are below the function and channel, the first on top
+    std::size_t nargs = static_cast<std::size_t>(insn->arg & 0xff);
+    uint64_t args[STACK_SIZE];
+    for (std::size_t i = 0; i < nargs; i++)
+      args[i] = sp[-3 - static_cast<std::ptrdiff_t>(i)];
+
+    std::string text;
+    if (!format((*state.formats)[insn->arg >> 8], args, nargs, state.ctx,
+                &text))
+      return nullptr;
+    state.ctx->output(text);
+    state.sp = sp - (nargs + 2);
+    break;
+  }
+  }
+
+  return insn + 1;
+}
+
+//! Format the output of printf
+
+//! The conversions supported are those of C for integers, characters,
+//! strings and pointers, with flags, field width, precision and length
+//! modifiers. Without a length modifier, integers are int sized.
+
+//! With no output, just check the format is supported and has a conversion
+//! for each argument.
+
+//! @param[in]  fmt    The format
+//! @param[in]  args   The arguments
+//! @param[in]  nargs  The number of arguments
+//! @param[in]  ctx    Access to the target, for strings
+//! @param[out] out    The text, or nullptr to just check the format
+//! @return  TRUE if the format was used, FALSE otherwise
+
+bool AgentExpr::format(const std::string &fmt, const uint64_t *args,
+                       std::size_t nargs, Context *ctx, std::string *out) {
+  std::size_t argNum = 0;
+  std::size_t i = 0;
+  while (i < fmt.size()) {
+    if (fmt[i] != '%') {
+      if (out != nullptr)
+        out->push_back(fmt[i]);
+      i++;
+      continue;
+    }
+
+    if ((i + 1 < fmt.size()) && (fmt[i + 1] == '%')) {
+      if (out != nullptr)
+        out->push_back('%');
+      i += 2;
+      continue;
+    }
+
+    // Flags, field width and precision are passed on, but a large width or
+    // precision is rejected, since it would make the output as large.
+    std::size_t start = i++;
+    while ((i < fmt.size()) && (std::strchr("-+ #0", fmt[i]) != nullptr))
+      i++;
+    if (!fieldSize(fmt, i))
+      return false;
+    if ((i < fmt.size()) && (fmt[i] == '.')) {
+      i++;
+      if (!fieldSize(fmt, i))
+        return false;
+    }
+    std::string spec = fmt.substr(start, i - start);
+
+    // Length modifiers give the size of integers
+    int bits = 32;
+    if (fmt.compare(i, 2, "hh") == 0) {
+      bits = 8;
+      i += 2;
+    } else if (fmt.compare(i, 2, "ll") == 0) {
+      bits = 64;
+      i += 2;
+    } else if ((i < fmt.size()) && (fmt[i] == 'h')) {
+      bits = 16;
+      i++;
+    } else if ((i < fmt.size()) &&
+               (std::strchr("ljzt", fmt[i]) != nullptr)) {
+      bits = 64;
+      i++;
+    }
+
+    if ((i >= fmt.size()) || (argNum >= nargs) ||
+        (std::strchr("diouxXcsp", fmt[i]) == nullptr))
+      return false;
+    char conv = fmt[i++];
+    if (out == nullptr) {
+      argNum++;
+      continue;
+    }
+
+    uint64_t value = args[argNum++];
+    uint64_t mask =
+        (bits < 64) ? (static_cast<uint64_t>(1) << bits) - 1 : ~UINT64_C(0);
+    switch (conv) {
+    case 'd':
+    case 'i': {
+      uint64_t signBit = static_cast<uint64_t>(1) << (bits - 1);
+      long long sValue =
+          static_cast<long long>(((value & mask) ^ signBit) - signBit);
+      append(*out, spec + "ll" + conv, sValue);
+      break;
+    }
+    case 'c':
+      append(*out, spec + conv, static_cast<int>(value & 0xff));
+      break;
+    case 'p':
+      out->append("0x");
+      append(*out, spec + "llx", static_cast<unsigned long long>(value));
+      break;
+    case 's': {
+      std::string str;
+      for (uint_addr_t addr = value; str.size() < MAX_STRING; addr++) {
+        uint8_t ch;
+        if (!ctx->readMemory(addr, &ch, 1))
+          return false;
+        if (ch == 0)
+          break;
+        str.push_back(static_cast<char>(ch));
+      }
+      append(*out, spec + conv, str.c_str());
+      break;
+    }
+    default:
+      append(*out, spec + "ll" + conv,
+             static_cast<unsigned long long>(value & mask));
+      break;
+    }
+  }
+
+  return argNum == nargs;
+}
+
+//! Skip the digits of a printf field width or precision
+
+//! @param[in]     fmt  The format string
+//! @param[in,out] i    The index of the first digit, updated to the index
+//!                     after the last
+//! @return  TRUE if the width or precision is at most MAX_FIELD
+
+bool AgentExpr::fieldSize(const std::string &fmt, std::size_t &i) {
+  std::size_t size = 0;
+  while ((i < fmt.size()) && std::isdigit(static_cast<uint8_t>(fmt[i]))) {
+    if (size <= MAX_FIELD)
+      size = size * 10 + static_cast<std::size_t>(fmt[i] - '0');
+    i++;
+  }
+
+  return size <= MAX_FIELD;
+}
+
+//! Append a formatted value to a string
+
+//! @param[in,out] out    The string
+//! @param[in]     spec   The conversion specification
+//! @param[in]     value  The value
+
+template <typename T>
+void AgentExpr::append(std::string &out, const std::string &spec, T value) {
+  int len = std::snprintf(nullptr, 0, spec.c_str(), value);
+  if (len <= 0)
+    return;
+
+  std::vector<char> buf(static_cast<std::size_t>(len) + 1);
+  std::snprintf(buf.data(), buf.size(), spec.c_str(), value);
+  out.append(buf.data(), static_cast<std::size_t>(len));
+}
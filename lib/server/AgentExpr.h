@@ -0,0 +1,198 @@
+// GDB agent expression evaluator: declaration
+//
+// This file is part of the Embecosm GDB Server.
+//
+// Copyright (C) 2019 Embecosm Limited
+// SPDX-License-Identifier: GPL-3.0-or-later
+// ----------------------------------------------------------------------------
+
+#ifndef EMBDEBUG_AGENT_EXPR_H
+#define EMBDEBUG_AGENT_EXPR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "embdebug/Types.h"
+
+namespace EmbDebug {
+
+//! A GDB agent expression.
+
+//! Agent expressions are bytecode for a simple stack machine, which GDB
+//! sends to the server so that it can evaluate expressions (such as
+//! breakpoint conditions and dynamic printf commands) without the client
+//! being involved. See "Agent Expressions" in the GDB manual.
+
+//! The integer bytecodes and printf are supported. Floating point, tracing
+//! and trace state variable bytecodes are not, and an expression containing
+//! them is rejected when it is parsed.
+
+//! An expression is evaluated each time a breakpoint is hit, so the bytecode
+//! is compiled once, when it is parsed, into threaded code: an array of
+//! instructions, each with a pointer to the function which executes it and
+//! its operand already decoded. The depth of the stack at each instruction
+//! is worked out when compiling, as GDB does when it generates bytecode, so
+//! that bytecode which could underflow or overflow the stack is rejected,
+//! and evaluation need not check the stack.
+
+class AgentExpr {
+public:
+  //! Access to the target state an expression needs
+  class Context {
+  public:
+    virtual ~Context() {}
+
+    //! \brief Read a register
+    //!
+    //! \param[in]  reg    The register number
+    //! \param[out] value  The register value
+    //! \return  True if the register was read
+    virtual bool readRegister(int reg, uint_reg_t &value) = 0;
+
+    //! \brief Read memory
+    //!
+    //! \param[in]  addr  The address to read
+    //! \param[out] buf   The bytes read
+    //! \param[in]  size  The number of bytes to read
+    //! \return  True if all the bytes were read
+    virtual bool readMemory(uint_addr_t addr, uint8_t *buf,
+                            std::size_t size) = 0;
+
+    //! \brief Output text from printf
+    //!
+    //! \param[in] text  The text
+    virtual void output(const std::string &text) = 0;
+  };
+
+  // Constructor and destructor
+
+  AgentExpr();
+  ~AgentExpr();
+
+  // Set the bytecode
+
+  bool parse(const char *hex, std::size_t len);
+
+  // Evaluate the expression
+
+  bool evaluate(Context &ctx, uint64_t &result) const;
+
+private:
+  //! The bytecodes supported
+  enum Op : uint8_t {
+    OP_ADD = 0x02,
+    OP_SUB = 0x03,
+    OP_MUL = 0x04,
+    OP_DIV_SIGNED = 0x05,
+    OP_DIV_UNSIGNED = 0x06,
+    OP_REM_SIGNED = 0x07,
+    OP_REM_UNSIGNED = 0x08,
+    OP_LSH = 0x09,
+    OP_RSH_SIGNED = 0x0a,
+    OP_RSH_UNSIGNED = 0x0b,
+    OP_LOG_NOT = 0x0e,
+    OP_BIT_AND = 0x0f,
+    OP_BIT_OR = 0x10,
+    OP_BIT_XOR = 0x11,
+    OP_BIT_NOT = 0x12,
+    OP_EQUAL = 0x13,
+    OP_LESS_SIGNED = 0x14,
+    OP_LESS_UNSIGNED = 0x15,
+    OP_EXT = 0x16,
+    OP_REF8 = 0x17,
+    OP_REF16 = 0x18,
+    OP_REF32 = 0x19,
+    OP_REF64 = 0x1a,
+    OP_IF_GOTO = 0x20,
+    OP_GOTO = 0x21,
+    OP_CONST8 = 0x22,
+    OP_CONST16 = 0x23,
+    OP_CONST32 = 0x24,
+    OP_CONST64 = 0x25,
+    OP_REG = 0x26,
+    OP_END = 0x27,
+    OP_DUP = 0x28,
+    OP_POP = 0x29,
+    OP_ZERO_EXT = 0x2a,
+    OP_SWAP = 0x2b,
+    OP_PICK = 0x32,
+    OP_ROT = 0x33,
+    OP_PRINTF = 0x34,
+  };
+
+  //! Maximum depth of the stack
+
+  static const int STACK_SIZE = 64;
+
+  //! Maximum number of backward jumps taken in one evaluation, so that an
+  //! expression which loops forever does not hang the server.
+
+  static const std::size_t MAX_JUMPS = 100000;
+
+  //! Maximum length of a string printed by printf
+
+  static const std::size_t MAX_STRING = 1024;
+
+  //! Maximum field width and precision in a printf format, so that a format
+  //! cannot make the output arbitrarily large
+
+  static const std::size_t MAX_FIELD = 256;
+
+  //! State of an evaluation
+
+  struct State;
+
+  //! A compiled instruction
+
+  struct Insn;
+  typedef const Insn *(*Handler)(const Insn *insn, State &state);
+
+  struct Insn {
+    //! Executes the instruction, returning the next instruction, or nullptr
+    //! when evaluation is finished.
+
+    Handler handler;
+
+    //! The operand. For jumps, the index of the instruction jumped to. For
+    //! printf, the index of the format string, shifted left 8 bits, and the
+    //! number of arguments. For end, the depth of the stack.
+
+    uint64_t arg;
+
+    //! The bytecode
+    uint8_t op;
+  };
+
+  //! The compiled bytecode
+
+  std::vector<Insn> mInsns;
+
+  //! The printf format strings
+
+  std::vector<std::string> mFormats;
+
+  // Compile the bytecode
+
+  bool compile(const std::vector<uint8_t> &code);
+  bool checkStack();
+  static int operandSize(uint8_t op);
+  static Handler handler(uint8_t op);
+
+  // Format printf output
+
+  static bool format(const std::string &fmt, const uint64_t *args,
+                     std::size_t nargs, Context *ctx, std::string *out);
+  static bool fieldSize(const std::string &fmt, std::size_t &i);
+  template <typename T>
+  static void append(std::string &out, const std::string &spec, T value);
+
+  // Execute an instruction
+
+  template <uint8_t OP> static const Insn *exec(const Insn *insn, State &state);
+};
+
+} // namespace EmbDebug
+
+#endif
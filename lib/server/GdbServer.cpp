@@ -9,6 +9,7 @@
 #include <algorithm>
 #include <chrono>
 #include <climits>
+#include <cstdlib>
 #include <cstring>
 #include <iomanip>
 #include <iostream>
@@ -22,6 +23,7 @@
 
 #include "AbstractConnection.h"
 #include "GdbServer.h"
+#include "RspCodec.h"
 #include "SyscallReplyPacket.h"
 #include "TraceFlags.h"
 #include "Utils.h"
@@ -54,12 +56,35 @@ using namespace EmbDebug;
 GdbServer::GdbServer(AbstractConnection *_conn, ITarget *_cpu,
                      TraceFlags *traceFlags, KillBehaviour _killBehaviour)
     : cpu(_cpu), traceFlags(traceFlags), rsp(_conn),
-      mNumRegs(cpu->getRegisterCount()), pkt(), mMatchpointMap(),
-      killBehaviour(_killBehaviour), mExitServer(false), mHaveMultiProc(false),
-      mStopMode(StopMode::ALL_STOP), mPtid(PID_DEFAULT, TID_DEFAULT),
-      mNextProcess(1), mHandlingSyscall(false), mHaveSyscallArgLocs(false),
+      mNumRegs(cpu->getRegisterCount()), pkt(), mMemBuf(),
+      mRegCache(cpu->getCpuCount(), mNumRegs), mRegVals(mNumRegs),
+      mRegSizes(mNumRegs), mMemCache(cpu, cpu->getCpuCount()),
+      mPcReg(cpu->getRegisterNumber(ITarget::RegisterRole::PC)),
+      mMatchpointMap(), mPendingRemovals(0), mLastWaitTimedOut(false),
+      killBehaviour(_killBehaviour),
+      mExitServer(false), mHaveMultiProc(false), mHaveSwBreak(false),
+      mHaveHwBreak(false), mStopMode(StopMode::ALL_STOP),
+      mPtid(PID_DEFAULT, TID_DEFAULT), mNextProcess(1),
+      mHandlingSyscall(false), mHaveSyscallArgLocs(false),
       mHaveSyscallSupport(false), mKillCoreOnExit(false),
-      mCoreManager(cpu->getCpuCount()) {}
+      mCoreManager(cpu->getCpuCount()) {
+  // The registers to expedite in stop replies: the PC, SP and FP, followed by
+  // any others the target asks for, without duplicates.
+  cpu->getExpeditedRegisters(mExpeditedRegs);
+  const ITarget::RegisterRole roles[] = {ITarget::RegisterRole::PC,
+                                         ITarget::RegisterRole::SP,
+                                         ITarget::RegisterRole::FP};
+  std::vector<int> regs;
+  for (ITarget::RegisterRole role : roles)
+    regs.push_back(cpu->getRegisterNumber(role));
+  regs.insert(regs.end(), mExpeditedRegs.begin(), mExpeditedRegs.end());
+
+  mExpeditedRegs.clear();
+  for (int reg : regs)
+    if ((reg >= 0) && (std::find(mExpeditedRegs.begin(), mExpeditedRegs.end(),
+                                 reg) == mExpeditedRegs.end()))
+      mExpeditedRegs.push_back(reg);
+}
 
 //! Destructor
 
@@ -87,10 +112,34 @@ int GdbServer::rspServer() {
       // guessing that in most cases a disconnect and reconnect implies
       // that we're starting again with the target and would like all
       // cores to spring back to life.
+      // Breakpoints left by the previous client would otherwise stop the
+      // target with nobody expecting them.
+      leaveNonStop();
+      removeAllMatchpoints();
       mCoreManager.reset();
+      invalidateCaches();
+    }
+
+    // In non-stop mode cores keep running while the client is served, so
+    // the target is watched for stops whenever the client is quiet. Memory
+    // may be changed by running cores, so is not cached between requests.
+    if ((mStopMode == StopMode::NON_STOP) &&
+        mCoreManager.isAnyCoreRunning()) {
+      if (!rsp->havePkt()) {
+        if (rsp->haveBreak()) {
+          for (unsigned int i = 0; i < mCoreManager.getCpuCount(); ++i)
+            if (mCoreManager[i].isRunning())
+              haltCore(i, TargetSignal::INT);
+        } else
+          waitNonStop();
+        continue;
+      }
+
+      mMemCache.invalidate();
     }
 
     // Get a RSP client request
+    rsp->stopWatch();
     rspClientRequest();
   }
 
@@ -100,28 +149,58 @@ int GdbServer::rspServer() {
 //! Some F request packets want to know the length of the string
 //! argument, so we have this simple function here to calculate that.
 
+//! The string is read in aligned chunks, so that no read crosses a page
+//! boundary. If the target reads only part of a chunk (for example because
+//! the chunk extends past the end of memory), and that part has no
+//! terminating zero, the rest of the chunk is read a byte at a time.
+
+//! @param[in] addr  The address of the string
+//! @return  The length of the string, including the terminating zero, or as
+//!          much of it as could be read.
+
 int GdbServer::stringLength(uint_addr_t addr) {
-  uint8_t ch;
+  uint8_t chunk[STRING_CHUNK_SIZE];
   int count = 0;
-  while (1 == cpu->read(addr + count, &ch, 1)) {
-    count++;
-    if (ch == 0)
-      break;
+
+  while (true) {
+    uint_addr_t chunkAddr = addr + count;
+    std::size_t chunkLen =
+        STRING_CHUNK_SIZE - (chunkAddr & (STRING_CHUNK_SIZE - 1));
+    std::size_t readLen = cpu->read(chunkAddr, chunk, chunkLen);
+    const void *end = memchr(chunk, 0, readLen);
+
+    if ((end == nullptr) && (readLen < chunkLen)) {
+      // Fall back to reading the rest of the chunk a byte at a time
+      while (readLen < chunkLen &&
+             1 == cpu->read(chunkAddr + readLen, &chunk[readLen], 1)) {
+        readLen++;
+        if (chunk[readLen - 1] == 0)
+          break;
+      }
+      end = memchr(chunk, 0, readLen);
+    }
+
+    if (end != nullptr)
+      return count + static_cast<int>(static_cast<const uint8_t *>(end) -
+                                      chunk) + 1;
+
+    count += static_cast<int>(readLen);
+    if (readLen < chunkLen)
+      return count;
   }
-  return count;
 }
 
 uint_reg_t GdbServer::readArgLoc(const ITarget::SyscallArgLoc &loc) {
   if (loc.type == ITarget::SyscallArgLocType::REGISTER) {
     uint_reg_t reg;
-    cpu->readRegister(loc.regLoc.reg, reg);
+    readReg(loc.regLoc.reg, reg);
     return reg;
   } else {
     assert(loc.type == ITarget::SyscallArgLocType::REGISTER_INDIRECT);
 
     // read the register and add the offset
     uint_reg_t reg;
-    cpu->readRegister(loc.regIndirectLoc.reg, reg);
+    readReg(loc.regIndirectLoc.reg, reg);
     uint_addr_t addr = (uint_addr_t)reg + loc.regIndirectLoc.offset;
 
     // read and return the memory
@@ -138,6 +217,75 @@ uint_reg_t GdbServer::readArgLoc(const ITarget::SyscallArgLoc &loc) {
   return 0;
 }
 
+//! Read the first count syscall arguments
+
+//! If the registers holding the arguments (or their addresses) are
+//! consecutive, they are read from the target together, and any arguments
+//! in memory are also read together, so that a target which supports bulk
+//! access can fetch the arguments in as few transactions as possible.
+
+//! @param[in]  count  The number of arguments to read
+//! @param[out] args   The argument values
+
+void GdbServer::readArgLocs(std::size_t count, std::vector<uint_reg_t> &args) {
+  assert(count <= mSyscallArgLocs.size());
+
+  // Which registers are needed?
+  std::vector<int> regs;
+  for (std::size_t i = 0; i < count; i++) {
+    const ITarget::SyscallArgLoc &loc = mSyscallArgLocs[i];
+    if (loc.type == ITarget::SyscallArgLocType::REGISTER)
+      regs.push_back(loc.regLoc.reg);
+    else
+      regs.push_back(loc.regIndirectLoc.reg);
+  }
+  std::sort(regs.begin(), regs.end());
+  regs.erase(std::unique(regs.begin(), regs.end()), regs.end());
+
+  // Read them into the register cache in one go if possible.
+  int numRegs = static_cast<int>(regs.size());
+  if ((numRegs > 1) && (regs.front() >= 0) && (regs.back() < mNumRegs) &&
+      (regs.back() - regs.front() + 1 == numRegs))
+    readRegs(regs.front(), numRegs, &mRegVals[regs.front()],
+             &mRegSizes[regs.front()]);
+
+  // Gather the arguments, noting those which are in memory.
+  std::size_t byteSize = cpu->getRegisterSize();
+  std::vector<ITarget::MemoryRange> ranges;
+  args.resize(count);
+  for (std::size_t i = 0; i < count; i++) {
+    const ITarget::SyscallArgLoc &loc = mSyscallArgLocs[i];
+    if (loc.type == ITarget::SyscallArgLocType::REGISTER) {
+      readReg(loc.regLoc.reg, args[i]);
+    } else {
+      uint_reg_t reg;
+      readReg(loc.regIndirectLoc.reg, reg);
+      ranges.push_back(
+          {(uint_addr_t)reg + loc.regIndirectLoc.offset, byteSize});
+    }
+  }
+
+  if (ranges.empty())
+    return;
+
+  // Read the arguments in memory
+  std::vector<uint8_t> buf(ranges.size() * byteSize);
+  std::size_t ret = cpu->readv(ranges.data(), ranges.size(), buf.data());
+  assert(ret == buf.size());
+  (void)ret;
+
+  const uint8_t *next = buf.data();
+  for (std::size_t i = 0; i < count; i++) {
+    if (mSyscallArgLocs[i].type != ITarget::SyscallArgLocType::REGISTER) {
+      uint_reg_t value = 0;
+      for (std::size_t b = 0; b < byteSize; ++b)
+        value |= static_cast<uint_reg_t>(next[b]) << b * CHAR_BIT;
+      args[i] = value;
+      next += byteSize;
+    }
+  }
+}
+
 //! We achieve a syscall on the host by sending an F request packet to
 //! the GDB client. The arguments for the call will have already been
 //! put into registers via its newlib/libgloss implementation.
@@ -170,33 +318,29 @@ void GdbServer::rspSyscallRequest() {
   std::vector<uint_reg_t> args;
   switch (syscallID) {
   case 57:
-    args.push_back(readArgLoc(mSyscallArgLocs[0]));
+    readArgLocs(1, args);
     rsp->putPkt(RspPacket::CreateFormatted("Fclose,%" PRIxREG, args[0]));
     return;
   case 62:
-    for (int i = 0; i < 3; ++i)
-      args.push_back(readArgLoc(mSyscallArgLocs[i]));
+    readArgLocs(3, args);
     rsp->putPkt(RspPacket::CreateFormatted("Flseek,%" PRIxREG ",%" PRIxREG
                                            ",%" PRIxREG,
                                            args[0], args[1], args[2]));
     return;
   case 63:
-    for (int i = 0; i < 3; ++i)
-      args.push_back(readArgLoc(mSyscallArgLocs[i]));
+    readArgLocs(3, args);
     rsp->putPkt(RspPacket::CreateFormatted("Fread,%" PRIxREG ",%" PRIxREG
                                            ",%" PRIxREG,
                                            args[0], args[1], args[2]));
     return;
   case 64:
-    for (int i = 0; i < 3; ++i)
-      args.push_back(readArgLoc(mSyscallArgLocs[i]));
+    readArgLocs(3, args);
     rsp->putPkt(RspPacket::CreateFormatted("Fwrite,%" PRIxREG ",%" PRIxREG
                                            ",%" PRIxREG,
                                            args[0], args[1], args[2]));
     return;
   case 80:
-    for (int i = 0; i < 2; ++i)
-      args.push_back(readArgLoc(mSyscallArgLocs[i]));
+    readArgLocs(2, args);
     rsp->putPkt(RspPacket::CreateFormatted("Ffstat,%" PRIxREG ",%" PRIxREG,
                                            args[0], args[1]));
     return;
@@ -205,7 +349,7 @@ void GdbServer::rspSyscallRequest() {
       cerr << "EXIT syscall on core " << cpu->getCurrentCpu()
            << " halting all other cores." << endl;
     (void)cpu->halt();
-    args.push_back(readArgLoc(mSyscallArgLocs[0]));
+    readArgLocs(1, args);
     if (mHaveMultiProc)
       rsp->putPkt(RspPacket::CreateFormatted(
           "W%" PRIxREG ";process:%x", args[0],
@@ -220,26 +364,23 @@ void GdbServer::rspSyscallRequest() {
     return;
   }
   case 169:
-    for (int i = 0; i < 2; ++i)
-      args.push_back(readArgLoc(mSyscallArgLocs[i]));
+    readArgLocs(2, args);
     rsp->putPkt(RspPacket::CreateFormatted(
         "Fgettimeofday,%" PRIxREG ",%" PRIxREG, args[0], args[1]));
     return;
   case 1024:
-    for (int i = 0; i < 3; ++i)
-      args.push_back(readArgLoc(mSyscallArgLocs[i]));
+    readArgLocs(3, args);
     rsp->putPkt(RspPacket::CreateFormatted(
         "Fopen,%" PRIxREG "/%x,%" PRIxREG ",%" PRIxREG, args[0],
         stringLength(args[0]), args[1], args[2]));
     return;
   case 1026:
-    args.push_back(readArgLoc(mSyscallArgLocs[0]));
+    readArgLocs(1, args);
     rsp->putPkt(RspPacket::CreateFormatted("Funlink,%" PRIxREG "/%x", args[0],
                                            stringLength(args[0])));
     return;
   case 1038:
-    for (int i = 0; i < 2; ++i)
-      args.push_back(readArgLoc(mSyscallArgLocs[i]));
+    readArgLocs(2, args);
     rsp->putPkt(RspPacket::CreateFormatted("Fstat,%" PRIxREG "/%x,%" PRIxREG,
                                            args[0], stringLength(args[0]),
                                            args[1]));
@@ -266,7 +407,7 @@ void GdbServer::rspSyscallReply() {
     int retcode = p.retcode();
 
     if (retcode != -1)
-      cpu->writeRegister(10, retcode);
+      writeReg(10, retcode);
 
     if (p.hasCtrlC()) {
       // Due to timing between packet send and receive and interrupts
@@ -317,13 +458,91 @@ void GdbServer::doCoreActions(void) {
 
   mTimeout.timeStamp(cpu);
 
+  // Stops at breakpoints whose conditions are false, or which have commands,
+  // are not reported. The cores which made them are stepped past the
+  // breakpoint and the target resumed again. Nor are steps which stay within
+  // the range of a range step the server is doing.
+  std::vector<std::pair<unsigned int, MatchpointMap::iterator>> skipped;
+  for (;;) {
+    // Take out the matchpoints the client no longer wants, in one batch
+    flushMatchpoints();
+
+    std::vector<ITarget::ResumeRes> results;
+    if (!resumeAndWait(results))
+      return;
+
+    for (unsigned int i = 0; i < mCoreManager.getCpuCount(); ++i) {
+      if (mCoreManager[i].isRunning()) {
+        if (mCoreManager[i].hasUnreportedStop()) {
+          std::ostringstream fmt_stream;
+          fmt_stream << "Core " << dec << i
+                     << " stopped, but already had a stop "
+                        "event pending";
+          Utils::fatalError(fmt_stream.str());
+        }
+        mCoreManager[i].setStopReason(results[i]);
+      }
+    }
+
+    // Breakpoints may be skipped, or a range stepped through, for a long
+    // time, each stop coming before wait() would return TIMEOUT, so check
+    // for a break or timeout between resumes.
+    if (skipConditionalStops(skipped)) {
+      // If stepping over a breakpoint stopped, that has been reported
+      if (!stepOverBreakpoints(skipped) || reportBreakOrTimeout())
+        return;
+    } else if (stepWithinRanges()) {
+      if (reportBreakOrTimeout())
+        return;
+
+      std::vector<ITarget::ResumeType> actions;
+      for (unsigned int i = 0; i < mCoreManager.getCpuCount(); ++i)
+        actions.push_back(mCoreManager[i].targetResumeType());
+      cpu->prepare(actions);
+    } else {
+      break;
+    }
+  }
+
+  if (!processStopEvents())
+    Utils::fatalError("No stop event processed");
+}
+
+//! Check for a break or timeout while the server resumes the target itself
+
+//! If either has happened, the stop is reported to the client.
+
+//! @return  TRUE if a break or timeout was reported, FALSE otherwise
+
+bool GdbServer::reportBreakOrTimeout() {
+  bool haveBreak = rsp->haveBreak();
+  if (!haveBreak && !mTimeout.timedOut(cpu))
+    return false;
+
+  rspReportException(haveBreak ? TargetSignal::INT : TargetSignal::XCPU);
+  return true;
+}
+
+//! Resume the target and wait for it to stop
+
+//! If the client breaks, or the timeout expires, the target is halted and
+//! the stop reported to the client.
+
+//! @param[out] results  Why each core stopped
+//! @return  TRUE if the target stopped by itself, FALSE if it was halted
+
+bool GdbServer::resumeAndWait(std::vector<ITarget::ResumeRes> &results) {
+  // Registers and memory are about to change
+  invalidateCaches();
+
   if (!cpu->resume())
     Utils::fatalError("Failed to resume target");
 
   // Tell the target to resume this set of actions.
-  std::vector<ITarget::ResumeRes> results;
   ITarget::WaitRes waitres;
-  while ((waitres = cpu->wait(results)) == ITarget::WaitRes::TIMEOUT) {
+  mLastWaitTimedOut = false;
+  while ((waitres = waitTarget(results, mTimeout.pollTimeout())) ==
+         ITarget::WaitRes::TIMEOUT) {
     bool haveBreak;
 
     // Check for a break from gdb.
@@ -334,16 +553,18 @@ void GdbServer::doCoreActions(void) {
       // Force the target to stop. Ignore return value.
       TargetSignal sig;
 
+      rsp->stopWatch();
       if (traceFlags->traceExec())
         cerr << "Break detected in gdbserver, halting all cores" << endl;
       if (!cpu->halt())
         Utils::fatalError("Failed to halt cores");
       sig = haveBreak ? TargetSignal::INT : TargetSignal::XCPU;
       rspReportException(sig);
-      return;
+      return false;
     }
   }
 
+  rsp->stopWatch();
   if (waitres == ITarget::WaitRes::ERROR)
     Utils::fatalError("Error returned from call to wait()");
 
@@ -356,21 +577,190 @@ void GdbServer::doCoreActions(void) {
     Utils::fatalError(fmt_stream.str());
   }
 
+  return true;
+}
+
+//! Find whether the stops of the target need not be reported
+
+//! A stop is skipped if a continuing core was interrupted at a breakpoint
+//! with conditions, none of which is true, or at a breakpoint with commands,
+//! which are run if the conditions hold. If any other stop is pending, all
+//! are reported, and the client evaluates the conditions itself. Skipped
+//! stops are marked as reported.
+
+//! @param[out] skipped  The cores whose stops were skipped, and the
+//!                      breakpoints they stopped at
+//! @return  TRUE if all the stops were skipped, FALSE otherwise
+
+bool GdbServer::skipConditionalStops(
+    std::vector<std::pair<unsigned int, MatchpointMap::iterator>> &skipped) {
+  skipped.clear();
+
+  // Don't read the PC of every core for every stop, unless there is some
+  // breakpoint with conditions or commands.
+  bool haveAgentExprs = false;
+  for (const auto &entry : mMatchpointMap)
+    if (entry.second.wanted && (!entry.second.conditions.empty() ||
+                                !entry.second.commands.empty()))
+      haveAgentExprs = true;
+  if (!haveAgentExprs || (mPcReg < 0))
+    return false;
+
+  // Commands are run for every core stopped at their breakpoint, even if
+  // some stop is reported, as the client does not run them itself.
+  bool skipAll = true;
   for (unsigned int i = 0; i < mCoreManager.getCpuCount(); ++i) {
-    if (mCoreManager[i].isRunning()) {
-      if (mCoreManager[i].hasUnreportedStop()) {
-        std::ostringstream fmt_stream;
-        fmt_stream << "Core " << dec << i
-                   << " stopped, but already had a stop "
-                      "event pending";
-        Utils::fatalError(fmt_stream.str());
+    if (!mCoreManager[i].isRunning() || !mCoreManager[i].hasUnreportedStop() ||
+        (mCoreManager[i].stopReason() == ITarget::ResumeRes::NONE))
+      continue;
+
+    if ((mCoreManager[i].stopReason() != ITarget::ResumeRes::INTERRUPTED) ||
+        (mCoreManager[i].resumeType() != ITarget::ResumeType::CONTINUE)) {
+      skipAll = false;
+      continue;
+    }
+
+    setCurrentCore(i);
+    uint_reg_t pc;
+    if (readReg(mPcReg, pc) == 0) {
+      skipAll = false;
+      continue;
+    }
+
+    auto it = mMatchpointMap.find({MatchpointType::BP_MEMORY, pc});
+    if ((it == mMatchpointMap.end()) || !it->second.wanted)
+      it = mMatchpointMap.find({MatchpointType::BP_HARDWARE, pc});
+    if ((it == mMatchpointMap.end()) || !it->second.wanted) {
+      skipAll = false;
+      continue;
+    }
+
+    const Matchpoint &mp = it->second;
+    if (conditionHolds(mp)) {
+      if (mp.commands.empty()) {
+        skipAll = false;
+        continue;
       }
-      mCoreManager[i].setStopReason(results[i]);
+      runCommands(mp);
     }
+
+    skipped.push_back({i, it});
   }
 
-  if (!processStopEvents())
-    Utils::fatalError("No stop event processed");
+  if (!skipAll) {
+    skipped.clear();
+    return false;
+  }
+
+  for (const auto &entry : skipped)
+    mCoreManager[entry.first].setStopReason(ITarget::ResumeRes::NONE);
+  return !skipped.empty();
+}
+
+//! Step cores past the breakpoints they stopped at
+
+//! Each core is stepped on its own with its breakpoint taken out of the
+//! target. The target is then prepared to resume as the client asked. If a
+//! step does not simply complete, the stop is reported to the client.
+
+//! @param[in] skipped  The cores to step, and the breakpoints they stopped
+//!                     at
+//! @return  TRUE if the target should be resumed, FALSE if a stop has been
+//!          reported
+
+bool GdbServer::stepOverBreakpoints(
+    const std::vector<std::pair<unsigned int, MatchpointMap::iterator>>
+        &skipped) {
+  for (const auto &entry : skipped) {
+    unsigned int core = entry.first;
+    MatchpointType type = entry.second->first.first;
+    uint_addr_t addr = entry.second->first.second;
+    const Matchpoint &mp = entry.second->second;
+
+    setCurrentCore(core);
+    if (!removeFromTarget(type, addr, mp))
+      cerr << "Warning: Failed to remove " << type << " matchpoint at 0x"
+           << hex << addr << dec << " to step over it" << endl;
+
+    std::vector<ITarget::ResumeType> actions(mCoreManager.getCpuCount(),
+                                             ITarget::ResumeType::NONE);
+    actions[core] = ITarget::ResumeType::STEP;
+    cpu->prepare(actions);
+
+    std::vector<ITarget::ResumeRes> results;
+    bool stopped = resumeAndWait(results);
+
+    // Put the breakpoint back
+    uint8_t instr[sizeof(mp.savedInstr)];
+    setCurrentCore(core);
+    if (mp.emulated ? !(breakInstr(mp.kind, instr) &&
+                        writeMem(addr, instr, mp.kind))
+                    : !cpu->insertMatchpoint(
+                          addr, static_cast<ITarget::MatchType>(type)))
+      cerr << "Warning: Failed to reinsert " << type << " matchpoint at 0x"
+           << hex << addr << dec << endl;
+
+    if (!stopped)
+      return false;
+
+    if (results[core] != ITarget::ResumeRes::STEPPED) {
+      mCoreManager[core].setStopReason(results[core]);
+      if (!processStopEvents())
+        Utils::fatalError("No stop event processed");
+      return false;
+    }
+  }
+
+  std::vector<ITarget::ResumeType> actions;
+  for (unsigned int i = 0; i < mCoreManager.getCpuCount(); ++i)
+    actions.push_back(mCoreManager[i].targetResumeType());
+  cpu->prepare(actions);
+  return true;
+}
+
+//! Find whether the stops of the target are all steps within a range
+
+//! When the target declines to range step a core, the server single steps
+//! it, and only reports the stop once it leaves its range, or stops at a
+//! breakpoint. If any other stop is pending, all are reported. Stops which
+//! are not reported are marked as reported.
+
+//! @return  TRUE if the target should step again, FALSE otherwise
+
+bool GdbServer::stepWithinRanges() {
+  if (mPcReg < 0)
+    return false;
+
+  std::vector<unsigned int> stepping;
+  for (unsigned int i = 0; i < mCoreManager.getCpuCount(); ++i) {
+    if (!mCoreManager[i].isRunning() || !mCoreManager[i].hasUnreportedStop() ||
+        (mCoreManager[i].stopReason() == ITarget::ResumeRes::NONE))
+      continue;
+
+    if (!mCoreManager[i].serverStepsRange() ||
+        (mCoreManager[i].stopReason() != ITarget::ResumeRes::STEPPED))
+      return false;
+
+    setCurrentCore(i);
+    uint_reg_t pc;
+    if ((readReg(mPcReg, pc) == 0) || !mCoreManager[i].inStepRange(pc))
+      return false;
+
+    // The client decides what to do at a breakpoint, as a target would
+    // stop there when range stepping.
+    for (MatchpointType type :
+         {MatchpointType::BP_MEMORY, MatchpointType::BP_HARDWARE}) {
+      auto it = mMatchpointMap.find({type, pc});
+      if ((it != mMatchpointMap.end()) && it->second.wanted)
+        return false;
+    }
+
+    stepping.push_back(i);
+  }
+
+  for (unsigned int core : stepping)
+    mCoreManager[core].setStopReason(ITarget::ResumeRes::NONE);
+  return !stepping.empty();
 }
 
 //! Extracts the next stop event that we should process by looking
@@ -428,7 +818,7 @@ bool GdbServer::processStopEvents(void) {
 
   if (getNextStopEvent(cpuNum, res)) {
     mCoreManager[cpuNum].reportStopReason();
-    cpu->setCurrentCpu(cpuNum);
+    setCurrentCore(cpuNum);
     switch (res) {
     case ITarget::ResumeRes::SYSCALL:
       // @todo this change of current cpu here is probably dangerous, after
@@ -468,6 +858,148 @@ bool GdbServer::processStopEvents(void) {
   return false;
 }
 
+//! The signal to report for a stop
+
+//! @param[in] res  Why the core stopped
+//! @return  The signal
+
+GdbServer::TargetSignal GdbServer::stopSignal(ITarget::ResumeRes res) {
+  return (res == ITarget::ResumeRes::LOCKSTEP) ? TargetSignal::USR1
+                                               : TargetSignal::TRAP;
+}
+
+//! Wait for the target
+
+//! If the target provides a file descriptor for its stop events, sleep
+//! until it or the client has something for the server first, rather than
+//! spinning on wait() returning TIMEOUT.
+
+//! Otherwise, once wait() has returned TIMEOUT, the client is watched from
+//! another thread, which interrupts wait() as soon as the client sends
+//! anything, so that how quickly a break is seen does not depend on how
+//! long the target runs before returning TIMEOUT. Runs which stop first,
+//! such as the steps the server makes itself, do not start a thread. The
+//! watcher is stopped before the client is next served.
+
+//! Each wait is measured, to adapt how long the target may run in the next.
+
+//! @param[out] results    Why each core stopped
+//! @param[in]  timeoutMs  The longest time to sleep in milliseconds, or -1
+//!                        to sleep until an event
+//! @return  The result of waiting
+
+ITarget::WaitRes GdbServer::waitTarget(std::vector<ITarget::ResumeRes> &results,
+                                       int timeoutMs) {
+  int eventFd = cpu->getEventFd();
+  if (eventFd >= 0)
+    rsp->waitForInput(eventFd, timeoutMs);
+  else if (mLastWaitTimedOut)
+    (void)rsp->startWatch([this]() { cpu->interruptWait(); });
+
+  mWaitBudget.startWait(cpu);
+  ITarget::WaitRes waitres = cpu->wait(results);
+  mLastWaitTimedOut = (waitres == ITarget::WaitRes::TIMEOUT);
+  mWaitBudget.endWait(cpu, mLastWaitTimedOut);
+  return waitres;
+}
+
+//! Wait for cores to stop in non-stop mode
+
+//! The target returns when some core stops, or after a while if none has,
+//! so that the client can be served. Each core which stopped has its stop
+//! queued for the client. Syscalls are reported as traps, since the client
+//! cannot serve them while other cores are running.
+
+void GdbServer::waitNonStop() {
+  std::vector<ITarget::ResumeRes> results;
+  ITarget::WaitRes waitres = waitTarget(results, -1);
+  if (waitres == ITarget::WaitRes::TIMEOUT)
+    return;
+
+  if (waitres == ITarget::WaitRes::ERROR)
+    Utils::fatalError("Error returned from call to wait()");
+
+  if (results.size() != mCoreManager.getCpuCount()) {
+    std::ostringstream fmt_stream;
+    fmt_stream << "wait() returned incorrect number of results, got "
+               << results.size() << " results, but expected "
+               << mCoreManager.getCpuCount();
+    Utils::fatalError(fmt_stream.str());
+  }
+
+  for (unsigned int i = 0; i < mCoreManager.getCpuCount(); ++i) {
+    if (!mCoreManager[i].isRunning() ||
+        (results[i] == ITarget::ResumeRes::NONE))
+      continue;
+
+    if (traceFlags->traceExec())
+      cerr << "waitNonStop: " << results[i] << " (core " << i << ")" << endl;
+    mCoreManager[i].setResumeType(ITarget::ResumeType::NONE);
+    mCoreManager[i].setStopReason(results[i]);
+    queueStopReply(i, stopSignal(results[i]));
+  }
+}
+
+//! Halt one running core in non-stop mode
+
+//! @param[in] core  The core to halt
+//! @param[in] sig   The signal to report for the stop
+
+void GdbServer::haltCore(unsigned int core, TargetSignal sig) {
+  if (!cpu->haltCpu(core))
+    Utils::fatalError("Failed to halt core");
+
+  mCoreManager[core].setResumeType(ITarget::ResumeType::NONE);
+  mCoreManager[core].setStopReason(ITarget::ResumeRes::INTERRUPTED);
+  queueStopReply(core, sig);
+}
+
+//! Queue the stop of a core for the client in non-stop mode
+
+//! If no other stop is waiting for the client, it is told with a
+//! notification. Otherwise it collects the stop with vStopped.
+
+//! @param[in] core  The core which stopped
+//! @param[in] sig   The signal to report
+
+void GdbServer::queueStopReply(unsigned int core, TargetSignal sig) {
+  mCoreManager[core].reportStopReason();
+
+  RspPacketBuilder reply;
+  buildStopReply(core, sig, reply);
+  mStopQueue.emplace_back(reply.getRawData(), reply.getSize());
+
+  if (mStopQueue.size() == 1) {
+    RspPacketBuilder notification;
+    notification += "Stop:";
+    notification.addData(reply.getRawData(), reply.getSize());
+    rsp->putNotification(notification);
+  }
+}
+
+//! Return to all-stop mode
+
+//! Any running cores are halted, and stops the client has not collected are
+//! dropped, since it asks for them again when it changes mode.
+
+void GdbServer::leaveNonStop() {
+  if (mStopMode != StopMode::NON_STOP)
+    return;
+
+  if (mCoreManager.isAnyCoreRunning() && !cpu->halt())
+    Utils::fatalError("Failed to halt cores");
+
+  for (unsigned int i = 0; i < mCoreManager.getCpuCount(); ++i) {
+    mCoreManager[i].setResumeType(ITarget::ResumeType::NONE);
+    mCoreManager[i].setStopReason(ITarget::ResumeRes::INTERRUPTED);
+    mCoreManager[i].reportStopReason();
+  }
+
+  (void)cpu->setNonStop(false);
+  mStopQueue.clear();
+  mStopMode = StopMode::ALL_STOP;
+}
+
 //! Deal with a request from the GDB client session
 
 //! In general, apart from the simplest requests, this function replies on
@@ -495,8 +1027,9 @@ void GdbServer::rspClientRequest() {
 
   case '?':
     // Return last signal ID
-    {
-      // @todo We need to handle asynchronous stops for non-stop mode.
+    if (mStopMode == StopMode::NON_STOP) {
+      rspStopReasonsNonStop();
+    } else {
       ITarget::ResumeRes stopReason =
           mCoreManager[cpu->getCurrentCpu()].stopReason();
       switch (stopReason) {
@@ -544,7 +1077,7 @@ void GdbServer::rspClientRequest() {
     RspPacketBuilder newpkt;
     newpkt.addData("vCont;");
     newpkt.addData(pkt.getData());
-    pkt = newpkt;
+    pkt = std::move(newpkt);
     rspVpkt();
     return;
   }
@@ -557,7 +1090,9 @@ void GdbServer::rspClientRequest() {
 
   case 'D':
     // Detach GDB. Do this by closing the client. The rules say that
-    // execution should continue, so unstall the processor.
+    // execution should continue, so unstall the processor. Breakpoints the
+    // client removed must not be left behind.
+    flushMatchpoints();
     rsp->putPkt("OK");
     rsp->rspClose();
     return;
@@ -596,7 +1131,7 @@ void GdbServer::rspClientRequest() {
           mPtid.crystalize(PID_DEFAULT, TID_DEFAULT)) {
         // Convert process number to core number (using - 1).
         // @todo method for pid to core mapping.
-        cpu->setCurrentCpu(mPtid.pid() - 1);
+        setCurrentCore(mPtid.pid() - 1);
         rsp->putPkt("OK");
       } else
         rsp->putPkt("E01");
@@ -683,6 +1218,11 @@ void GdbServer::rspClientRequest() {
     rspVpkt();
     return;
 
+  case 'x':
+    // Read memory (binary)
+    rspReadMemBin();
+    return;
+
   case 'X':
     // Write memory (binary)
     rspWriteMemBin();
@@ -711,17 +1251,72 @@ void GdbServer::rspClientRequest() {
 
 //! Send a packet acknowledging an exception has occurred
 
+//! The values of the expedited registers (PC, SP, FP and any requested by
+//! the target) are included, so that GDB need not ask for them.
+
 //! @param[in] sig  The signal to send (defaults to TargetSignal::TRAP).
 
 void GdbServer::rspReportException(TargetSignal sig) {
+  RspPacketBuilder response;
+  buildStopReply(cpu->getCurrentCpu(), sig, response);
+  rsp->putPkt(response);
+}
+
+//! Construct a stop reply for a core
+
+//! The expedited registers are read from the given core, after which the
+//! core the client selected is selected again.
+
+//! @param[in]  core      The core which stopped
+//! @param[in]  sig       The signal to report
+//! @param[out] response  The stop reply
+
+void GdbServer::buildStopReply(unsigned int core, TargetSignal sig,
+                               RspPacketBuilder &response) {
+  int sigNum = static_cast<int>(sig) & 0xff;
+  const char *reason = breakReason(sig);
+  char buf[64];
+
+  // Without expedited registers, multiprocess or a stop reason, a plain
+  // signal will do
+  if (!mHaveMultiProc && mExpeditedRegs.empty() && (reason == nullptr)) {
+    snprintf(buf, sizeof(buf), "S%02x", sigNum);
+    response += buf;
+    return;
+  }
+
   // Construct a signal received packet
-  if (mHaveMultiProc)
-    rsp->putPkt(RspPacket::CreateFormatted(
-        "T%02xthread:p%x.1;", (static_cast<int>(sig) & 0xff),
-        CoreManager::coreNum2Pid(cpu->getCurrentCpu())));
-  else
-    rsp->putPkt(
-        RspPacket::CreateFormatted("S%02x", (static_cast<int>(sig) & 0xff)));
+
+  snprintf(buf, sizeof(buf), "T%02x", sigNum);
+  response += buf;
+  if (mHaveMultiProc) {
+    snprintf(buf, sizeof(buf), "thread:p%x.1;",
+             CoreManager::coreNum2Pid(core));
+    response += buf;
+  }
+  if (reason != nullptr)
+    response += reason;
+
+  // Add the expedited registers, in target byte order
+  unsigned int prevCore = cpu->getCurrentCpu();
+  if (core != prevCore)
+    setCurrentCore(core);
+
+  for (int reg : mExpeditedRegs) {
+    uint_reg_t val;
+    std::size_t byteSize = readReg(reg, val);
+    if (byteSize == 0)
+      continue;
+
+    snprintf(buf, sizeof(buf), "%x:", reg);
+    response += buf;
+    Utils::regVal2Hex(val, buf, byteSize, true /* little endian */);
+    response.addData(buf, byteSize * 2);
+    response += ';';
+  }
+
+  if (core != prevCore)
+    setCurrentCore(prevCore);
 }
 
 //! Handle a RSP read all registers request
@@ -735,14 +1330,13 @@ void GdbServer::rspReadAllRegs() {
   // The registers. GDB client expects them to be packed according to target
   // endianness.
   RspPacketBuilder response;
+  readRegs(0, mNumRegs, mRegVals.data(), mRegSizes.data());
   for (int regNum = 0; regNum < mNumRegs; regNum++) {
-    uint_reg_t val;       // Enough for even the PC
-    std::size_t byteSize; // Size of reg in bytes
-    char result[32];      // Temporary buffer
+    char result[32]; // Temporary buffer
 
-    byteSize = cpu->readRegister(regNum, val);
-    Utils::regVal2Hex(val, result, byteSize, true /* Little Endian */);
-    response.addData(result, byteSize * 2); // 2 chars per hex digit
+    Utils::regVal2Hex(mRegVals[regNum], result, mRegSizes[regNum],
+                      true /* Little Endian */);
+    response.addData(result, mRegSizes[regNum] * 2); // 2 chars per hex digit
   }
 
   // Finalize the packet and send it
@@ -759,11 +1353,14 @@ void GdbServer::rspWriteAllRegs() {
   // The registers
   std::size_t byteSize = cpu->getRegisterSize();
   for (int regNum = 0; regNum < mNumRegs; regNum++) {
-    uint64_t val = Utils::hex2RegVal(&(pkt.getRawData()[pktPos]), byteSize,
-                                     true /* little endian */);
+    mRegVals[regNum] = Utils::hex2RegVal(&(pkt.getRawData()[pktPos]),
+                                         byteSize, true /* little endian */);
     pktPos += byteSize * 2; // 2 chars per hex digit
+  }
 
-    if (byteSize != cpu->writeRegister(regNum, val))
+  writeRegs(0, mNumRegs, mRegVals.data(), mRegSizes.data());
+  for (int regNum = 0; regNum < mNumRegs; regNum++) {
+    if (byteSize != mRegSizes[regNum])
       cerr << "Warning: Size != " << byteSize << " when writing reg " << regNum
            << "." << endl;
   }
@@ -784,8 +1381,6 @@ void GdbServer::rspWriteAllRegs() {
 void GdbServer::rspReadMem() {
   uint_reg_t addr;           // Where to read the memory
   uint_addr_t len;           // Number of bytes to read
-  uint_addr_t off;           // Offset into the memory
-  uint8_t *buf;		     // Where to read the raw data
   RspPacketBuilder response; // Response to memory request
 
   if (2 !=
@@ -803,16 +1398,61 @@ void GdbServer::rspReadMem() {
     len = (pkt.getMaxPacketSize() - 1) / 2;
   }
 
-  buf = new uint8_t[len];
-  if (len == cpu->read(addr, buf, len))
-    for (off = 0; off < len; off++) {
-      response += Utils::hex2Char(buf[off] >> 4);
-      response += Utils::hex2Char(buf[off] & 0xf);
-    }
-  else
+  // The scratch buffer only grows, so is not reallocated in the steady state.
+  if (mMemBuf.size() < len)
+    mMemBuf.resize(len);
+
+  if (len == mMemCache.read(addr, mMemBuf.data(), len)) {
+    shadowMatchpoints(addr, mMemBuf.data(), len, false);
+    response.addHex(mMemBuf.data(), len);
+  } else
     cerr << "Warning: failed to read " << len << "chars" << endl;
 
-  delete[] buf;
+  rsp->putPkt(response);
+}
+
+//! Handle a RSP read memory (binary) request
+
+//! Syntax is:
+//!   x<addr>,<length>
+
+//! The response is 'b' followed by the bytes, lowest address first. Any
+//! chars which need escaping are escaped when the packet is sent.
+
+//! The length given is the number of bytes to be read.
+
+void GdbServer::rspReadMemBin() {
+  uint_addr_t addr;          // Where to read the memory
+  uint_addr_t len;           // Number of bytes to read
+  RspPacketBuilder response; // Response to memory request
+
+  if (2 !=
+      sscanf(pkt.getRawData(), "x%" PRIxADDR ",%" PRIxADDR, &addr, &len)) {
+    cerr << "Warning: Failed to recognize RSP binary read memory command: "
+         << pkt.getRawData() << endl;
+    rsp->putPkt("E01");
+    return;
+  }
+
+  // Make sure we won't overflow the buffer (allowing for the 'b')
+  if (len >= pkt.getMaxPacketSize()) {
+    cerr << "Warning: Memory read " << pkt.getRawData()
+         << " too large for RSP packet: truncated" << endl;
+    len = pkt.getMaxPacketSize() - 1;
+  }
+
+  if (mMemBuf.size() < len)
+    mMemBuf.resize(len);
+
+  if (len != mMemCache.read(addr, mMemBuf.data(), len)) {
+    cerr << "Warning: failed to read " << len << " chars" << endl;
+    rsp->putPkt("E01");
+    return;
+  }
+
+  shadowMatchpoints(addr, mMemBuf.data(), len, false);
+  response += 'b';
+  response.addData(reinterpret_cast<const char *>(mMemBuf.data()), len);
   rsp->putPkt(response);
 }
 
@@ -840,8 +1480,7 @@ void GdbServer::rspWriteMem() {
   }
 
   // Find the start of the data and check there is the amount we expect.
-  char *symDat =
-      (char *)(memchr(pkt.getRawData(), ':', pkt.getMaxPacketSize())) + 1;
+  char *symDat = (char *)(memchr(pkt.getRawData(), ':', pkt.getLen())) + 1;
   std::size_t datLen = pkt.getLen() - (symDat - pkt.getRawData());
 
   // Sanity check
@@ -852,18 +1491,164 @@ void GdbServer::rspWriteMem() {
     return;
   }
 
+  // Decode the bytes
+  if (mMemBuf.size() < len)
+    mMemBuf.resize(len);
+  if (!RspCodec::hex2Bin(symDat, len, mMemBuf.data())) {
+    cerr << "Warning: Write of non-hex data requested: packet ignored" << endl;
+    rsp->putPkt("E01");
+    return;
+  }
+
   // Write the bytes to memory (no check the address is OK here)
-  for (std::size_t off = 0; off < len; off++) {
-    assert(Utils::isHexStr(&symDat[off * 2], 2));
-    uint8_t nyb1 = Utils::char2Hex(symDat[off * 2]);
-    uint8_t nyb2 = Utils::char2Hex(symDat[off * 2 + 1]);
-    uint8_t val = static_cast<unsigned int>((nyb1 << 4) | nyb2);
+  shadowMatchpoints(addr, mMemBuf.data(), len, true);
+  if (!writeMem(addr, mMemBuf.data(), len))
+    cerr << "Warning: Failed to write " << len << " bytes to 0x" << hex << addr
+         << dec << endl;
+
+  rsp->putPkt("OK");
+}
 
-    if (1 != cpu->write(addr + off, &val, 1))
-      cerr << "Warning: Failed to write character" << endl;
+//! Write a block of memory to the target
+
+//! The block is written with a single call to the target, unless the target
+//! reports that it only wrote part of it, in which case the rest is written
+//! with further calls. The memory cache is updated with the bytes written,
+//! or emptied if the write fails, since the target's memory is then unknown.
+
+//! @param[in] addr  Where to write the memory
+//! @param[in] buf   The bytes to write
+//! @param[in] len   The number of bytes to write
+//! @return  TRUE if all the bytes were written, FALSE otherwise
+
+bool GdbServer::writeMem(uint_addr_t addr, const uint8_t *buf,
+                         std::size_t len) {
+  std::size_t off = 0;
+  while (off < len) {
+    std::size_t written = cpu->write(addr + off, buf + off, len - off);
+    if (written == 0) {
+      mMemCache.invalidate();
+      return false;
+    }
+    off += written;
   }
 
-  rsp->putPkt("OK");
+  mMemCache.write(addr, buf, len);
+  return true;
+}
+
+//! Select the core for subsequent target accesses
+
+//! @param[in] core  The core number
+
+void GdbServer::setCurrentCore(unsigned int core) {
+  cpu->setCurrentCpu(core);
+  mRegCache.setCore(core);
+  mMemCache.setCore(core);
+}
+
+//! Invalidate the register and memory caches of all cores
+
+//! Used whenever the target may change its state, for example before it is
+//! resumed or reset.
+
+void GdbServer::invalidateCaches() {
+  mRegCache.invalidateAll();
+  mMemCache.invalidate();
+}
+
+//! Read a register of the current core
+
+//! The value is taken from the register cache if possible, otherwise it is
+//! read from the target and cached.
+
+//! @param[in]  reg    The register to read
+//! @param[out] value  The value of the register
+//! @return  The size of the register in bytes
+
+std::size_t GdbServer::readReg(int reg, uint_reg_t &value) {
+  std::size_t size;
+  if (mRegCache.lookup(reg, value, size))
+    return size;
+
+  size = cpu->readRegister(reg, value);
+  mRegCache.store(reg, value, size);
+  return size;
+}
+
+//! Read a range of registers of the current core
+
+//! Registers are taken from the register cache if possible. The rest are
+//! read from the target in one call, and cached.
+
+//! @param[in]  first   The first register to read
+//! @param[in]  count   The number of registers to read
+//! @param[out] values  The values of the registers
+//! @param[out] sizes   The sizes of the registers in bytes
+
+void GdbServer::readRegs(int first, int count, uint_reg_t *values,
+                         std::size_t *sizes) {
+  // Which registers are not cached?
+  int lo = count;
+  int hi = -1;
+  for (int i = 0; i < count; i++) {
+    if (!mRegCache.lookup(first + i, values[i], sizes[i])) {
+      lo = std::min(lo, i);
+      hi = i;
+    }
+  }
+  if (hi < lo)
+    return;
+
+  // Read them all together (including any cached ones in the middle), then
+  // one at a time if the target did not read them all.
+  int done = cpu->readRegisters(first + lo, hi - lo + 1, &values[lo],
+                                &sizes[lo]);
+  for (int i = lo; i < lo + done; i++)
+    mRegCache.store(first + i, values[i], sizes[i]);
+  for (int i = lo + done; i <= hi; i++)
+    sizes[i] = readReg(first + i, values[i]);
+}
+
+//! Write a range of registers of the current core
+
+//! The registers are written to the target in one call, and cached.
+
+//! @param[in]  first   The first register to write
+//! @param[in]  count   The number of registers to write
+//! @param[in]  values  The values to write
+//! @param[out] sizes   The sizes of the registers in bytes
+
+void GdbServer::writeRegs(int first, int count, const uint_reg_t *values,
+                          std::size_t *sizes) {
+  int done = cpu->writeRegisters(first, count, values, sizes);
+  for (int i = 0; i < done; i++) {
+    if (first + i < 0 || first + i >= mNumRegs)
+      mRegCache.invalidateCore();
+    else
+      mRegCache.store(first + i, values[i], sizes[i]);
+  }
+  for (int i = done; i < count; i++)
+    sizes[i] = writeReg(first + i, values[i]);
+}
+
+//! Write a register of the current core
+
+//! The write goes through to the target. If the target writes a register
+//! outside the cache, it may be an alias of a cached register, so the cache
+//! for the core is discarded.
+
+//! @param[in] reg    The register to write
+//! @param[in] value  The value to write
+//! @return  The size of the register in bytes
+
+std::size_t GdbServer::writeReg(int reg, uint_reg_t value) {
+  std::size_t size = cpu->writeRegister(reg, value);
+  if (reg < 0 || reg >= mNumRegs)
+    mRegCache.invalidateCore();
+  else
+    mRegCache.store(reg, value, size);
+  return size;
 }
 
 //! Read a single register
@@ -890,7 +1675,7 @@ void GdbServer::rspReadReg() {
   std::size_t byteSize;
   char regData[32];
 
-  byteSize = cpu->readRegister(regNum, val);
+  byteSize = readReg(regNum, val);
   Utils::regVal2Hex(val, regData, byteSize, true /* little endian */);
 
   rsp->putPkt(RspPacket(regData, byteSize * 2));
@@ -911,10 +1696,9 @@ void GdbServer::rspWriteReg() {
   char valstr[valstr_len + 1]; // Allow for EOS
 
   // Break out the fields from the data
-  std::ostringstream fmt_stream;
-  fmt_stream << "P%x=%" << valstr_len << "s";
-  string fmt = fmt_stream.str();
-  if (2 != sscanf(pkt.getRawData(), fmt.c_str(), &regNum, valstr)) {
+  char fmt[16];
+  snprintf(fmt, sizeof(fmt), "P%%x=%%%ds", valstr_len);
+  if (2 != sscanf(pkt.getRawData(), fmt, &regNum, valstr)) {
     cerr << "Warning: Failed to recognize RSP write register command "
          << pkt.getRawData() << endl;
     rsp->putPkt("E01");
@@ -925,7 +1709,7 @@ void GdbServer::rspWriteReg() {
   uint_reg_t val =
       Utils::hex2RegVal(valstr, regByteSize, true /* little endian */);
 
-  if (regByteSize != cpu->writeRegister(regNum, val))
+  if (regByteSize != writeReg(regNum, val))
     cerr << "Warning: Size != " << regByteSize << " when writing reg " << regNum
          << "." << endl;
 
@@ -1027,16 +1811,24 @@ void GdbServer::rspQuery() {
 
     mHaveMultiProc = false;
 
+    mHaveSwBreak = false;
+    mHaveHwBreak = false;
+
     for (auto it = tokens.begin(); it != tokens.end(); it++) {
       if (*it == "multiprocess+") {
         mHaveMultiProc = true;
         multiProcStr = ";multiprocess+";
+      } else if (*it == "swbreak+") {
+        mHaveSwBreak = true;
+      } else if (*it == "hwbreak+") {
+        mHaveHwBreak = true;
       }
     }
 
     rsp->putPkt(RspPacket::CreateFormatted(
-        "PacketSize=%" PRIxPTR
-        ";QNonStop+;VContSupported+;QStartNoAckMode+%s%s",
+        "PacketSize=%" PRIxPTR ";QNonStop+;VContSupported+;QStartNoAckMode+;"
+        "binary-upload+;swbreak+;hwbreak+;ConditionalBreakpoints+;"
+        "BreakpointCommands+%s%s",
         pkt.getMaxPacketSize(), supportsTargetXML, multiProcStr));
 
   } else if (pkt.getData().starts_with("qSymbol:")) {
@@ -1100,7 +1892,7 @@ void GdbServer::rspQuery() {
 //! The actual command follows the "qRcmd," in ASCII encoded to hex
 
 void GdbServer::rspCommand() {
-  char *cmd = new char[pkt.getMaxPacketSize() / 2];
+  char *cmd = new char[pkt.getLen() / 2 + 1];
   uint64_t timeout;
 
   Utils::hex2Ascii(cmd, &(pkt.getRawData()[strlen("qRcmd,")]));
@@ -1132,6 +1924,18 @@ void GdbServer::rspCommand() {
         "    Set debug flag in target and optional associated value\n",
         "  show debug [<flag>]\n",
         "    Show debug for one flag or all flags in target\n",
+        "  set rle [on|off]\n",
+        "    Run-length encode packets sent to the client\n",
+        "  show rle\n",
+        "    Show whether packets sent to the client are run-length encoded\n",
+        "  set memory-cache [on|off]\n",
+        "    Cache target memory while the target is stopped\n",
+        "  show memory-cache\n",
+        "    Show whether target memory is cached\n",
+        "  set max-interrupt-latency <ms>\n",
+        "    Longest time the target runs before checking for a break\n",
+        "  show max-interrupt-latency\n",
+        "    Show the maximum interrupt latency\n",
         "  echo <message>\n",
         "    Echo <message> on stdout of the gdbserver\n",
         nullptr};
@@ -1169,6 +1973,7 @@ void GdbServer::rspCommand() {
 
     // Warm reset the CPU.  Failure to reset causes us to blow up.
 
+    invalidateCaches();
     if (ITarget::ResumeRes::SUCCESS != cpu->reset(ITarget::ResetType::WARM))
       Utils::fatalError("Failed to reset");
 
@@ -1179,6 +1984,7 @@ void GdbServer::rspCommand() {
 
     // Cold reset the CPU.  Failure to reset causes us to blow up.
 
+    invalidateCaches();
     if (ITarget::ResumeRes::SUCCESS != cpu->reset(ITarget::ResetType::COLD))
       Utils::fatalError("Failed to cold reset");
 
@@ -1259,10 +2065,12 @@ void GdbServer::rspCommand() {
 
     rspShowCommand(cmd + i);
   } else {
-    // Fallback is to pass the command to the target.
+    // Fallback is to pass the command to the target, which may change its
+    // registers and memory.
 
     ostringstream oss;
 
+    invalidateCaches();
     if (cpu->command(string(cmd), oss)) {
       rsp->putPkt(RspPacket::CreateRcmdStr(oss.str().c_str(), true));
 
@@ -1279,12 +2087,42 @@ void GdbServer::rspCommand() {
   delete[] cmd;
 }
 
-//! Handle a RSP qRcmd request for set
+//! Parse the on/off argument of a monitor set command
 
-//! The main rspCommand function has decoded the argument string and
-//! stripped off "set" and any spaces separating it from the rest.
+//! A missing argument means on.
 
-//! Any unrecognized command is passed to the target to process.
+//! @param[in]  tokens  The tokens of the command
+//! @param[in]  idx     The index of the argument in the tokens
+//! @param[out] state   The state requested
+//! @return  TRUE if the argument was valid, FALSE otherwise
+
+static bool parseOnOff(const vector<string> &tokens, std::size_t idx,
+                       bool &state) {
+  if (tokens.size() <= idx) {
+    state = true;
+    return true;
+  }
+
+  const char *arg = tokens[idx].c_str();
+  if ((0 == strcasecmp(arg, "0")) || (0 == strcasecmp(arg, "off")) ||
+      (0 == strcasecmp(arg, "false"))) {
+    state = false;
+    return true;
+  } else if ((0 == strcasecmp(arg, "1")) || (0 == strcasecmp(arg, "on")) ||
+             (0 == strcasecmp(arg, "true"))) {
+    state = true;
+    return true;
+  }
+
+  return false;
+}
+
+//! Handle a RSP qRcmd request for set
+
+//! The main rspCommand function has decoded the argument string and
+//! stripped off "set" and any spaces separating it from the rest.
+
+//! Any unrecognized command is passed to the target to process.
 
 //! @param[in] cmd  The RSP set command string (excluding "set ")
 
@@ -1348,24 +2186,55 @@ void GdbServer::rspSetCommand(const char *cmd) {
   } else if (string("kill-core-on-exit") == tokens[0]) {
     // Valid state?
 
-    if (numTok == 1) {
-      mKillCoreOnExit = true;
-    } else {
-      if ((0 == strcasecmp(tokens[1].c_str(), "0")) ||
-          (0 == strcasecmp(tokens[1].c_str(), "off")) ||
-          (0 == strcasecmp(tokens[1].c_str(), "false")))
-        mKillCoreOnExit = false;
-      else if ((0 == strcasecmp(tokens[1].c_str(), "1")) ||
-               (0 == strcasecmp(tokens[1].c_str(), "on")) ||
-               (0 == strcasecmp(tokens[1].c_str(), "true")))
-        mKillCoreOnExit = true;
-      else {
-        // Not a valid level
-        rsp->putPkt("E02");
-        return;
-      }
+    if (!parseOnOff(tokens, 1, mKillCoreOnExit)) {
+      // Not a valid level
+      rsp->putPkt("E02");
+      return;
     }
 
+    rsp->putPkt("OK");
+    return;
+  } else if ((numTok <= 2) && (string("rle") == tokens[0])) {
+    // monitor set rle [on|off]
+
+    bool rle;
+
+    if (!parseOnOff(tokens, 1, rle)) {
+      rsp->putPkt("E02");
+      return;
+    }
+
+    // Acknowledge before the change, so the ack is encoded as the client
+    // expects.
+
+    rsp->putPkt("OK");
+    rsp->setRunLengthEncoding(rle);
+    return;
+  } else if ((numTok <= 2) && (string("memory-cache") == tokens[0])) {
+    // monitor set memory-cache [on|off]
+
+    bool enabled;
+
+    if (!parseOnOff(tokens, 1, enabled)) {
+      rsp->putPkt("E02");
+      return;
+    }
+
+    mMemCache.setEnabled(enabled);
+    rsp->putPkt("OK");
+    return;
+  } else if ((numTok == 2) && (string("max-interrupt-latency") == tokens[0])) {
+    // monitor set max-interrupt-latency <ms>
+
+    char *end;
+    unsigned long long ms = strtoull(tokens[1].c_str(), &end, 10);
+
+    if ((*end != '\0') || (ms == 0) || (tokens[1][0] == '-')) {
+      rsp->putPkt("E02");
+      return;
+    }
+
+    mWaitBudget.maxLatency(std::chrono::milliseconds(ms));
     rsp->putPkt("OK");
     return;
   } else {
@@ -1374,6 +2243,7 @@ void GdbServer::rspSetCommand(const char *cmd) {
     ostringstream oss;
     string fullCmd = string("set ") + string(cmd);
 
+    invalidateCaches();
     if (cpu->command(string(fullCmd), oss)) {
       rsp->putPkt(RspPacket::CreateRcmdStr(oss.str().c_str(), true));
 
@@ -1437,6 +2307,35 @@ void GdbServer::rspShowCommand(const char *cmd) {
     oss << "kill-core-on-exit: " << (mKillCoreOnExit ? "ON" : "OFF");
     oss << endl;
 
+    rsp->putPkt(RspPacket::CreateRcmdStr(oss.str().c_str(), true));
+    rsp->putPkt("OK");
+  } else if ((numTok == 1) && (string("rle") == tokens[0])) {
+    // monitor show rle
+
+    ostringstream oss;
+    oss << "rle: " << (rsp->getRunLengthEncoding() ? "ON" : "OFF") << endl;
+
+    rsp->putPkt(RspPacket::CreateRcmdStr(oss.str().c_str(), true));
+    rsp->putPkt("OK");
+  } else if ((numTok == 1) && (string("memory-cache") == tokens[0])) {
+    // monitor show memory-cache
+
+    ostringstream oss;
+    oss << "memory-cache: " << (mMemCache.isEnabled() ? "ON" : "OFF") << endl;
+
+    rsp->putPkt(RspPacket::CreateRcmdStr(oss.str().c_str(), true));
+    rsp->putPkt("OK");
+  } else if ((numTok == 1) &&
+             (string("max-interrupt-latency") == tokens[0])) {
+    // monitor show max-interrupt-latency
+
+    ostringstream oss;
+    oss << "max-interrupt-latency: "
+        << std::chrono::duration_cast<std::chrono::milliseconds>(
+               mWaitBudget.maxLatency())
+               .count()
+        << " ms" << endl;
+
     rsp->putPkt(RspPacket::CreateRcmdStr(oss.str().c_str(), true));
     rsp->putPkt("OK");
   } else {
@@ -1463,11 +2362,21 @@ void GdbServer::rspShowCommand(const char *cmd) {
 
 void GdbServer::rspSet() {
   if (pkt.getData().starts_with("QNonStop:")) {
+    // The client only changes mode while all cores are stopped, which it
+    // is told of again if it asks, so no stop is left to report.
     switch (pkt.getData()[strlen("QNonStop:")]) {
     case '0':
-      mStopMode = StopMode::ALL_STOP;
+      leaveNonStop();
       break;
     case '1':
+      if (!cpu->setNonStop(true)) {
+        rsp->putPkt("E01");
+        return;
+      }
+      for (unsigned int i = 0; i < mCoreManager.getCpuCount(); ++i) {
+        mCoreManager[i].setResumeType(ITarget::ResumeType::NONE);
+        mCoreManager[i].reportStopReason();
+      }
       mStopMode = StopMode::NON_STOP;
       break;
 
@@ -1501,6 +2410,11 @@ void GdbServer::rspVCont() {
     return;
   }
 
+  if (mStopMode == StopMode::NON_STOP) {
+    rspVContNonStop(actions);
+    return;
+  }
+
   for (unsigned int i = 0; i < mCoreManager.getCpuCount(); ++i) {
     ITarget::ResumeType resType;
     char action = actions.getCoreAction(CoreManager::coreNum2Pid(i));
@@ -1520,6 +2434,10 @@ void GdbServer::rspVCont() {
       resType = ITarget::ResumeType::STEP;
       break;
 
+    case 'r':
+      resType = ITarget::ResumeType::RANGE_STEP;
+      break;
+
     default:
       rsp->putPkt("E01");
       return;
@@ -1533,8 +2451,22 @@ void GdbServer::rspVCont() {
       resType = ITarget::ResumeType::NONE;
     }
 
+    // Ask the target to step through the range itself, and otherwise step
+    // the core one instruction at a time until it leaves the range.
+    if (resType == ITarget::ResumeType::RANGE_STEP) {
+      uint_addr_t start;
+      uint_addr_t end;
+      if (!actions.getCoreRange(CoreManager::coreNum2Pid(i), start, end)) {
+        rsp->putPkt("E01");
+        return;
+      }
+      setCurrentCore(i);
+      mCoreManager[i].setStepRange(start, end,
+                                   !cpu->setStepRange(start, end));
+    }
+
     mCoreManager[i].setResumeType(resType);
-    coreActions.push_back(resType);
+    coreActions.push_back(mCoreManager[i].targetResumeType());
   }
 
   if (coreActions.size() != mCoreManager.getCpuCount()) {
@@ -1550,6 +2482,84 @@ void GdbServer::rspVCont() {
   doCoreActions();
 }
 
+//! Handle a 'vCont' packet in non-stop mode
+
+//! The cores given actions are resumed or halted, while all others are left
+//! as they are, and the client is told straight away. The stops of the
+//! resumed cores are reported later, in notifications. Cores which are
+//! already running are not resumed again. A range step the target declines
+//! is done as a single step, the client stepping again if the core is still
+//! in the range.
+
+//! @param[in] actions  The actions of the packet
+
+void GdbServer::rspVContNonStop(const VContActions &actions) {
+  unsigned int numCores = mCoreManager.getCpuCount();
+  std::vector<char> coreActions;
+  for (unsigned int i = 0; i < numCores; ++i) {
+    char action = actions.getCoreAction(CoreManager::coreNum2Pid(i));
+    if ((action != '\0') && (strchr("cCsSrt", action) == nullptr)) {
+      rsp->putPkt("E01");
+      return;
+    }
+    coreActions.push_back(action);
+  }
+
+  // Each core is selected to set it up, and the client's choice restored
+  unsigned int selectedCore = cpu->getCurrentCpu();
+  std::vector<ITarget::ResumeType> resTypes(numCores,
+                                            ITarget::ResumeType::NONE);
+  bool resuming = false;
+  for (unsigned int i = 0; i < numCores; ++i) {
+    char action = coreActions[i];
+    if ((action == '\0') || !mCoreManager[i].isLive())
+      continue;
+
+    if (action == 't') {
+      if (mCoreManager[i].isRunning())
+        haltCore(i, TargetSignal::NONE);
+      continue;
+    }
+
+    if (mCoreManager[i].isRunning())
+      continue;
+
+    ITarget::ResumeType resType;
+    if ((action == 'c') || (action == 'C'))
+      resType = ITarget::ResumeType::CONTINUE;
+    else if ((action == 's') || (action == 'S'))
+      resType = ITarget::ResumeType::STEP;
+    else
+      resType = ITarget::ResumeType::RANGE_STEP;
+
+    setCurrentCore(i);
+    if (resType == ITarget::ResumeType::RANGE_STEP) {
+      uint_addr_t start;
+      uint_addr_t end;
+      if (!actions.getCoreRange(CoreManager::coreNum2Pid(i), start, end))
+        resType = ITarget::ResumeType::STEP;
+      else
+        mCoreManager[i].setStepRange(start, end,
+                                     !cpu->setStepRange(start, end));
+    }
+
+    mCoreManager[i].setResumeType(resType);
+    resTypes[i] = mCoreManager[i].targetResumeType();
+    mRegCache.invalidateCore();
+    resuming = true;
+  }
+  setCurrentCore(selectedCore);
+
+  if (resuming) {
+    flushMatchpoints();
+    mMemCache.invalidate();
+    if (!cpu->prepare(resTypes) || !cpu->resume())
+      Utils::fatalError("Failed to resume target");
+  }
+
+  rsp->putPkt("OK");
+}
+
 //! Handle a 'vKill:pid' packet.
 //
 //! This packet will be used in preference to the older 'k' when GDB
@@ -1567,7 +2577,17 @@ void GdbServer::rspVKill() {
 
   pid = (int)(Utils::hex2Val(str, strlen(str)));
 
-  if (!mCoreManager.killCoreNum(CoreManager::pid2CoreNum(pid))) {
+  // A running core must be stopped before it is killed
+  unsigned int coreNum = CoreManager::pid2CoreNum(pid);
+  if ((mStopMode == StopMode::NON_STOP) &&
+      (coreNum < mCoreManager.getCpuCount()) &&
+      mCoreManager[coreNum].isRunning()) {
+    if (!cpu->haltCpu(coreNum))
+      Utils::fatalError("Failed to halt core");
+    mCoreManager[coreNum].setResumeType(ITarget::ResumeType::NONE);
+  }
+
+  if (!mCoreManager.killCoreNum(coreNum)) {
     rsp->putPkt("E01");
     return;
   }
@@ -1581,6 +2601,45 @@ void GdbServer::rspVKill() {
   }
 }
 
+//! Handle a 'vStopped' packet.
+
+//! The client has collected the oldest queued stop, and asks for the next,
+//! or is told OK if there are no more.
+
+void GdbServer::rspVStopped() {
+  if (!mStopQueue.empty())
+    mStopQueue.pop_front();
+
+  if (mStopQueue.empty())
+    rsp->putPkt("OK");
+  else
+    rsp->putPkt(mStopQueue.front().c_str());
+}
+
+//! Handle a '?' packet in non-stop mode
+
+//! The stops of all the stopped cores are queued afresh. The first is the
+//! reply, and the client collects the others with vStopped. If no core is
+//! stopped the reply is OK.
+
+void GdbServer::rspStopReasonsNonStop() {
+  mStopQueue.clear();
+  for (unsigned int i = 0; i < mCoreManager.getCpuCount(); ++i) {
+    if (!mCoreManager[i].isLive() || mCoreManager[i].isRunning())
+      continue;
+
+    mCoreManager[i].reportStopReason();
+    RspPacketBuilder reply;
+    buildStopReply(i, stopSignal(mCoreManager[i].stopReason()), reply);
+    mStopQueue.emplace_back(reply.getRawData(), reply.getSize());
+  }
+
+  if (mStopQueue.empty())
+    rsp->putPkt("OK");
+  else
+    rsp->putPkt(mStopQueue.front().c_str());
+}
+
 //! Handle a RSP 'v' packet
 
 //! @todo for now we don't handle V packets.
@@ -1589,15 +2648,20 @@ void GdbServer::rspVpkt() {
   if (pkt.getData() == "vCont?") {
     // What actions are supported in vCont?  If we don't support 'c' and
     // 'C' then GDB will refuse to use vCont.  If we're going to claim
-    // 'C' then we may as well claim 'S' too.  I don't claim 't' yet,
-    // though we probably will want that in time.
-    rsp->putPkt("vCont;c;C;s;S");
+    // 'C' then we may as well claim 'S' too.  GDB will not stop cores
+    // in non-stop mode unless 't' is claimed, though it is only accepted
+    // in that mode.  Range stepping with 'r' is always claimed, since if
+    // the target can't do it the server steps the core itself.
+    rsp->putPkt("vCont;c;C;s;S;t;r");
   } else if (pkt.getData().starts_with("vCont")) {
     rspVCont();
     return;
   } else if (pkt.getData().starts_with("vKill;")) {
     rspVKill();
     return;
+  } else if (pkt.getData() == "vStopped") {
+    rspVStopped();
+    return;
   } else {
     // Unsupported packet.
     rsp->putPkt("");
@@ -1628,11 +2692,15 @@ void GdbServer::rspWriteMemBin() {
     return;
   }
 
-  // Find the start of the data and "unescape" it.
-  uint8_t *bindat =
-      (uint8_t *)(memchr(pkt.getRawData(), ':', pkt.getMaxPacketSize())) + 1;
-  std::size_t off = (char *)bindat - pkt.getRawData();
-  std::size_t newLen = Utils::rspUnescape((char *)bindat, pkt.getLen() - off);
+  // Find the start of the data and "unescape" it straight into the buffer
+  // to be written.
+  const char *bindat =
+      static_cast<const char *>(memchr(pkt.getRawData(), ':', pkt.getLen())) +
+      1;
+  std::size_t escLen = pkt.getLen() - (bindat - pkt.getRawData());
+  if (mMemBuf.size() < escLen)
+    mMemBuf.resize(escLen);
+  std::size_t newLen = Utils::rspUnescape(bindat, escLen, mMemBuf.data());
 
   // Sanity check
   if (newLen != len) {
@@ -1644,7 +2712,8 @@ void GdbServer::rspWriteMemBin() {
   }
 
   // Write the bytes to memory.
-  if (len != cpu->write(addr, bindat, len))
+  shadowMatchpoints(addr, mMemBuf.data(), len, true);
+  if (!writeMem(addr, mMemBuf.data(), len))
     cerr << "Warning: Failed to write " << len << " bytes to 0x" << hex << addr
          << dec << endl;
 
@@ -1653,23 +2722,449 @@ void GdbServer::rspWriteMemBin() {
 
 //! Handle a RSP remove breakpoint or matchpoint request
 
-//! This checks that the matchpoint was actually set earlier. For software
-//! (memory) breakpoints, the breakpoint is cleared from memory.
+//! Syntax is:
+
+//!   z<type>,<addr>,<kind>
+
+//! This checks that the matchpoint was actually set earlier. The matchpoint
+//! is only taken out of the target when it is next resumed, since GDB often
+//! removes breakpoints only to insert them again before resuming.
 
 //! @todo This doesn't work with icache/immu yet
 
 void GdbServer::rspRemoveMatchpoint() {
-  rsp->putPkt("");
-  return;
+  unsigned int type;
+  uint_addr_t addr;
+  unsigned int kind;
+
+  if (3 != sscanf(pkt.getRawData(), "z%u,%" PRIxADDR ",%x", &type, &addr,
+                  &kind)) {
+    cerr << "Warning: Failed to recognize RSP remove matchpoint "
+         << pkt.getRawData() << endl;
+    rsp->putPkt("E01");
+    return;
+  }
+
+  // Matchpoint types we do not know are not supported
+  if (type > static_cast<unsigned int>(MatchpointType::WP_ACCESS)) {
+    rsp->putPkt("");
+    return;
+  }
+
+  if (removeMatchpoint(static_cast<MatchpointType>(type), addr))
+    rsp->putPkt("OK");
+  else
+    rsp->putPkt("E01");
 }
 
 //! Handle a RSP insert breakpoint or matchpoint request
 
-//! @todo For now only memory breakpoints are handled
+//! Syntax is:
+
+//!   Z<type>,<addr>,<kind>[;X<len>,<expr>...][;cmds:<persist>,X<len>,<expr>...]
+
+//! The target is asked to insert the matchpoint. If it declines a software
+//! (memory) breakpoint, the breakpoint is emulated by writing a breakpoint
+//! instruction to memory.
+
+//! Any conditions and commands are agent expressions, which are evaluated
+//! when the target stops at the breakpoint.
 
 void GdbServer::rspInsertMatchpoint() {
-  rsp->putPkt("");
-  return;
+  unsigned int type;
+  uint_addr_t addr;
+  unsigned int kind;
+  int len = 0;
+  std::vector<AgentExpr> conditions;
+  std::vector<AgentExpr> commands;
+
+  if ((3 != sscanf(pkt.getRawData(), "Z%u,%" PRIxADDR ",%x%n", &type, &addr,
+                   &kind, &len)) ||
+      !parseAgentExprs(pkt.getRawData() + len, conditions, commands)) {
+    cerr << "Warning: Failed to recognize RSP insert matchpoint "
+         << pkt.getRawData() << endl;
+    rsp->putPkt("E01");
+    return;
+  }
+
+  // Matchpoint types we do not know are not supported
+  if (type > static_cast<unsigned int>(MatchpointType::WP_ACCESS)) {
+    rsp->putPkt("");
+    return;
+  }
+
+  if (insertMatchpoint(static_cast<MatchpointType>(type), addr, kind,
+                       conditions, commands))
+    rsp->putPkt("OK");
+  else
+    rsp->putPkt("E01");
+}
+
+//! Insert a matchpoint
+
+//! Inserting a matchpoint which is already in the target, including one the
+//! client removed since the target was last resumed, succeeds without
+//! touching the target. Its conditions and commands are replaced, as the
+//! client inserts a breakpoint again when they change.
+
+//! @param[in] type        The type of matchpoint
+//! @param[in] addr        The address of the matchpoint
+//! @param[in] kind        The kind of matchpoint. For software breakpoints,
+//!                        the size of the breakpoint instruction.
+//! @param[in] conditions  The conditions of the matchpoint
+//! @param[in] commands    The commands of the matchpoint
+//! @return  TRUE if the matchpoint was inserted, FALSE otherwise
+
+bool GdbServer::insertMatchpoint(MatchpointType type, uint_addr_t addr,
+                                 std::size_t kind,
+                                 const std::vector<AgentExpr> &conditions,
+                                 const std::vector<AgentExpr> &commands) {
+  auto key = std::make_pair(type, addr);
+  auto it = mMatchpointMap.find(key);
+  if (it != mMatchpointMap.end()) {
+    if (!it->second.wanted) {
+      it->second.wanted = true;
+      mPendingRemovals--;
+    }
+    it->second.conditions = conditions;
+    it->second.commands = commands;
+    return true;
+  }
+
+  Matchpoint mp;
+  mp.kind = kind;
+  mp.emulated = false;
+  mp.wanted = true;
+  mp.conditions = conditions;
+  mp.commands = commands;
+  if (cpu->insertMatchpoint(addr, static_cast<ITarget::MatchType>(type))) {
+    mMatchpointMap[key] = mp;
+    return true;
+  }
+
+  if (type != MatchpointType::BP_MEMORY)
+    return false;
+
+  // The target declined a software breakpoint, so save the instruction and
+  // replace it with a breakpoint instruction.
+  uint8_t instr[sizeof(mp.savedInstr)];
+  if (!breakInstr(kind, instr) ||
+      (kind != mMemCache.read(addr, mp.savedInstr, kind)) ||
+      !writeMem(addr, instr, kind))
+    return false;
+
+  mp.emulated = true;
+  mMatchpointMap[key] = mp;
+  return true;
+}
+
+//! Parse the conditions and commands of a matchpoint
+
+//! The parameters following the kind of a Z packet are separated by ';'.
+//! A condition list is a series of agent expressions, each X<len>,<expr>,
+//! concatenated without separators. A command list is cmds:<persist>,
+//! followed by agent expressions in the same way. Other parameters are
+//! ignored.
+
+//! Whether commands persist when the client disconnects is ignored, since
+//! all matchpoints are removed when a client connects.
+
+//! @param[in]  params      The parameters, each preceded by ';'
+//! @param[out] conditions  The conditions
+//! @param[out] commands    The commands
+//! @return  TRUE if the parameters were parsed, FALSE otherwise
+
+bool GdbServer::parseAgentExprs(const char *params,
+                                std::vector<AgentExpr> &conditions,
+                                std::vector<AgentExpr> &commands) {
+  const char *p = params;
+  while (*p == ';') {
+    p++;
+    std::vector<AgentExpr> *exprs;
+    if (*p == 'X') {
+      exprs = &conditions;
+    } else if (strncmp(p, "cmds:", 5) == 0) {
+      p += 5;
+      if (((*p != '0') && (*p != '1')) || (p[1] != ','))
+        return false;
+      p += 2;
+      exprs = &commands;
+    } else {
+      while ((*p != '\0') && (*p != ';'))
+        p++;
+      continue;
+    }
+
+    while (*p == 'X') {
+      char *end;
+      unsigned long len = strtoul(p + 1, &end, 16);
+      if ((end == p + 1) || (*end != ',') || (strlen(end + 1) < 2 * len))
+        return false;
+
+      AgentExpr expr;
+      if (!expr.parse(end + 1, len))
+        return false;
+      exprs->push_back(expr);
+      p = end + 1 + 2 * len;
+    }
+  }
+
+  return *p == '\0';
+}
+
+//! Find whether the target should stop at a matchpoint
+
+//! Failing to evaluate a condition counts as it being true, so that the
+//! client sees the stop.
+
+//! @param[in] mp  The matchpoint, whose conditions are evaluated for the
+//!                current core
+//! @return  TRUE if any condition is true or there are none, FALSE otherwise
+
+bool GdbServer::conditionHolds(const Matchpoint &mp) {
+  if (mp.conditions.empty())
+    return true;
+
+  AgentContext ctx(this);
+  for (const AgentExpr &cond : mp.conditions) {
+    uint64_t value;
+    if (!cond.evaluate(ctx, value) || (value != 0))
+      return true;
+  }
+
+  return false;
+}
+
+//! Run the commands of a matchpoint
+
+//! Output from the commands is sent to the client as it is made. Failing to
+//! run a command is only warned about.
+
+//! @param[in] mp  The matchpoint, whose commands are run for the current core
+
+void GdbServer::runCommands(const Matchpoint &mp) {
+  AgentContext ctx(this);
+  for (const AgentExpr &cmd : mp.commands) {
+    uint64_t value;
+    if (!cmd.evaluate(ctx, value))
+      cerr << "Warning: Failed to run breakpoint command" << endl;
+  }
+}
+
+//! Remove a matchpoint
+
+//! The matchpoint is only marked as no longer wanted. It is taken out of the
+//! target by flushMatchpoints().
+
+//! @param[in] type  The type of matchpoint
+//! @param[in] addr  The address of the matchpoint
+//! @return  TRUE if the matchpoint was removed, FALSE if it was not inserted
+
+bool GdbServer::removeMatchpoint(MatchpointType type, uint_addr_t addr) {
+  auto it = mMatchpointMap.find(std::make_pair(type, addr));
+  if ((it == mMatchpointMap.end()) || !it->second.wanted) {
+    cerr << "Warning: No " << type << " matchpoint at 0x" << hex << addr
+         << dec << " to remove" << endl;
+    return false;
+  }
+
+  it->second.wanted = false;
+  mPendingRemovals++;
+  return true;
+}
+
+//! Take the matchpoints the client has removed out of the target
+
+void GdbServer::flushMatchpoints() {
+  if (mPendingRemovals == 0)
+    return;
+
+  for (auto it = mMatchpointMap.begin(); it != mMatchpointMap.end();) {
+    if (it->second.wanted) {
+      ++it;
+      continue;
+    }
+
+    if (!removeFromTarget(it->first.first, it->first.second, it->second))
+      cerr << "Warning: Failed to remove " << it->first.first
+           << " matchpoint at 0x" << hex << it->first.second << dec << endl;
+    it = mMatchpointMap.erase(it);
+  }
+
+  mPendingRemovals = 0;
+}
+
+//! Remove all matchpoints
+
+//! Matchpoints which cannot be removed are forgotten anyway.
+
+void GdbServer::removeAllMatchpoints() {
+  for (const auto &entry : mMatchpointMap)
+    removeFromTarget(entry.first.first, entry.first.second, entry.second);
+
+  mMatchpointMap.clear();
+  mPendingRemovals = 0;
+}
+
+//! Take a matchpoint out of the target
+
+//! For emulated software breakpoints, the original instruction is restored
+//! to memory, otherwise the target is asked to remove the matchpoint.
+
+//! @param[in] type  The type of matchpoint
+//! @param[in] addr  The address of the matchpoint
+//! @param[in] mp    The matchpoint
+//! @return  TRUE if the matchpoint was removed, FALSE otherwise
+
+bool GdbServer::removeFromTarget(MatchpointType type, uint_addr_t addr,
+                                 const Matchpoint &mp) {
+  if (mp.emulated)
+    return writeMem(addr, mp.savedInstr, mp.kind);
+  else
+    return cpu->removeMatchpoint(addr, static_cast<ITarget::MatchType>(type));
+}
+
+//! Hide emulated breakpoints from the client
+
+//! The client does not expect to see breakpoints it inserted with Z packets
+//! in memory. So memory read for the client has the saved instructions in
+//! place of the breakpoint instructions. Memory written by the client
+//! replaces the saved instructions, and the breakpoint instructions are
+//! kept in memory.
+
+//! @param[in]     addr     The address of the memory
+//! @param[in,out] buf      The memory read from or to be written to the
+//!                         target
+//! @param[in]     len      The number of bytes of memory
+//! @param[in]     writing  TRUE if the memory is to be written to the target,
+//!                         FALSE if it has been read
+
+void GdbServer::shadowMatchpoints(uint_addr_t addr, uint8_t *buf,
+                                  std::size_t len, bool writing) {
+  if (mMatchpointMap.empty() || (len == 0))
+    return;
+
+  // Breakpoints starting a little below the address may overlap it
+  const std::size_t maxKind = sizeof(Matchpoint::savedInstr);
+  uint_addr_t start = addr < maxKind ? 0 : addr - (maxKind - 1);
+  for (auto it =
+           mMatchpointMap.lower_bound({MatchpointType::BP_MEMORY, start});
+       (it != mMatchpointMap.end()) &&
+       (it->first.first == MatchpointType::BP_MEMORY) &&
+       (it->first.second - addr < len || it->first.second < addr);
+       ++it) {
+    Matchpoint &mp = it->second;
+    uint8_t instr[maxKind];
+    if (!mp.emulated || !breakInstr(mp.kind, instr))
+      continue;
+
+    // breakInstr only accepts kinds which fit, but say so to the compiler
+    std::size_t kind = std::min<std::size_t>(mp.kind, maxKind);
+    for (std::size_t i = 0; i < kind; i++) {
+      uint_addr_t byteAddr = it->first.second + i;
+      if ((byteAddr < addr) || (byteAddr - addr >= len))
+        continue;
+
+      uint8_t &byte = buf[byteAddr - addr];
+      if (writing) {
+        mp.savedInstr[i] = byte;
+        byte = instr[i];
+      } else {
+        byte = mp.savedInstr[i];
+      }
+    }
+  }
+}
+
+//! Get the breakpoint instruction for a software breakpoint
+
+//! @param[in]  kind   The size of the breakpoint instruction
+//! @param[out] bytes  The bytes of the instruction, lowest address first
+//! @return  TRUE if there is a breakpoint instruction of that size, FALSE
+//!          otherwise
+
+bool GdbServer::breakInstr(std::size_t kind, uint8_t *bytes) {
+  uint32_t instr;
+  if (kind == sizeof(BREAK_INSTR))
+    instr = BREAK_INSTR;
+  else if (kind == sizeof(C_BREAK_INSTR))
+    instr = C_BREAK_INSTR;
+  else
+    return false;
+
+  for (std::size_t i = 0; i < kind; i++)
+    bytes[i] = static_cast<uint8_t>(instr >> (i * 8));
+  return true;
+}
+
+//! The stop reason to report for a breakpoint
+
+//! If the current core stopped at a breakpoint inserted by the client, and
+//! the client supports it, the stop reply should say so.
+
+//! @param[in] sig  The signal being reported
+//! @return  The stop reason, or nullptr if there is none to report
+
+const char *GdbServer::breakReason(TargetSignal sig) {
+  if ((sig != TargetSignal::TRAP) || (mPcReg < 0) ||
+      mMatchpointMap.empty() || !(mHaveSwBreak || mHaveHwBreak) ||
+      (mCoreManager[mRegCache.getCore()].stopReason() !=
+       ITarget::ResumeRes::INTERRUPTED))
+    return nullptr;
+
+  uint_reg_t pc;
+  if (readReg(mPcReg, pc) == 0)
+    return nullptr;
+
+  auto it = mMatchpointMap.find({MatchpointType::BP_MEMORY, pc});
+  if (mHaveSwBreak && (it != mMatchpointMap.end()) && it->second.wanted)
+    return "swbreak:;";
+  it = mMatchpointMap.find({MatchpointType::BP_HARDWARE, pc});
+  if (mHaveHwBreak && (it != mMatchpointMap.end()) && it->second.wanted)
+    return "hwbreak:;";
+  return nullptr;
+}
+
+//! Read a register of the current core for an agent expression
+
+//! @param[in]  reg    The register to read
+//! @param[out] value  The value of the register
+//! @return  TRUE if the register was read, FALSE otherwise
+
+bool GdbServer::AgentContext::readRegister(int reg, uint_reg_t &value) {
+  if ((reg < 0) || (reg >= mServer->mNumRegs))
+    return false;
+
+  return mServer->readReg(reg, value) != 0;
+}
+
+//! Read memory of the current core for an agent expression
+
+//! Emulated breakpoints are hidden, as they are from the client.
+
+//! @param[in]  addr  The address to read from
+//! @param[out] buf   The bytes read
+//! @param[in]  size  The number of bytes to read
+//! @return  TRUE if all the bytes were read, FALSE otherwise
+
+bool GdbServer::AgentContext::readMemory(uint_addr_t addr, uint8_t *buf,
+                                         std::size_t size) {
+  if (mServer->mMemCache.read(addr, buf, size) != size)
+    return false;
+
+  mServer->shadowMatchpoints(addr, buf, size, false);
+  return true;
+}
+
+//! Send output from an agent expression to the client
+
+//! The client prints it on its console. The target is running as far as the
+//! client knows, when it expects such output.
+
+//! @param[in] text  The text
+
+void GdbServer::AgentContext::output(const std::string &text) {
+  mServer->rsp->putPkt(RspPacket::CreateHexStr(text.c_str()));
 }
 
 namespace EmbDebug {
@@ -1776,6 +3271,18 @@ GdbServer::CoreManager::CoreManager(unsigned int count)
   mCoreStates.resize(count);
 }
 
+//! Whether any core is running
+//
+//! In non-stop mode, this is whether any core has been resumed and not yet
+//! stopped.
+
+bool GdbServer::CoreManager::isAnyCoreRunning() const {
+  for (const CoreState &state : mCoreStates)
+    if (state.isRunning())
+      return true;
+  return false;
+}
+
 //! Reset the core manager, restoring all cores to life.
 //
 //! Any exited cores are once again alive, and non-exited after a call to
@@ -12,18 +12,25 @@
 #define __STDC_FORMAT_MACROS
 #include <cassert>
 #include <cinttypes>
+#include <deque>
 #include <map>
+#include <string>
 #include <vector>
 
+#include "AgentExpr.h"
+#include "MemoryCache.h"
 #include "Ptid.h"
+#include "RegisterCache.h"
 #include "RspPacket.h"
 #include "Timeout.h"
+#include "WaitBudget.h"
 #include "embdebug/ITarget.h"
 #include "embdebug/Types.h"
 
 namespace EmbDebug {
 
 class AbstractConnection;
+class VContActions;
 
 //! Module implementing a GDB RSP server.
 
@@ -98,10 +105,14 @@ private:
 
   static const uint32_t BREAK_INSTR = 0x100073;
 
-  //! Constant which is the sample period (in instruction steps) during
-  //! "continue" etc.
+  //! Constant for a compressed breakpoint (C.EBREAK).
 
-  static const int RUN_SAMPLE_PERIOD = 10000;
+  static const uint16_t C_BREAK_INSTR = 0x9002;
+
+  //! Size (a power of two) of the aligned chunks in which strings are read
+  //! from target memory. This is small enough that no chunk crosses a page.
+
+  static const std::size_t STRING_CHUNK_SIZE = 256;
 
   //! Our associated simulated CPU
 
@@ -123,14 +134,90 @@ private:
 
   RspPacket pkt;
 
+  //! Scratch buffer for memory reads and writes, reused for every request.
+
+  std::vector<uint8_t> mMemBuf;
+
+  //! Register values of each core, valid while the target is stopped
+
+  RegisterCache mRegCache;
+
+  //! Scratch buffers for the values and sizes of all the registers
+
+  std::vector<uint_reg_t> mRegVals;
+  std::vector<std::size_t> mRegSizes;
+
+  //! Memory of each core, valid while the target is stopped
+
+  MemoryCache mMemCache;
+
+  //! Registers whose values are sent with each stop reply
+
+  std::vector<int> mExpeditedRegs;
+
+  //! The PC register, or -1 if the target does not say
+
+  int mPcReg;
+
+  //! A matchpoint inserted by the client
+
+  struct Matchpoint {
+    //! The kind given by the client. For breakpoints, the size in bytes of
+    //! the breakpoint instruction.
+
+    std::size_t kind;
+
+    //! Whether this is a software breakpoint the server emulates by writing
+    //! a breakpoint instruction to memory, because the target declined it.
+
+    bool emulated;
+
+    //! The instruction replaced by an emulated breakpoint
+
+    uint8_t savedInstr[4];
+
+    //! Whether the client still wants the matchpoint. Matchpoints the client
+    //! has removed stay in the target until it is next resumed, in case the
+    //! client inserts them again first.
+
+    bool wanted;
+
+    //! Conditions for a breakpoint. The client is only told the target
+    //! stopped at the breakpoint if one of them is true, or there are none.
+
+    std::vector<AgentExpr> conditions;
+
+    //! Commands run by the server when the target stops at a breakpoint and
+    //! its conditions hold, such as the printf of a dynamic printf. The
+    //! client is not told of stops at a breakpoint with commands.
+
+    std::vector<AgentExpr> commands;
+  };
+
   //! Hash table for matchpoints
 
-  std::map<std::pair<MatchpointType, uint_addr_t>, uint64_t> mMatchpointMap;
+  typedef std::map<std::pair<MatchpointType, uint_addr_t>, Matchpoint>
+      MatchpointMap;
+  MatchpointMap mMatchpointMap;
+
+  //! Number of matchpoints the client has removed which are still in the
+  //! target
+
+  std::size_t mPendingRemovals;
 
   //! Timeout for continue.
 
   Timeout mTimeout;
 
+  //! How long the target may run in each wait
+
+  WaitBudget mWaitBudget;
+
+  //! Whether the last wait returned TIMEOUT, so that the target is running
+  //! for long enough to be worth watching the client for
+
+  bool mLastWaitTimedOut;
+
   //! How to behave when we get a kill (k) packet.
 
   KillBehaviour killBehaviour;
@@ -143,10 +230,22 @@ private:
 
   bool mHaveMultiProc;
 
+  //! Whether the client supports software and hardware breakpoint stop
+  //! reasons
+
+  bool mHaveSwBreak;
+  bool mHaveHwBreak;
+
   //! Stop mode
 
   StopMode mStopMode;
 
+  //! Stop replies not yet collected by the client in non-stop mode. The
+  //! first has been sent in a notification, and is removed when the client
+  //! asks for the next with vStopped.
+
+  std::deque<std::string> mStopQueue;
+
   //! Current PTID
 
   Ptid mPtid;
@@ -197,6 +296,8 @@ private:
       return mCoreStates[coreNum].isLive();
     }
 
+    bool isAnyCoreRunning() const;
+
     bool killCoreNum(unsigned int coreNum);
 
     void reset();
@@ -208,7 +309,8 @@ private:
       CoreState()
           : mStopReason(ITarget::ResumeRes::INTERRUPTED),
             mResumeType(ITarget::ResumeType::NONE), mStopReported(true),
-            mIsLive(true) {}
+            mIsLive(true), mStepStart(0), mStepEnd(0),
+            mServerStepsRange(false) {}
 
       void killCore() { mIsLive = false; }
 
@@ -231,6 +333,30 @@ private:
 
       void setResumeType(ITarget::ResumeType type) { mResumeType = type; }
 
+      ITarget::ResumeType resumeType() const { return mResumeType; }
+
+      void setStepRange(uint_addr_t start, uint_addr_t end,
+                        bool serverSteps) {
+        mStepStart = start;
+        mStepEnd = end;
+        mServerStepsRange = serverSteps;
+      }
+
+      bool inStepRange(uint_addr_t addr) const {
+        return (mStepStart <= addr) && (addr < mStepEnd);
+      }
+
+      bool serverStepsRange() const {
+        return (mResumeType == ITarget::ResumeType::RANGE_STEP) &&
+               mServerStepsRange;
+      }
+
+      // The action the target is prepared with, which is a single step
+      // when the server steps the core through its range.
+      ITarget::ResumeType targetResumeType() const {
+        return serverStepsRange() ? ITarget::ResumeType::STEP : mResumeType;
+      }
+
     private:
       // The last reason that this core stopped.
       ITarget::ResumeRes mStopReason;
@@ -245,6 +371,15 @@ private:
       // True when this core is "live", set to false when the core calls
       // exit, after which the core is considered "not-live".
       bool mIsLive;
+
+      // The range of addresses a range stepping core steps within, from
+      // the first address to the address just after the range.
+      uint_addr_t mStepStart;
+      uint_addr_t mStepEnd;
+
+      // True when the target declined to range step this core, so the
+      // server single steps it until it leaves its range.
+      bool mServerStepsRange;
     };
 
     CoreState &operator[](std::size_t idx) {
@@ -275,6 +410,20 @@ private:
   //! Keep track of core count, and which cores are live.
   CoreManager mCoreManager;
 
+  //! Access for agent expressions to the current core
+
+  class AgentContext : public AgentExpr::Context {
+  public:
+    AgentContext(GdbServer *server) : mServer(server) {}
+
+    bool readRegister(int reg, uint_reg_t &value) override;
+    bool readMemory(uint_addr_t addr, uint8_t *buf, std::size_t size) override;
+    void output(const std::string &text) override;
+
+  private:
+    GdbServer *mServer;
+  };
+
 protected:
   // Main RSP request handler
   void rspClientRequest();
@@ -282,13 +431,43 @@ protected:
 private:
   // Handle the various RSP requests
   uint_reg_t readArgLoc(const ITarget::SyscallArgLoc &loc);
+  void readArgLocs(std::size_t count, std::vector<uint_reg_t> &args);
   int stringLength(uint_addr_t addr);
+  bool writeMem(uint_addr_t addr, const uint8_t *buf, std::size_t len);
+  void setCurrentCore(unsigned int core);
+  void invalidateCaches();
+  bool insertMatchpoint(MatchpointType type, uint_addr_t addr,
+                        std::size_t kind,
+                        const std::vector<AgentExpr> &conditions,
+                        const std::vector<AgentExpr> &commands);
+  static bool parseAgentExprs(const char *params,
+                              std::vector<AgentExpr> &conditions,
+                              std::vector<AgentExpr> &commands);
+  bool conditionHolds(const Matchpoint &mp);
+  void runCommands(const Matchpoint &mp);
+  bool removeMatchpoint(MatchpointType type, uint_addr_t addr);
+  void flushMatchpoints();
+  void removeAllMatchpoints();
+  bool removeFromTarget(MatchpointType type, uint_addr_t addr,
+                        const Matchpoint &mp);
+  void shadowMatchpoints(uint_addr_t addr, uint8_t *buf, std::size_t len,
+                         bool writing);
+  static bool breakInstr(std::size_t kind, uint8_t *bytes);
+  const char *breakReason(TargetSignal sig);
+  void buildStopReply(unsigned int core, TargetSignal sig,
+                      RspPacketBuilder &response);
+  std::size_t readReg(int reg, uint_reg_t &value);
+  std::size_t writeReg(int reg, uint_reg_t value);
+  void readRegs(int first, int count, uint_reg_t *values, std::size_t *sizes);
+  void writeRegs(int first, int count, const uint_reg_t *values,
+                 std::size_t *sizes);
   void rspSyscallRequest();
   void rspSyscallReply();
   void rspReportException(TargetSignal sig = TargetSignal::TRAP);
   void rspReadAllRegs();
   void rspWriteAllRegs();
   void rspReadMem();
+  void rspReadMemBin();
   void rspWriteMem();
   void rspReadReg();
   void rspWriteReg();
@@ -304,11 +483,30 @@ private:
   void rspInsertMatchpoint();
   void rspWriteNextThreadInfo();
   void rspVCont();
+  void rspVContNonStop(const VContActions &actions);
   void rspVKill();
+  void rspVStopped();
+  void rspStopReasonsNonStop();
 
   void doCoreActions(void);
+  bool reportBreakOrTimeout();
+  bool resumeAndWait(std::vector<ITarget::ResumeRes> &results);
+  bool skipConditionalStops(
+      std::vector<std::pair<unsigned int, MatchpointMap::iterator>> &skipped);
+  bool stepOverBreakpoints(
+      const std::vector<std::pair<unsigned int, MatchpointMap::iterator>>
+          &skipped);
+  bool stepWithinRanges();
   bool getNextStopEvent(unsigned int &, ITarget::ResumeRes &);
   bool processStopEvents(void);
+  static TargetSignal stopSignal(ITarget::ResumeRes res);
+
+  ITarget::WaitRes waitTarget(std::vector<ITarget::ResumeRes> &results,
+                              int timeoutMs);
+  void waitNonStop();
+  void haltCore(unsigned int core, TargetSignal sig);
+  void queueStopReply(unsigned int core, TargetSignal sig);
+  void leaveNonStop();
 };
 
 } // namespace EmbDebug
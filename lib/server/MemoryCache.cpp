@@ -0,0 +1,293 @@
+// Memory cache: implementation
+//
+// This file is part of the Embecosm GDB Server.
+//
+// Copyright (C) 2019 Embecosm Limited
+// SPDX-License-Identifier: GPL-3.0-or-later
+// ----------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include "MemoryCache.h"
+
+using namespace EmbDebug;
+
+//! Constructor
+
+//! Initially nothing is cached, caching is enabled, core 0 is current and
+//! there have been no sequential reads.
+
+//! @param[in] cpu       The target whose memory is cached
+//! @param[in] numCores  The number of cores
+
+MemoryCache::MemoryCache(ITarget *cpu, unsigned int numCores)
+    : mCpu(cpu), mEnabled(true), mCore(0), mPages(numCores), mPool(),
+      mUsedPages(0), mFreePages(), mLastAddr(1), mLastEnd(0), mReadAhead(0) {}
+
+//! Destructor
+
+MemoryCache::~MemoryCache() {}
+
+//! Enable or disable caching
+
+//! Disabling the cache empties it.
+
+//! @param[in] enabled  TRUE to enable caching, FALSE to disable it
+
+void MemoryCache::setEnabled(bool enabled) {
+  mEnabled = enabled;
+  if (!enabled)
+    invalidate();
+}
+
+//! Select the core whose memory is accessed
+
+//! @param[in] core  The core, which must be less than the number of cores
+
+void MemoryCache::setCore(unsigned int core) {
+  assert(core < mPages.size());
+  mCore = core;
+}
+
+//! Read memory of the current core
+
+//! Any pages of the range which are not cached are read from the target,
+//! a run of consecutive pages at a time. If the read follows on from the
+//! previous read, the last run also includes the pages to be read ahead. If
+//! the target cannot read whole pages (for example at the end of memory), or
+//! the memory is not cacheable, the range is read from the target directly.
+
+//! @param[in]  addr    The address to read from
+//! @param[out] buffer  Buffer for the bytes read
+//! @param[in]  size    The number of bytes to read
+//! @return  The number of bytes read
+
+std::size_t MemoryCache::read(uint_addr_t addr, uint8_t *buffer,
+                              std::size_t size) {
+  if (!mEnabled || size == 0)
+    return mCpu->read(addr, buffer, size);
+
+  uint_addr_t first = addr & ~static_cast<uint_addr_t>(PAGE_SIZE - 1);
+  uint_addr_t last =
+      (addr + size - 1) & ~static_cast<uint_addr_t>(PAGE_SIZE - 1);
+  if (last < first)
+    return mCpu->read(addr, buffer, size); // Wraps around memory
+
+  // A read which starts within or just after the previous read is
+  // sequential, and grows the read ahead.
+  if ((addr < mLastAddr) || (addr > mLastEnd))
+    mReadAhead = 0;
+  else if (mReadAhead == 0)
+    mReadAhead = 1;
+  else if (mReadAhead < MAX_READ_AHEAD)
+    mReadAhead *= 2;
+  mLastAddr = addr;
+  mLastEnd = addr + size;
+
+  std::size_t numPages = (last - first) / PAGE_SIZE + 1;
+  if (numPages > MAX_PAGES || !mCpu->isCacheable(first, numPages * PAGE_SIZE))
+    return mCpu->read(addr, buffer, size);
+
+  // Make sure there is room for the missing pages, so that filling them
+  // does not evict the pages which are present.
+  std::size_t missing = 0;
+  for (std::size_t i = 0; i < numPages; i++)
+    if (lookup(first + i * PAGE_SIZE) == nullptr)
+      missing++;
+  if (missing > freePages())
+    clearPages();
+
+  // Fill each run of missing pages
+  std::size_t i = 0;
+  while (i < numPages) {
+    if (lookup(first + i * PAGE_SIZE) != nullptr) {
+      i++;
+      continue;
+    }
+
+    std::size_t j = i + 1;
+    while (j < numPages && lookup(first + j * PAGE_SIZE) == nullptr)
+      j++;
+
+    // If read ahead fails, try again without it.
+    std::size_t ahead = 0;
+    if ((j == numPages) && (last + PAGE_SIZE > last))
+      ahead = readAheadPages(last + PAGE_SIZE, freePages() - (j - i));
+    if (!fill(first + i * PAGE_SIZE, j - i + ahead) &&
+        ((ahead == 0) || !fill(first + i * PAGE_SIZE, j - i)))
+      return mCpu->read(addr, buffer, size);
+    i = j;
+  }
+
+  // Copy the data out of the pages
+  std::size_t done = 0;
+  while (done < size) {
+    uint_addr_t pageAddr =
+        (addr + done) & ~static_cast<uint_addr_t>(PAGE_SIZE - 1);
+    std::size_t off = static_cast<std::size_t>(addr + done - pageAddr);
+    std::size_t len = std::min(PAGE_SIZE - off, size - done);
+    ::memcpy(buffer + done, lookup(pageAddr) + off, len);
+    done += len;
+  }
+
+  return size;
+}
+
+//! Record a write to memory of the current core
+
+//! The write must already have been made to the target. Any cached pages
+//! of the current core it overlaps are updated. Other cores may share the
+//! memory, so their copies of the pages are dropped, and the pool pages
+//! they used are freed.
+
+//! @param[in] addr    The address written to
+//! @param[in] buffer  The bytes written
+//! @param[in] size    The number of bytes written
+
+void MemoryCache::write(uint_addr_t addr, const uint8_t *buffer,
+                        std::size_t size) {
+  std::unordered_map<uint_addr_t, std::size_t> &pages = mPages[mCore];
+  std::size_t done = 0;
+  while (done < size) {
+    uint_addr_t pageAddr =
+        (addr + done) & ~static_cast<uint_addr_t>(PAGE_SIZE - 1);
+    std::size_t off = static_cast<std::size_t>(addr + done - pageAddr);
+    std::size_t len = std::min(PAGE_SIZE - off, size - done);
+
+    auto it = pages.find(pageAddr);
+    if (it != pages.end())
+      ::memcpy(&mPool[it->second + off], buffer + done, len);
+    for (std::size_t core = 0; core < mPages.size(); core++) {
+      if (core == mCore)
+        continue;
+
+      auto other = mPages[core].find(pageAddr);
+      if (other != mPages[core].end()) {
+        mFreePages.push_back(other->second);
+        mPages[core].erase(other);
+      }
+    }
+    done += len;
+  }
+}
+
+//! Invalidate all cached memory of all cores
+
+//! Reads after this are not treated as following on from reads before it.
+
+void MemoryCache::invalidate() {
+  clearPages();
+  mLastAddr = 1;
+  mLastEnd = 0;
+  mReadAhead = 0;
+}
+
+//! Empty the cache of all cores
+
+void MemoryCache::clearPages() {
+  for (auto &pages : mPages)
+    pages.clear();
+  mUsedPages = 0;
+  mFreePages.clear();
+}
+
+//! Find how many more pages the pool can hold
+
+//! @return  The number of pages never handed out, plus those freed
+
+std::size_t MemoryCache::freePages() const {
+  return MAX_PAGES - mUsedPages + mFreePages.size();
+}
+
+//! Hand out a page of the pool
+
+//! Pages which have been freed are handed out first. There must be a page
+//! free.
+
+//! @return  The offset of the page in the pool
+
+std::size_t MemoryCache::allocPage() {
+  assert(freePages() > 0);
+  if (mFreePages.empty())
+    return mUsedPages++ * PAGE_SIZE;
+
+  std::size_t offset = mFreePages.back();
+  mFreePages.pop_back();
+  return offset;
+}
+
+//! Find a cached page of the current core
+
+//! @param[in] pageAddr  The address of the page
+//! @return  The page data, or nullptr if the page is not cached
+
+const uint8_t *MemoryCache::lookup(uint_addr_t pageAddr) const {
+  const std::unordered_map<uint_addr_t, std::size_t> &pages = mPages[mCore];
+  auto it = pages.find(pageAddr);
+  return it == pages.end() ? nullptr : &mPool[it->second];
+}
+
+//! Read consecutive pages of the current core from the target
+
+//! There must be room in the pool for the pages. If there are no freed
+//! pages to reuse, the pages are read straight into the pool. Otherwise
+//! they are read into a buffer and copied into the pages handed out.
+
+//! @param[in] pageAddr  The address of the first page
+//! @param[in] numPages  The number of pages
+//! @return  TRUE if all the pages were read, FALSE otherwise
+
+bool MemoryCache::fill(uint_addr_t pageAddr, std::size_t numPages) {
+  assert(numPages <= freePages());
+  if (mPool.empty())
+    mPool.resize(MAX_PAGES * PAGE_SIZE);
+
+  std::unordered_map<uint_addr_t, std::size_t> &pages = mPages[mCore];
+  std::size_t len = numPages * PAGE_SIZE;
+  if (mFreePages.empty()) {
+    std::size_t offset = mUsedPages * PAGE_SIZE;
+    if (mCpu->read(pageAddr, &mPool[offset], len) != len)
+      return false;
+
+    for (std::size_t i = 0; i < numPages; i++)
+      pages[pageAddr + i * PAGE_SIZE] = allocPage();
+    return true;
+  }
+
+  std::vector<uint8_t> data(len);
+  if (mCpu->read(pageAddr, data.data(), len) != len)
+    return false;
+
+  for (std::size_t i = 0; i < numPages; i++) {
+    std::size_t offset = allocPage();
+    ::memcpy(&mPool[offset], &data[i * PAGE_SIZE], PAGE_SIZE);
+    pages[pageAddr + i * PAGE_SIZE] = offset;
+  }
+  return true;
+}
+
+//! Find how many pages to read ahead
+
+//! Reading ahead stops at the first page which is already cached or is not
+//! cacheable, and does not wrap around memory.
+
+//! @param[in] pageAddr  The address of the first page to read ahead
+//! @param[in] maxPages  The maximum number of pages there is room for
+//! @return  The number of pages to read ahead
+
+std::size_t MemoryCache::readAheadPages(uint_addr_t pageAddr,
+                                        std::size_t maxPages) const {
+  std::size_t limit = std::min(mReadAhead, maxPages);
+  std::size_t count = 0;
+  while (count < limit) {
+    uint_addr_t nextAddr = pageAddr + count * PAGE_SIZE;
+    if ((nextAddr < pageAddr) || (lookup(nextAddr) != nullptr) ||
+        !mCpu->isCacheable(nextAddr, PAGE_SIZE))
+      break;
+    count++;
+  }
+
+  return count;
+}
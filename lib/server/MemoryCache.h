@@ -0,0 +1,133 @@
+// Memory cache: declaration
+//
+// This file is part of the Embecosm GDB Server.
+//
+// Copyright (C) 2019 Embecosm Limited
+// SPDX-License-Identifier: GPL-3.0-or-later
+// ----------------------------------------------------------------------------
+
+#ifndef EMBDEBUG_MEMORY_CACHE_H
+#define EMBDEBUG_MEMORY_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "embdebug/ITarget.h"
+#include "embdebug/Types.h"
+
+namespace EmbDebug {
+
+//! Cache of target memory for each core.
+
+//! While the target is stopped its memory only changes when the server
+//! writes it, so GDB's repeated reads of the same stack frames, code and
+//! data after each stop can be served without asking the target again.
+
+//! Memory is cached in aligned pages. A read which misses fetches all the
+//! pages it needs from the target in a single read. Only memory which the
+//! target reports as cacheable is cached. Any other memory (such as memory
+//! mapped I/O, and all memory of targets which do not say) is always read
+//! from the target, exactly as asked.
+
+//! When reads are sequential, as when GDB disassembles or dumps memory, a
+//! read which misses also fetches the pages which follow it, so that the
+//! next reads are served from the cache. The number of pages read ahead
+//! doubles with each sequential read, up to a limit, and is reset by any
+//! other read.
+
+//! The cache does not know when the target runs. It is the responsibility
+//! of the user to invalidate it before the target is resumed or reset, or
+//! otherwise changes its memory.
+
+class MemoryCache {
+public:
+  // Constructor and destructor
+
+  MemoryCache(ITarget *cpu, unsigned int numCores);
+  ~MemoryCache();
+
+  // Enable and disable caching
+
+  void setEnabled(bool enabled);
+  bool isEnabled() const { return mEnabled; }
+
+  // Select the core whose memory is accessed
+
+  void setCore(unsigned int core);
+
+  // Access memory of the current core
+
+  std::size_t read(uint_addr_t addr, uint8_t *buffer, std::size_t size);
+  void write(uint_addr_t addr, const uint8_t *buffer, std::size_t size);
+
+  // Invalidate all cached memory
+
+  void invalidate();
+
+private:
+  //! Size of a page of the cache. A power of two.
+
+  static const std::size_t PAGE_SIZE = 256;
+
+  //! Maximum number of pages cached. When full the cache is emptied.
+
+  static const std::size_t MAX_PAGES = 1024;
+
+  //! Maximum number of pages read ahead of a sequential read
+
+  static const std::size_t MAX_READ_AHEAD = 16;
+
+  //! The target
+
+  ITarget *mCpu;
+
+  //! Whether caching is enabled
+
+  bool mEnabled;
+
+  //! The current core
+
+  unsigned int mCore;
+
+  //! For each core, the offset in the pool of each cached page, indexed
+  //! by page address.
+
+  std::vector<std::unordered_map<uint_addr_t, std::size_t>> mPages;
+
+  //! Storage for the cached pages, allocated when first needed
+
+  std::vector<uint8_t> mPool;
+
+  //! Number of pages at the start of the pool which have been handed out
+
+  std::size_t mUsedPages;
+
+  //! Offsets in the pool of pages handed out and since dropped, to be handed
+  //! out again before the rest of the pool
+
+  std::vector<std::size_t> mFreePages;
+
+  //! Start and end of the last read, to detect sequential reads
+
+  uint_addr_t mLastAddr;
+  uint_addr_t mLastEnd;
+
+  //! Number of pages to read ahead of the next read which misses
+
+  std::size_t mReadAhead;
+
+  // Empty, find or fill cached pages
+
+  void clearPages();
+  std::size_t freePages() const;
+  std::size_t allocPage();
+  const uint8_t *lookup(uint_addr_t pageAddr) const;
+  bool fill(uint_addr_t pageAddr, std::size_t numPages);
+  std::size_t readAheadPages(uint_addr_t pageAddr, std::size_t maxPages) const;
+};
+
+} // namespace EmbDebug
+
+#endif
@@ -0,0 +1,117 @@
+// Register cache: implementation
+//
+// This file is part of the Embecosm GDB Server.
+//
+// Copyright (C) 2019 Embecosm Limited
+// SPDX-License-Identifier: GPL-3.0-or-later
+// ----------------------------------------------------------------------------
+
+#include <cassert>
+#include <climits>
+
+#include "RegisterCache.h"
+
+using namespace EmbDebug;
+
+//! Constructor
+
+//! Initially nothing is cached, and core 0 is current.
+
+//! @param[in] numCores  The number of cores
+//! @param[in] numRegs   The number of registers to cache for each core
+
+RegisterCache::RegisterCache(unsigned int numCores, int numRegs)
+    : mNumRegs(numRegs < 0 ? 0 : numRegs), mCore(0),
+      mEntries(static_cast<std::size_t>(numCores) * mNumRegs, Entry{0, 0}) {}
+
+//! Destructor
+
+RegisterCache::~RegisterCache() {}
+
+//! Select the core whose registers are accessed
+
+//! @param[in] core  The core, which must be less than the number of cores
+
+void RegisterCache::setCore(unsigned int core) {
+  assert((static_cast<std::size_t>(core) + 1) * mNumRegs <= mEntries.size());
+  mCore = core;
+}
+
+//! Look up a register of the current core
+
+//! @param[in]  reg    The register number
+//! @param[out] value  The register value, if cached
+//! @param[out] size   The register size in bytes, if cached
+//! @return  TRUE if the register was cached, FALSE otherwise
+
+bool RegisterCache::lookup(int reg, uint_reg_t &value,
+                           std::size_t &size) const {
+  const Entry *e = entry(reg);
+  if (e == nullptr || e->size == 0)
+    return false;
+
+  value = e->value;
+  size = e->size;
+  return true;
+}
+
+//! Record the value of a register of the current core
+
+//! The value is truncated to the size of the register, as the target would
+//! do if it were written. Registers which cannot be cached are ignored.
+
+//! @param[in] reg    The register number
+//! @param[in] value  The register value
+//! @param[in] size   The register size in bytes, zero if unknown
+
+void RegisterCache::store(int reg, uint_reg_t value, std::size_t size) {
+  Entry *e = entry(reg);
+  if (e == nullptr)
+    return;
+
+  if (size > 0 && size < sizeof(uint_reg_t))
+    value &= (static_cast<uint_reg_t>(1) << (size * CHAR_BIT)) - 1;
+  e->value = value;
+  e->size = size > sizeof(uint_reg_t) ? 0 : size;
+}
+
+//! Forget a register of the current core
+
+//! @param[in] reg  The register number
+
+void RegisterCache::invalidate(int reg) {
+  Entry *e = entry(reg);
+  if (e != nullptr)
+    e->size = 0;
+}
+
+//! Forget all the registers of the current core
+
+void RegisterCache::invalidateCore() {
+  for (int reg = 0; reg < mNumRegs; reg++)
+    invalidate(reg);
+}
+
+//! Forget the registers of all cores
+
+void RegisterCache::invalidateAll() {
+  for (Entry &e : mEntries)
+    e.size = 0;
+}
+
+//! Find the entry for a register of the current core
+
+//! @param[in] reg  The register number
+//! @return  The entry, or nullptr if the register is not cached
+
+RegisterCache::Entry *RegisterCache::entry(int reg) {
+  if (reg < 0 || reg >= mNumRegs)
+    return nullptr;
+  return &mEntries[static_cast<std::size_t>(mCore) * mNumRegs + reg];
+}
+
+const RegisterCache::Entry *RegisterCache::entry(int reg) const {
+  if (reg < 0 || reg >= mNumRegs)
+    return nullptr;
+  return &mEntries[static_cast<std::size_t>(mCore) * mNumRegs + reg];
+}
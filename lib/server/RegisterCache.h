@@ -0,0 +1,84 @@
+// Register cache: declaration
+//
+// This file is part of the Embecosm GDB Server.
+//
+// Copyright (C) 2019 Embecosm Limited
+// SPDX-License-Identifier: GPL-3.0-or-later
+// ----------------------------------------------------------------------------
+
+#ifndef EMBDEBUG_REGISTER_CACHE_H
+#define EMBDEBUG_REGISTER_CACHE_H
+
+#include <cstddef>
+#include <vector>
+
+#include "embdebug/Types.h"
+
+namespace EmbDebug {
+
+//! Cache of register values for each core.
+
+//! While the target is stopped its registers only change when the server
+//! writes them, so GDB's repeated reads of the same registers after each
+//! stop can be served without asking the target again.
+
+//! The cache holds the registers numbered below the register count given to
+//! the constructor. Other registers (such as CSRs accessed by number) are
+//! never cached.
+
+//! The cache does not know when the target runs. It is the responsibility
+//! of the user to invalidate it before the target is resumed or reset, or
+//! otherwise changes its registers.
+
+class RegisterCache {
+public:
+  // Constructor and destructor
+
+  RegisterCache(unsigned int numCores, int numRegs);
+  ~RegisterCache();
+
+  // Select the core whose registers are accessed
+
+  void setCore(unsigned int core);
+  unsigned int getCore() const { return mCore; }
+
+  // Access registers of the current core
+
+  bool lookup(int reg, uint_reg_t &value, std::size_t &size) const;
+  void store(int reg, uint_reg_t value, std::size_t size);
+
+  // Invalidate cached registers
+
+  void invalidate(int reg);
+  void invalidateCore();
+  void invalidateAll();
+
+private:
+  //! A cached register
+
+  struct Entry {
+    uint_reg_t value; //!< The register value
+    std::size_t size; //!< The size in bytes, or zero if not cached
+  };
+
+  //! Number of registers cached for each core
+
+  int mNumRegs;
+
+  //! The current core
+
+  unsigned int mCore;
+
+  //! The cached registers, mNumRegs for each core in turn
+
+  std::vector<Entry> mEntries;
+
+  // Find the entry for a register of the current core
+
+  Entry *entry(int reg);
+  const Entry *entry(int reg) const;
+};
+
+} // namespace EmbDebug
+
+#endif
@@ -0,0 +1,198 @@
+// Byte ring buffer: definition
+//
+// This file is part of the Embecosm GDB Server.
+//
+// Copyright (C) 2019 Embecosm Limited
+// SPDX-License-Identifier: GPL-3.0-or-later
+// ----------------------------------------------------------------------------
+
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+namespace EmbDebug {
+
+//! A fixed capacity circular buffer of bytes.
+
+//! This is used by the connections to buffer incoming data, so that it may be
+//! read from the OS in large blocks but consumed a character at a time. The
+//! capacity is always a power of two, so that the free-running head and tail
+//! indices can be mapped onto the storage with a simple mask.
+
+//! Data which has been consumed may be pinned, so that it is not overwritten
+//! by new data. This allows packets to be parsed in place, with the caller
+//! using the data directly from the buffer.
+
+class RingBuffer {
+public:
+  // Constructor
+
+  explicit RingBuffer(std::size_t capacity)
+      : mHead(0), mTail(0), mPin(0), mPinned(false) {
+    std::size_t size = 1;
+    while (size < capacity)
+      size <<= 1;
+    mData.resize(size);
+    mMask = size - 1;
+  }
+
+  // Accessors
+
+  std::size_t capacity() const { return mMask + 1; }
+  std::size_t size() const { return mTail - mHead; }
+  std::size_t space() const {
+    return capacity() - (mTail - (mPinned ? mPin : mHead));
+  }
+  bool empty() const { return mHead == mTail; }
+
+  //! Discard all buffered data, including any pinned data
+
+  void clear() {
+    mHead = mTail = 0;
+    mPinned = false;
+  }
+
+  //! Start again from the beginning of the storage if nothing is buffered.
+
+  //! Keeping data at the start of the storage means it is less likely to
+  //! wrap, so less likely to need ::linearize ().
+
+  void rewind() {
+    if (empty() && !mPinned)
+      mHead = mTail = 0;
+  }
+
+  //! Look at the oldest character in the buffer without removing it
+
+  unsigned char front() const {
+    assert(!empty() && "Attempted to read from an empty RingBuffer");
+    return static_cast<unsigned char>(mData[mHead & mMask]);
+  }
+
+  //! Remove and return the oldest character in the buffer
+
+  unsigned char pop() {
+    unsigned char c = front();
+    mHead++;
+    return c;
+  }
+
+  //! Look at a character in the buffer without removing it
+
+  //! @param[in] offset  Offset of the character from the oldest character
+
+  unsigned char at(std::size_t offset) const {
+    assert(offset < size() && "Attempted to read beyond RingBuffer data");
+    return static_cast<unsigned char>(mData[(mHead + offset) & mMask]);
+  }
+
+  //! Remove the \p len oldest characters from the buffer
+
+  void drop(std::size_t len) {
+    assert(len <= size() && "Attempted to drop more than the RingBuffer holds");
+    mHead += len;
+  }
+
+  //! Get the largest contiguous region of data from an offset.
+
+  //! @param[in]  offset  Offset from the oldest character.
+  //! @param[out] len     The number of chars which may be read.
+  //! @return  Pointer to the start of the data.
+
+  const char *readRegion(std::size_t offset, std::size_t &len) const {
+    assert(offset <= size() && "Attempted to read beyond RingBuffer data");
+    std::size_t start = (mHead + offset) & mMask;
+    std::size_t toEnd = capacity() - start;
+    std::size_t avail = size() - offset;
+    len = avail < toEnd ? avail : toEnd;
+    return &mData[start];
+  }
+
+  //! Make sure the \p len oldest chars are held contiguously.
+
+  //! If they wrap around the end of the storage, the contents are rotated so
+  //! the oldest char is at the start of the storage. Any pinned data is lost.
+
+  //! @param[in] len  The number of chars required to be contiguous.
+  //! @return  Pointer to the oldest char.
+
+  char *linearize(std::size_t len) {
+    assert(len <= size() && "Attempted to linearize beyond RingBuffer data");
+    std::size_t start = mHead & mMask;
+    if (start + len > capacity()) {
+      std::rotate(mData.begin(), mData.begin() + start, mData.end());
+      mTail -= mHead;
+      mHead = 0;
+      mPinned = false;
+      start = 0;
+    }
+    return &mData[start];
+  }
+
+  //! Protect data from the oldest character onwards from being overwritten,
+  //! even once consumed, until ::unpin () is called.
+
+  void pin() {
+    mPin = mHead;
+    mPinned = true;
+  }
+
+  //! Allow pinned data to be overwritten
+
+  void unpin() { mPinned = false; }
+
+  //! Get the largest contiguous free region of the buffer.
+
+  //! Data may be written directly into this region, and then made visible
+  //! with ::commit ().
+
+  //! @param[out] len  The number of chars which may be written.
+  //! @return  Pointer to the start of the free region.
+
+  char *writeRegion(std::size_t &len) {
+    std::size_t offset = mTail & mMask;
+    std::size_t toEnd = capacity() - offset;
+    len = space() < toEnd ? space() : toEnd;
+    return &mData[offset];
+  }
+
+  //! Make \p len chars written into the ::writeRegion () visible.
+
+  void commit(std::size_t len) {
+    assert(len <= space() && "Committed more than the RingBuffer can hold");
+    mTail += len;
+  }
+
+private:
+  //! The storage
+
+  std::vector<char> mData;
+
+  //! Mask to map indices onto the storage
+
+  std::size_t mMask;
+
+  //! Free running index of the oldest character
+
+  std::size_t mHead;
+
+  //! Free running index one beyond the newest character
+
+  std::size_t mTail;
+
+  //! Free running index of the oldest pinned character
+
+  std::size_t mPin;
+
+  //! Whether any data is pinned
+
+  bool mPinned;
+};
+
+} // namespace EmbDebug
+
+#endif
@@ -0,0 +1,499 @@
+// RSP data encoding kernels: implementation
+//
+// This file is part of the Embecosm GDB Server.
+//
+// Copyright (C) 2019 Embecosm Limited
+// SPDX-License-Identifier: GPL-3.0-or-later
+// ----------------------------------------------------------------------------
+
+#include <cstring>
+
+#include "RspCodec.h"
+
+// SSE2 is always available on x86-64, and may be assumed on 32-bit x86 if
+// the compiler has been told so. AVX2 needs run time detection, which we only
+// do with compilers supporting per-function target attributes.
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                    \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define EMBDEBUG_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(EMBDEBUG_HAVE_SSE2) && defined(__GNUC__) &&                        \
+    (defined(__x86_64__) || defined(__i386__))
+#define EMBDEBUG_HAVE_AVX2 1
+#include <immintrin.h>
+#define EMBDEBUG_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+using namespace EmbDebug;
+
+namespace {
+
+//! Lower case hex digits
+const char HEX_DIGITS[] = "0123456789abcdef";
+
+//! Does a char need escaping
+inline bool needsEscape(char c) {
+  return ('$' == c) || ('#' == c) || ('*' == c) || ('}' == c);
+}
+
+//! Value of a hex digit, or -1 if it is not one
+inline int nibbleVal(char c) {
+  if ((c >= '0') && (c <= '9'))
+    return c - '0';
+  if ((c >= 'a') && (c <= 'f'))
+    return c - 'a' + 10;
+  if ((c >= 'A') && (c <= 'F'))
+    return c - 'A' + 10;
+  return -1;
+}
+
+//! Index of the lowest set bit of a non-zero mask
+inline unsigned int lowestBit(uint32_t mask) {
+#if defined(__GNUC__)
+  return static_cast<unsigned int>(__builtin_ctz(mask));
+#elif defined(_MSC_VER)
+  unsigned long idx;
+  _BitScanForward(&idx, mask);
+  return static_cast<unsigned int>(idx);
+#else
+  unsigned int idx = 0;
+  while (!(mask & 1)) {
+    mask >>= 1;
+    idx++;
+  }
+  return idx;
+#endif
+}
+
+// Scalar implementations. These also deal with the tails left over by the
+// vector implementations.
+
+uint8_t checksumScalar(const char *buf, std::size_t len) {
+  uint8_t sum = 0;
+  for (std::size_t i = 0; i < len; i++)
+    sum = static_cast<uint8_t>(sum + static_cast<uint8_t>(buf[i]));
+  return sum;
+}
+
+std::size_t findEscapeScalar(const char *buf, std::size_t len) {
+  for (std::size_t i = 0; i < len; i++)
+    if (needsEscape(buf[i]))
+      return i;
+  return len;
+}
+
+void bin2HexScalar(const uint8_t *src, std::size_t len, char *dest) {
+  for (std::size_t i = 0; i < len; i++) {
+    dest[i * 2] = HEX_DIGITS[src[i] >> 4];
+    dest[i * 2 + 1] = HEX_DIGITS[src[i] & 0xf];
+  }
+}
+
+bool hex2BinScalar(const char *src, std::size_t len, uint8_t *dest) {
+  for (std::size_t i = 0; i < len; i++) {
+    int hi = nibbleVal(src[i * 2]);
+    int lo = nibbleVal(src[i * 2 + 1]);
+    if ((hi < 0) || (lo < 0))
+      return false;
+    dest[i] = static_cast<uint8_t>((hi << 4) | lo);
+  }
+  return true;
+}
+
+#ifdef EMBDEBUG_HAVE_SSE2
+
+// SSE2 implementations, handling 16 bytes at a time.
+
+uint8_t checksumSse2(const char *buf, std::size_t len) {
+  const __m128i zero = _mm_setzero_si128();
+  __m128i acc = zero;
+  std::size_t i = 0;
+
+  // Sum each group of 8 bytes into a 64-bit lane
+  for (; i + 16 <= len; i += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(buf + i));
+    acc = _mm_add_epi64(acc, _mm_sad_epu8(v, zero));
+  }
+
+  uint64_t lanes[2];
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), acc);
+  return static_cast<uint8_t>(lanes[0] + lanes[1] +
+                              checksumScalar(buf + i, len - i));
+}
+
+std::size_t findEscapeSse2(const char *buf, std::size_t len) {
+  const __m128i dollar = _mm_set1_epi8('$');
+  const __m128i hash = _mm_set1_epi8('#');
+  const __m128i star = _mm_set1_epi8('*');
+  const __m128i brace = _mm_set1_epi8('}');
+  std::size_t i = 0;
+
+  for (; i + 16 <= len; i += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(buf + i));
+    __m128i m = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(v, dollar), _mm_cmpeq_epi8(v, hash)),
+        _mm_or_si128(_mm_cmpeq_epi8(v, star), _mm_cmpeq_epi8(v, brace)));
+    uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(m));
+    if (mask != 0)
+      return i + lowestBit(mask);
+  }
+
+  return i + findEscapeScalar(buf + i, len - i);
+}
+
+//! Convert each byte (0-15) to its lower case hex digit
+inline __m128i nibbleToHexSse2(__m128i n) {
+  __m128i alpha = _mm_cmpgt_epi8(n, _mm_set1_epi8(9));
+  __m128i adjust = _mm_and_si128(alpha, _mm_set1_epi8('a' - '0' - 10));
+  return _mm_add_epi8(_mm_add_epi8(n, _mm_set1_epi8('0')), adjust);
+}
+
+void bin2HexSse2(const uint8_t *src, std::size_t len, char *dest) {
+  const __m128i mask = _mm_set1_epi8(0x0f);
+  std::size_t i = 0;
+
+  for (; i + 16 <= len; i += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+    __m128i hi = nibbleToHexSse2(_mm_and_si128(_mm_srli_epi16(v, 4), mask));
+    __m128i lo = nibbleToHexSse2(_mm_and_si128(v, mask));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + i * 2),
+                     _mm_unpacklo_epi8(hi, lo));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + i * 2 + 16),
+                     _mm_unpackhi_epi8(hi, lo));
+  }
+
+  bin2HexScalar(src + i, len - i, dest + i * 2);
+}
+
+//! Convert each hex digit to its value, accumulating which were valid
+inline __m128i hexToNibbleSse2(__m128i c, __m128i &valid) {
+  __m128i d = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+  __m128i isDigit = _mm_cmpeq_epi8(_mm_max_epu8(d, _mm_set1_epi8(9)),
+                                   _mm_set1_epi8(9));
+  __m128i a = _mm_sub_epi8(_mm_or_si128(c, _mm_set1_epi8(0x20)),
+                           _mm_set1_epi8('a'));
+  __m128i isAlpha = _mm_cmpeq_epi8(_mm_max_epu8(a, _mm_set1_epi8(5)),
+                                   _mm_set1_epi8(5));
+  valid = _mm_and_si128(valid, _mm_or_si128(isDigit, isAlpha));
+  return _mm_or_si128(
+      _mm_and_si128(isDigit, d),
+      _mm_and_si128(isAlpha, _mm_add_epi8(a, _mm_set1_epi8(10))));
+}
+
+//! Combine pairs of nibbles (high nibble first) into 16-bit lanes
+inline __m128i nibblePairsSse2(__m128i n) {
+  return _mm_or_si128(
+      _mm_slli_epi16(_mm_and_si128(n, _mm_set1_epi16(0x00ff)), 4),
+      _mm_srli_epi16(n, 8));
+}
+
+bool hex2BinSse2(const char *src, std::size_t len, uint8_t *dest) {
+  __m128i valid = _mm_set1_epi8(-1);
+  std::size_t i = 0;
+
+  for (; i + 16 <= len; i += 16) {
+    const __m128i *p = reinterpret_cast<const __m128i *>(src + i * 2);
+    __m128i n0 = hexToNibbleSse2(_mm_loadu_si128(p), valid);
+    __m128i n1 = hexToNibbleSse2(_mm_loadu_si128(p + 1), valid);
+    _mm_storeu_si128(
+        reinterpret_cast<__m128i *>(dest + i),
+        _mm_packus_epi16(nibblePairsSse2(n0), nibblePairsSse2(n1)));
+  }
+
+  if (_mm_movemask_epi8(valid) != 0xffff)
+    return false;
+  return hex2BinScalar(src + i * 2, len - i, dest + i);
+}
+
+#endif // EMBDEBUG_HAVE_SSE2
+
+#ifdef EMBDEBUG_HAVE_AVX2
+
+// AVX2 implementations, handling 32 bytes at a time.
+
+EMBDEBUG_TARGET_AVX2
+uint8_t checksumAvx2(const char *buf, std::size_t len) {
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i acc = zero;
+  std::size_t i = 0;
+
+  for (; i + 32 <= len; i += 32) {
+    __m256i v =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(buf + i));
+    acc = _mm256_add_epi64(acc, _mm256_sad_epu8(v, zero));
+  }
+
+  uint64_t lanes[4];
+  _mm256_storeu_si256(reinterpret_cast<__m256i *>(lanes), acc);
+  return static_cast<uint8_t>(lanes[0] + lanes[1] + lanes[2] + lanes[3] +
+                              checksumSse2(buf + i, len - i));
+}
+
+EMBDEBUG_TARGET_AVX2
+std::size_t findEscapeAvx2(const char *buf, std::size_t len) {
+  const __m256i dollar = _mm256_set1_epi8('$');
+  const __m256i hash = _mm256_set1_epi8('#');
+  const __m256i star = _mm256_set1_epi8('*');
+  const __m256i brace = _mm256_set1_epi8('}');
+  std::size_t i = 0;
+
+  for (; i + 32 <= len; i += 32) {
+    __m256i v =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(buf + i));
+    __m256i m = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, dollar),
+                        _mm256_cmpeq_epi8(v, hash)),
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, star),
+                        _mm256_cmpeq_epi8(v, brace)));
+    uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(m));
+    if (mask != 0)
+      return i + lowestBit(mask);
+  }
+
+  return i + findEscapeSse2(buf + i, len - i);
+}
+
+EMBDEBUG_TARGET_AVX2
+inline __m256i nibbleToHexAvx2(__m256i n) {
+  __m256i alpha = _mm256_cmpgt_epi8(n, _mm256_set1_epi8(9));
+  __m256i adjust = _mm256_and_si256(alpha, _mm256_set1_epi8('a' - '0' - 10));
+  return _mm256_add_epi8(_mm256_add_epi8(n, _mm256_set1_epi8('0')), adjust);
+}
+
+EMBDEBUG_TARGET_AVX2
+void bin2HexAvx2(const uint8_t *src, std::size_t len, char *dest) {
+  const __m256i mask = _mm256_set1_epi8(0x0f);
+  std::size_t i = 0;
+
+  for (; i + 32 <= len; i += 32) {
+    __m256i v =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+    __m256i hi =
+        nibbleToHexAvx2(_mm256_and_si256(_mm256_srli_epi16(v, 4), mask));
+    __m256i lo = nibbleToHexAvx2(_mm256_and_si256(v, mask));
+
+    // The unpacks work within 128-bit lanes, so the halves need reordering
+    __m256i a = _mm256_unpacklo_epi8(hi, lo);
+    __m256i b = _mm256_unpackhi_epi8(hi, lo);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dest + i * 2),
+                        _mm256_permute2x128_si256(a, b, 0x20));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dest + i * 2 + 32),
+                        _mm256_permute2x128_si256(a, b, 0x31));
+  }
+
+  bin2HexSse2(src + i, len - i, dest + i * 2);
+}
+
+EMBDEBUG_TARGET_AVX2
+inline __m256i hexToNibbleAvx2(__m256i c, __m256i &valid) {
+  __m256i d = _mm256_sub_epi8(c, _mm256_set1_epi8('0'));
+  __m256i isDigit = _mm256_cmpeq_epi8(
+      _mm256_max_epu8(d, _mm256_set1_epi8(9)), _mm256_set1_epi8(9));
+  __m256i a = _mm256_sub_epi8(_mm256_or_si256(c, _mm256_set1_epi8(0x20)),
+                              _mm256_set1_epi8('a'));
+  __m256i isAlpha = _mm256_cmpeq_epi8(
+      _mm256_max_epu8(a, _mm256_set1_epi8(5)), _mm256_set1_epi8(5));
+  valid = _mm256_and_si256(valid, _mm256_or_si256(isDigit, isAlpha));
+  return _mm256_or_si256(
+      _mm256_and_si256(isDigit, d),
+      _mm256_and_si256(isAlpha, _mm256_add_epi8(a, _mm256_set1_epi8(10))));
+}
+
+EMBDEBUG_TARGET_AVX2
+inline __m256i nibblePairsAvx2(__m256i n) {
+  return _mm256_or_si256(
+      _mm256_slli_epi16(_mm256_and_si256(n, _mm256_set1_epi16(0x00ff)), 4),
+      _mm256_srli_epi16(n, 8));
+}
+
+EMBDEBUG_TARGET_AVX2
+bool hex2BinAvx2(const char *src, std::size_t len, uint8_t *dest) {
+  __m256i valid = _mm256_set1_epi8(-1);
+  std::size_t i = 0;
+
+  for (; i + 32 <= len; i += 32) {
+    const __m256i *p = reinterpret_cast<const __m256i *>(src + i * 2);
+    __m256i n0 = hexToNibbleAvx2(_mm256_loadu_si256(p), valid);
+    __m256i n1 = hexToNibbleAvx2(_mm256_loadu_si256(p + 1), valid);
+
+    // The pack works within 128-bit lanes, so the quarters need reordering
+    __m256i packed =
+        _mm256_packus_epi16(nibblePairsAvx2(n0), nibblePairsAvx2(n1));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dest + i),
+                        _mm256_permute4x64_epi64(packed, 0xd8));
+  }
+
+  if (static_cast<uint32_t>(_mm256_movemask_epi8(valid)) != 0xffffffff)
+    return false;
+  return hex2BinSse2(src + i * 2, len - i, dest + i);
+}
+
+#endif // EMBDEBUG_HAVE_AVX2
+
+//! A set of kernel implementations
+struct Kernels {
+  RspCodec::Impl impl;
+  uint8_t (*checksum)(const char *, std::size_t);
+  std::size_t (*findEscape)(const char *, std::size_t);
+  void (*bin2Hex)(const uint8_t *, std::size_t, char *);
+  bool (*hex2Bin)(const char *, std::size_t, uint8_t *);
+};
+
+const Kernels scalarKernels = {RspCodec::Impl::SCALAR, checksumScalar,
+                               findEscapeScalar, bin2HexScalar,
+                               hex2BinScalar};
+
+#ifdef EMBDEBUG_HAVE_SSE2
+const Kernels sse2Kernels = {RspCodec::Impl::SSE2, checksumSse2,
+                             findEscapeSse2, bin2HexSse2, hex2BinSse2};
+#endif
+
+#ifdef EMBDEBUG_HAVE_AVX2
+const Kernels avx2Kernels = {RspCodec::Impl::AVX2, checksumAvx2,
+                             findEscapeAvx2, bin2HexAvx2, hex2BinAvx2};
+#endif
+
+//! Get the kernels for an implementation, or nullptr if not supported.
+const Kernels *kernelsFor(RspCodec::Impl impl) {
+  switch (impl) {
+  case RspCodec::Impl::SCALAR:
+    return &scalarKernels;
+
+  case RspCodec::Impl::SSE2:
+#ifdef EMBDEBUG_HAVE_SSE2
+    return &sse2Kernels;
+#else
+    return nullptr;
+#endif
+
+  case RspCodec::Impl::AVX2:
+#ifdef EMBDEBUG_HAVE_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+      return &avx2Kernels;
+#endif
+    return nullptr;
+  }
+
+  return nullptr;
+}
+
+//! Get the best supported kernels
+const Kernels *bestKernels() {
+  const RspCodec::Impl order[] = {RspCodec::Impl::AVX2, RspCodec::Impl::SSE2,
+                                  RspCodec::Impl::SCALAR};
+  for (RspCodec::Impl impl : order) {
+    const Kernels *k = kernelsFor(impl);
+    if (k != nullptr)
+      return k;
+  }
+  return &scalarKernels;
+}
+
+//! The kernels in use, chosen on first use
+const Kernels *selected = nullptr;
+
+inline const Kernels *kernels() {
+  if (selected == nullptr)
+    selected = bestKernels();
+  return selected;
+}
+
+} // namespace
+
+bool RspCodec::isSupported(Impl impl) { return kernelsFor(impl) != nullptr; }
+
+bool RspCodec::setImpl(Impl impl) {
+  const Kernels *k = kernelsFor(impl);
+  if (k == nullptr)
+    return false;
+  selected = k;
+  return true;
+}
+
+RspCodec::Impl RspCodec::getImpl() { return kernels()->impl; }
+
+uint8_t RspCodec::checksum(const char *buf, std::size_t len) {
+  return kernels()->checksum(buf, len);
+}
+
+std::size_t RspCodec::findEscape(const char *buf, std::size_t len) {
+  return kernels()->findEscape(buf, len);
+}
+
+std::size_t RspCodec::escape(const char *src, std::size_t len, char *dest) {
+  std::size_t fromOffset = 0; // Offset to source char
+  std::size_t toOffset = 0;   // Offset to dest char
+
+  while (fromOffset < len) {
+    // Copy everything up to the next char needing escaping in one go
+    std::size_t run =
+        kernels()->findEscape(src + fromOffset, len - fromOffset);
+    memcpy(dest + toOffset, src + fromOffset, run);
+    fromOffset += run;
+    toOffset += run;
+
+    // Then the escaped char, if there is one
+    if (fromOffset < len) {
+      dest[toOffset++] = '}';
+      dest[toOffset++] = src[fromOffset++] ^ 0x20;
+    }
+  }
+
+  return toOffset;
+}
+
+std::size_t RspCodec::runLengthEncode(char *buf, std::size_t len) {
+  std::size_t fromOffset = 0; // Offset to source char
+  std::size_t toOffset = 0;   // Offset to dest char
+
+  while (fromOffset < len) {
+    char c = buf[fromOffset];
+
+    // Escape sequences are copied unchanged
+    if (('}' == c) && (fromOffset + 1 < len)) {
+      buf[toOffset++] = buf[fromOffset++];
+      buf[toOffset++] = buf[fromOffset++];
+      continue;
+    }
+
+    // Measure the run of this char
+    std::size_t run = 1;
+    while ((fromOffset + run < len) && (buf[fromOffset + run] == c))
+      run++;
+    fromOffset += run;
+
+    // Emit the char once, then encode as many of the repeats as possible.
+    buf[toOffset++] = c;
+    std::size_t repeats = run - 1;
+    while (repeats >= 3) {
+      std::size_t count = repeats < 97 ? repeats : 97;
+      if ((count == 6) || (count == 7))
+        count = 5; // Would give '#' or '$'
+      buf[toOffset++] = '*';
+      buf[toOffset++] = static_cast<char>(count + 29);
+      repeats -= count;
+    }
+
+    // Any left over are too few to be worth encoding
+    for (; repeats > 0; repeats--)
+      buf[toOffset++] = c;
+  }
+
+  return toOffset;
+}
+
+void RspCodec::bin2Hex(const uint8_t *src, std::size_t len, char *dest) {
+  kernels()->bin2Hex(src, len, dest);
+}
+
+bool RspCodec::hex2Bin(const char *src, std::size_t len, uint8_t *dest) {
+  return kernels()->hex2Bin(src, len, dest);
+}
@@ -0,0 +1,117 @@
+// RSP data encoding kernels: definition
+//
+// This file is part of the Embecosm GDB Server.
+//
+// Copyright (C) 2019 Embecosm Limited
+// SPDX-License-Identifier: GPL-3.0-or-later
+// ----------------------------------------------------------------------------
+
+#ifndef EMBDEBUG_RSP_CODEC_H
+#define EMBDEBUG_RSP_CODEC_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace EmbDebug {
+
+//! Bulk operations on RSP packet data.
+
+//! These are the loops which dominate the CPU cost of streaming large amounts
+//! of memory through the server. Each has a scalar implementation, and on x86
+//! SSE2 and AVX2 implementations, one of which is selected at run time
+//! according to what the host supports.
+
+namespace RspCodec {
+
+//! The available implementations of the kernels
+enum class Impl { SCALAR, SSE2, AVX2 };
+
+//! \brief Is an implementation supported on this host
+//!
+//! \param[in] impl  The implementation
+//! \return  True if the implementation was compiled in and the host CPU
+//!          supports it.
+bool isSupported(Impl impl);
+
+//! \brief Select the implementation to use
+//!
+//! By default the best supported implementation is used. This is mainly of
+//! use for testing and benchmarking.
+//!
+//! \param[in] impl  The implementation to use
+//! \return  True if the implementation is now in use, false if it is not
+//!          supported (in which case the implementation is unchanged).
+bool setImpl(Impl impl);
+
+//! \brief The implementation currently in use
+Impl getImpl();
+
+//! \brief Compute the RSP checksum of a buffer
+//!
+//! \param[in] buf  The data
+//! \param[in] len  The number of chars of data
+//! \return  The sum of the chars, modulo 256
+uint8_t checksum(const char *buf, std::size_t len);
+
+//! \brief Find the first char which needs escaping in RSP packet data
+//!
+//! The chars which need escaping are '$', '#', '*' and '}'.
+//!
+//! \param[in] buf  The data
+//! \param[in] len  The number of chars of data
+//! \return  The offset of the first char needing escaping, or \p len if
+//!          there are none.
+std::size_t findEscape(const char *buf, std::size_t len);
+
+//! \brief Escape RSP packet data
+//!
+//! '$', '#', '*' and '}' are escaped by preceding them by '}' and XORing
+//! them with 0x20.
+//!
+//! \param[in]  src   The data to escape
+//! \param[in]  len   The number of chars of data
+//! \param[out] dest  Buffer of at least 2 * \p len chars for the result
+//! \return  The number of chars of escaped data
+std::size_t escape(const char *src, std::size_t len, char *dest);
+
+//! \brief Run-length encode escaped RSP packet data in place
+//!
+//! A run of a repeated char is replaced by the char, '*' and a count char
+//! whose value is the number of additional repeats plus 29. Count chars must
+//! be printable, and may not be '#' or '$', so each encoding covers between
+//! 3 and 97 additional repeats, other than 6 or 7. Runs of fewer than 4
+//! chars are left alone, since they would not get shorter. Escape sequences
+//! are never encoded, since it is the escaped char which would be repeated.
+//!
+//! This has only a scalar implementation.
+//!
+//! \param[in,out] buf  The escaped data
+//! \param[in]     len  The number of chars of escaped data
+//! \return  The number of chars of encoded data
+std::size_t runLengthEncode(char *buf, std::size_t len);
+
+//! \brief Convert bytes to pairs of lower case hex digits
+//!
+//! The result is not null terminated.
+//!
+//! \param[in]  src   The bytes to convert
+//! \param[in]  len   The number of bytes
+//! \param[out] dest  Buffer of at least 2 * \p len chars for the result
+void bin2Hex(const uint8_t *src, std::size_t len, char *dest);
+
+//! \brief Convert pairs of hex digits to bytes
+//!
+//! Both upper and lower case digits are accepted.
+//!
+//! \param[in]  src   Buffer holding 2 * \p len hex digits
+//! \param[in]  len   The number of bytes to produce
+//! \param[out] dest  Buffer of at least \p len bytes for the result
+//! \return  True if all the digits were valid. If not, the contents of
+//!          \p dest are undefined.
+bool hex2Bin(const char *src, std::size_t len, uint8_t *dest);
+
+} // namespace RspCodec
+
+} // namespace EmbDebug
+
+#endif
@@ -61,10 +61,14 @@ private:
 
   bool writePort;
 
-  // Implementation specific routines to handle individual chars.
+  // Implementation specific routines to handle blocks of chars.
 
-  virtual bool putRspCharRaw(char c);
-  virtual int getRspCharRaw(bool blocking);
+  virtual bool putRspCharsRaw(const char *buf, std::size_t len);
+  virtual int getRspCharsRaw(char *buf, std::size_t len, bool blocking);
+
+#ifndef WIN32
+  virtual int getPollFd() { return clientFd; }
+#endif
 };
 
 } // namespace EmbDebug
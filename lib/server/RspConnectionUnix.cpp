@@ -151,6 +151,7 @@ bool RspConnection::rspConnect() {
 
   // Reset the initial connection state
   setNoAckMode(false);
+  discardInput();
 
   return true;
 }
@@ -171,26 +172,32 @@ void RspConnection::rspClose() {
 //! @return  TRUE if we are connected, FALSE otherwise
 bool RspConnection::isConnected() { return -1 != clientFd; }
 
-//! Put a single character out on the RSP connection
+//! Put a block of characters out on the RSP connection
 
 //! Utility routine. This should only be called if the client is open, but we
 //! check for safety.
 
-//! @param[in] c         The character to put out
+//! The OS may accept only part of the block, in which case we keep writing
+//! the remainder until all of it has been sent.
 
-//! @return  TRUE if char sent OK, FALSE if not (communications failure)
+//! @param[in] buf  The characters to put out
+//! @param[in] len  The number of characters to put out
 
-bool RspConnection::putRspCharRaw(char c) {
+//! @return  TRUE if all chars sent OK, FALSE if not (communications failure)
+
+bool RspConnection::putRspCharsRaw(const char *buf, std::size_t len) {
   if (-1 == clientFd) {
-    cerr << "Warning: Attempt to write '" << c
-         << "' to unopened RSP client: Ignored" << endl;
+    cerr << "Warning: Attempt to write " << len
+         << " chars to unopened RSP client: Ignored" << endl;
     return false;
   }
 
   // Write until successful (we retry after interrupts) or catastrophic
   // failure.
-  while (true) {
-    switch (write(clientFd, &c, sizeof(c))) {
+  while (len > 0) {
+    ssize_t count = write(clientFd, buf, len);
+
+    switch (count) {
     case -1:
       // Error: only allow interrupts or would block
       if ((EAGAIN != errno) && (EINTR != errno)) {
@@ -205,37 +212,47 @@ bool RspConnection::putRspCharRaw(char c) {
       break; // Nothing written! Try again
 
     default:
-      return true; // Success, we can return
+      // Partial or complete write, carry on with any remainder
+      buf += count;
+      len -= static_cast<std::size_t>(count);
+      break;
     }
   }
+
+  return true; // Success, we can return
 }
 
-//! Get a single character from the RSP connection
+//! Get a block of characters from the RSP connection
 
 //! Utility routine. This should only be called if the client is open, but we
 //! check for safety.
 
-//! @param[in] blocking  True if the read should block.
-//! @return  The character received or -1 on failure, or if the read would
-//!          block, and blocking is true.
+//! A single call to recv is made (retrying after interrupts), returning
+//! whatever is available up to the size of the buffer.
 
-int RspConnection::getRspCharRaw(bool blocking) {
+//! @param[out] buf       Buffer for the received characters.
+//! @param[in]  len       Maximum number of characters to receive.
+//! @param[in]  blocking  True if the read should block.
+//! @return  The number of characters received, 0 if the read would block
+//!          and blocking is false, or -1 on failure.
+
+int RspConnection::getRspCharsRaw(char *buf, std::size_t len, bool blocking) {
   if (-1 == clientFd) {
     cerr << "Warning: Attempt to read from "
          << "unopened RSP client: Ignored" << endl;
     return -1;
   }
 
-  // Blocking read until successful (we retry after interrupts) or
-  // catastrophic failure.
+  // Read until successful (we retry after interrupts) or catastrophic
+  // failure.
 
   for (;;) {
-    unsigned char c;
+    ssize_t count = recv(clientFd, buf, len, (blocking ? 0 : MSG_DONTWAIT));
 
-    switch (recv(clientFd, &c, sizeof(c), (blocking ? 0 : MSG_DONTWAIT))) {
+    switch (count) {
     case -1:
       if (!blocking && (errno == EAGAIN || errno == EWOULDBLOCK))
-        return -1;
+        return 0;
 
       // Error: only allow interrupts
 
@@ -250,7 +267,7 @@ int RspConnection::getRspCharRaw(bool blocking) {
       return -1;
 
     default:
-      return c & 0xff; // Success, we can return (no sign extend!)
+      return static_cast<int>(count); // Success, we can return
     }
   }
 }
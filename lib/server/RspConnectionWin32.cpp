@@ -160,6 +160,7 @@ bool RspConnection::rspConnect() {
 
   // Reset the initial connection state
   setNoAckMode(false);
+  discardInput();
 
   return true;
 }
@@ -184,42 +185,56 @@ void RspConnection::rspClose() {
 //! @return  TRUE if we are connected, FALSE otherwise
 bool RspConnection::isConnected() { return INVALID_SOCKET != clientSock; }
 
-//! Put a single character out on the RSP connection
+//! Put a block of characters out on the RSP connection
 
 //! Utility routine. This should only be called if the client is open, but we
 //! check for safety.
 
-//! @param[in] c         The character to put out
+//! The OS may accept only part of the block, in which case we keep sending
+//! the remainder until all of it has been sent.
 
-//! @return  TRUE if char sent OK, FALSE if not (communications failure)
+//! @param[in] buf  The characters to put out
+//! @param[in] len  The number of characters to put out
 
-bool RspConnection::putRspCharRaw(char c) {
+//! @return  TRUE if all chars sent OK, FALSE if not (communications failure)
+
+bool RspConnection::putRspCharsRaw(const char *buf, std::size_t len) {
   if (clientSock == INVALID_SOCKET) {
-    cerr << "Warning: Attempt to write '" << c
-         << "' to unopened RSP client: Ignored" << endl;
+    cerr << "Warning: Attempt to write " << len
+         << " chars to unopened RSP client: Ignored" << endl;
     return false;
   }
 
   // Attempt to write to the socket
-  if (send(clientSock, &c, sizeof(c), 0) == SOCKET_ERROR) {
-    cerr << "Warning: Failed to write to RSP Client: "
-         << "Closing client connection: " << WSAGetLastError() << endl;
-    rspClose();
-    return false;
+  while (len > 0) {
+    int count = send(clientSock, buf, static_cast<int>(len), 0);
+    if (count == SOCKET_ERROR) {
+      cerr << "Warning: Failed to write to RSP Client: "
+           << "Closing client connection: " << WSAGetLastError() << endl;
+      rspClose();
+      return false;
+    }
+    buf += count;
+    len -= static_cast<std::size_t>(count);
   }
   return true;
 }
 
-//! Get a single character from the RSP connection
+//! Get a block of characters from the RSP connection
 
 //! Utility routine. This should only be called if the client is open, but we
 //! check for safety.
 
-//! @param[in] blocking  True if the read should block.
-//! @return  The character received or -1 on failure, or if the read would
-//!          block, and blocking is true.
+//! A single call to recv is made, returning whatever is available up to the
+//! size of the buffer.
 
-int RspConnection::getRspCharRaw(bool blocking) {
+//! @param[out] buf       Buffer for the received characters.
+//! @param[in]  len       Maximum number of characters to receive.
+//! @param[in]  blocking  True if the read should block.
+//! @return  The number of characters received, 0 if the read would block
+//!          and blocking is false, or -1 on failure.
+
+int RspConnection::getRspCharsRaw(char *buf, std::size_t len, bool blocking) {
   if (!isConnected()) {
     cerr << "Warning: Attempt to read from "
          << "unopened RSP client: Ignored" << endl;
@@ -231,26 +246,18 @@ int RspConnection::getRspCharRaw(bool blocking) {
   if (ioctlsocket(clientSock, FIONBIO, &blockingMode))
     cerr << "Warning: Unable to set blocking mode of socket." << endl;
 
-  // Blocking read until successful (we retry after interrupts) or
-  // catastrophic failure.
-
-  while (true) {
-    char c;
-    switch (recv(clientSock, &c, sizeof(c), 0)) {
-    case SOCKET_ERROR:
-      // If non-blocking and no data, return -1
-      if (!blocking && WSAGetLastError() == WSAEWOULDBLOCK)
-        return -1;
-
-      cerr << "Warning: Failed to read from RSP client: " << WSAGetLastError()
-           << endl;
-      return -1;
-
-    case 0:
-      return -1;
-
-    default:
-      return c & 0xff; // Success, we can return (no sign extend!)
-    }
+  int count = recv(clientSock, buf, static_cast<int>(len), 0);
+  switch (count) {
+  case SOCKET_ERROR:
+    // If non-blocking and no data, return 0
+    if (!blocking && WSAGetLastError() == WSAEWOULDBLOCK)
+      return 0;
+    cerr << "Warning: Failed to read from RSP client: " << WSAGetLastError()
+         << endl;
+    return -1;
+  case 0:
+    return -1;
+  default:
+    return count;
   }
 }
@@ -7,12 +7,14 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 // ----------------------------------------------------------------------------
 
+#include <algorithm>
 #include <cerrno>
 #include <cstdio>
 #include <cstring>
 #include <iomanip>
 #include <iostream>
 
+#include "RspCodec.h"
 #include "RspPacket.h"
 #include "Utils.h"
 
@@ -27,42 +29,133 @@ using std::setw;
 using namespace EmbDebug;
 
 // Define the bufSize with its default value
-std::size_t RspPacket::bufSize = 10000;
+std::size_t RspPacket::bufSize = RspPacket::DEFAULT_MAX_PACKET_SIZE;
 
-//! Default constructor
-RspPacket::RspPacket()
-  : len (0) {
-  data = new char [bufSize];
-  ::memset(data, 0, bufSize);
+// The buffer pool is initially empty
+char *RspPacket::freeList = nullptr;
+std::size_t RspPacket::poolCount = 0;
+
+//! Set the maximum packet size
+
+//! Buffers already in the pool may be larger than now needed, so are freed.
+
+//! @param[in] _bufSize  The new maximum packet size
+void RspPacket::setMaxPacketSize(std::size_t _bufSize) {
+  while (freeList != nullptr) {
+    char *next;
+    ::memcpy(&next, freeList, sizeof(next));
+    delete[] freeList;
+    freeList = next;
+  }
+  poolCount = 0;
+  bufSize = _bufSize;
 }
 
-//! Copy constructor
-RspPacket::RspPacket(const RspPacket &other) {
-  data = new char [bufSize];
-  ::memcpy(data, other.data, bufSize);
-  len = other.len;
+//! Get a buffer of at least the given size
+
+//! The first buffer in the pool which is large enough is used. Only if there
+//! is none is a buffer allocated, with a power of two size.
+
+//! @param[in]  size  The number of chars required, excluding the terminating
+//!                   zero.
+//! @param[out] _cap  The number of chars the buffer may hold, excluding the
+//!                   terminating zero.
+//! @return  The buffer.
+char *RspPacket::acquireBuffer(std::size_t size, std::size_t &_cap) {
+  char **link = &freeList;
+  while (*link != nullptr) {
+    char *buf = *link;
+    ::memcpy(&_cap, buf + sizeof(char *), sizeof(_cap));
+    if (_cap >= size) {
+      ::memcpy(link, buf, sizeof(char *));
+      poolCount--;
+      return buf;
+    }
+    link = reinterpret_cast<char **>(buf);
+  }
+
+  std::size_t allocSize = MIN_BUF_SIZE;
+  while (allocSize < size + 1)
+    allocSize *= 2;
+  _cap = allocSize - 1;
+  return new char[allocSize];
+}
+
+//! Return a buffer to the pool
+
+//! Buffers are freed if the pool is full, or if they are larger than any
+//! packet now needs.
+
+//! @param[in] buf   The buffer to release
+//! @param[in] _cap  The capacity of the buffer when it was acquired.
+void RspPacket::releaseBuffer(char *buf, std::size_t _cap) {
+  if ((poolCount >= MAX_POOL_COUNT) || (_cap / 2 > bufSize)) {
+    delete[] buf;
+    return;
+  }
+  ::memcpy(buf, &freeList, sizeof(freeList));
+  ::memcpy(buf + sizeof(char *), &_cap, sizeof(_cap));
+  freeList = buf;
+  poolCount++;
+}
+
+//! Make sure an empty packet can hold at least size chars
+
+//! @param[in] size  The number of chars required.
+void RspPacket::reserve(std::size_t size) {
+  assert(len == 0 && "Can only reserve space in an empty packet");
+  if (size <= cap)
+    return;
+  if (ownsBuffer())
+    releaseBuffer(data, cap);
+  data = acquireBuffer(size, cap);
+  data[0] = '\0';
+}
+
+//! Default constructor
+RspPacket::RspPacket() : data(inlineData), len(0), cap(INLINE_SIZE) {
+  inlineData[0] = '\0';
 }
 
 //! Move constructor
-RspPacket::RspPacket(RspPacket &&other) {
-  data = std::move (other.data);
-  len = other.len;
-  other.data = nullptr;
-  other.len = 0;
+
+//! Pooled buffers change owner, inline data must be copied.
+RspPacket::RspPacket(RspPacket &&other) : RspPacket() {
+  *this = std::move(other);
+}
+
+//! Constructor from a builder, taking ownership of its buffer
+RspPacket::RspPacket(RspPacketBuilder &&builder)
+    : data(builder.data), len(builder.len), cap(builder.cap) {
+  if (data == nullptr) {
+    data = inlineData;
+    cap = INLINE_SIZE;
+  }
+  data[len] = '\0';
+  builder.data = nullptr;
+  builder.len = 0;
+  builder.cap = 0;
 }
 
-//! Constructor from a builder
-RspPacket::RspPacket(const RspPacketBuilder &builder) {
-  data = new char [bufSize];
-  ::memcpy(data, builder.data, bufSize);
-  len = builder.len;
+//! Constructor from a builder, copying its data
+RspPacket::RspPacket(const RspPacketBuilder &builder)
+    : RspPacket(builder.data, builder.len) {}
+
+//! Create packet from constant string
+RspPacket::RspPacket(const char *X) : RspPacket(X, ::strlen(X)) {}
+
+//! Create packet from constant char buffer
+RspPacket::RspPacket(const char *X, std::size_t _len) : RspPacket() {
+  reserve(_len);
+  ::memcpy(data, X, _len);
+  len = _len;
+  data[len] = '\0';
 }
 
 //! Destructor
 RspPacket::~RspPacket() {
-  if (data != nullptr)
-    delete [] data;
-  data = nullptr;
+  if (ownsBuffer())
+    releaseBuffer(data, cap);
 }
 
 //! Create a new packet from a const string as a hex encoded string for qRcmd.
@@ -83,15 +176,11 @@ RspPacket RspPacket::CreateHexStr(const char *str) {
     slen = bufSize / 2 - 1;
   }
 
-  // Construct the string the hard way
+  // Construct the string
+  response.reserve(slen * 2 + 1);
   response.data[0] = 'O';
-  for (std::size_t i = 0; i < slen; i++) {
-    int nybble_hi = str[i] >> 4;
-    int nybble_lo = str[i] & 0x0f;
-
-    response.data[i * 2 + 1] = nybble_hi + (nybble_hi > 9 ? 'a' - 10 : '0');
-    response.data[i * 2 + 2] = nybble_lo + (nybble_lo > 9 ? 'a' - 10 : '0');
-  }
+  RspCodec::bin2Hex(reinterpret_cast<const uint8_t *>(str), slen,
+                    &response.data[1]);
   response.len = slen * 2 + 1;
   response.data[response.len] = 0;
 
@@ -120,7 +209,8 @@ RspPacket RspPacket::CreateRcmdStr(const char *str, const bool toStdoutP) {
     slen = bufSize / 2 - 1;
   }
 
-  // Construct the string the hard way
+  // Construct the string
+  response.reserve(slen * 2 + 1);
   int offset;
   if (toStdoutP) {
     response.data[0] = 'O';
@@ -129,58 +219,124 @@ RspPacket RspPacket::CreateRcmdStr(const char *str, const bool toStdoutP) {
     offset = 0;
   }
 
-  for (unsigned int i = 0; i < slen; i++) {
-    uint8_t nybble_hi = str[i] >> 4;
-    uint8_t nybble_lo = str[i] & 0x0f;
-
-    response.data[i * 2 + offset + 0] =
-        static_cast<char>(nybble_hi + (nybble_hi > 9 ? 'a' - 10 : '0'));
-    response.data[i * 2 + offset + 1] =
-        static_cast<char>(nybble_lo + (nybble_lo > 9 ? 'a' - 10 : '0'));
-  }
+  RspCodec::bin2Hex(reinterpret_cast<const uint8_t *>(str), slen,
+                    &response.data[offset]);
   response.len = slen * 2 + offset;
   response.data[response.len] = 0;
 
   return response;
 }
 
+//! Create a packet which views data owned elsewhere
+
+//! Nothing is copied. The data must be zero terminated, and must not change
+//! or be freed while the packet is in use.
+
+//! @param[in] data  The packet data
+//! @param[in] _len  The number of chars of packet data
+RspPacket RspPacket::CreateView(const char *data, std::size_t _len) {
+  assert(data[_len] == '\0' && "Packet view data must be zero terminated");
+  RspPacket view;
+  view.data = const_cast<char *>(data);
+  view.len = _len;
+  view.cap = 0;
+  return view;
+}
+
 // Move operator
-RspPacket &
-RspPacket::operator=(RspPacket &&other) {
-  if (data != nullptr)
-    delete [] data;
-  data = std::move (other.data);
+RspPacket &RspPacket::operator=(RspPacket &&other) {
+  if (this == &other)
+    return *this;
+  if (ownsBuffer())
+    releaseBuffer(data, cap);
+
+  if (other.data == other.inlineData) {
+    data = inlineData;
+    cap = INLINE_SIZE;
+    ::memcpy(inlineData, other.inlineData, other.len + 1);
+  } else {
+    data = other.data;
+    cap = other.cap;
+  }
   len = other.len;
-  other.data = nullptr;
+
+  other.data = other.inlineData;
+  other.cap = INLINE_SIZE;
   other.len = 0;
+  other.inlineData[0] = '\0';
   return *this;
 }
 
 //! Create a packet from a printf-style call
 
+//! Short results are formatted directly into the inline data.
+
 //! @return a packet with the printf-formatted string
 RspPacket RspPacket::CreateFormatted(const char *format, ...) {
   RspPacket response;
   va_list args;
+  va_list args2;
   va_start(args, format);
-  response.len = vsnprintf(response.data, 10000, format, args);
+  va_copy(args2, args);
+  int res = vsnprintf(response.data, response.cap + 1, format, args);
   va_end(args);
+
+  if (res < 0) {
+    response.data[0] = '\0';
+    res = 0;
+  } else if (static_cast<std::size_t>(res) > response.cap) {
+    std::size_t size = std::min(static_cast<std::size_t>(res), bufSize);
+    response.reserve(size);
+    vsnprintf(response.data, size + 1, format, args2);
+    res = static_cast<int>(size);
+  }
+  va_end(args2);
+
+  response.len = static_cast<std::size_t>(res);
   return response;
 }
 
-//! Default constructor to allocate data buffer
-RspPacketBuilder::RspPacketBuilder () {
-  data = new char [RspPacket::getMaxPacketSize()];
-  ::memset(data, 0, RspPacket::getMaxPacketSize());
+//! Default constructor, taking a small data buffer from the pool
+RspPacketBuilder::RspPacketBuilder() {
+  data = RspPacket::acquireBuffer(RspPacket::MIN_BUF_SIZE - 1, cap);
 }
 
-//! Default constructor to free data buffer
-RspPacketBuilder::~RspPacketBuilder () {
+//! Destructor to return the data buffer to the pool
+RspPacketBuilder::~RspPacketBuilder() {
   if (data != nullptr)
-    delete [] data;
+    RspPacket::releaseBuffer(data, cap);
   data = nullptr;
 }
 
+//! Make sure the data buffer can hold at least size chars
+
+//! The buffer is at least doubled in size, so that building a packet a
+//! piece at a time does not copy it too often.
+
+//! @param[in] size  The number of chars required
+//! @return  TRUE if the buffer is large enough, FALSE if size is more than
+//!          the maximum packet size.
+bool RspPacketBuilder::grow(std::size_t size) {
+  if (size > getMaxPacketSize()) {
+    std::cerr << "Warning: RspPacketBuilder length exceeded, ignoring "
+              << EMBDEBUG_PRETTY_FUNCTION << std::endl;
+    return false;
+  }
+  if (size <= cap)
+    return true;
+
+  std::size_t newCap;
+  char *newData =
+      RspPacket::acquireBuffer(std::max(size, std::min(cap * 2,
+                                                       getMaxPacketSize())),
+                               newCap);
+  ::memcpy(newData, data, len);
+  RspPacket::releaseBuffer(data, cap);
+  data = newData;
+  cap = newCap;
+  return true;
+}
+
 //! Add a C string to the current packet
 RspPacketBuilder &RspPacketBuilder::operator+=(const char *str) {
   std::size_t _len = ::strlen(str);
@@ -190,11 +346,8 @@ RspPacketBuilder &RspPacketBuilder::operator+=(const char *str) {
 
 //! Add a char to the current packet
 RspPacketBuilder &RspPacketBuilder::operator+=(const char c) {
-  if (len == RspPacket::getMaxPacketSize()) {
-    std::cerr << "Warning: RspPacketBuilder length exceeded, ignoring "
-              << EMBDEBUG_PRETTY_FUNCTION << std::endl;
+  if (!grow(len + 1))
     return *this;
-  }
   data[len] = c;
   len++;
   return *this;
@@ -208,15 +361,20 @@ void RspPacketBuilder::addData(const char *str) {
 
 //! Add a byte buffer to the current packet
 void RspPacketBuilder::addData(const char *str, std::size_t _len) {
-  if ((len + _len) > RspPacket::getMaxPacketSize()) {
-    std::cerr << "Warning: RspPacketBuilder length exceeded, ignoring "
-              << EMBDEBUG_PRETTY_FUNCTION << std::endl;
+  if (!grow(len + _len))
     return;
-  }
   ::memcpy(&data[len], str, _len);
   len += _len;
 }
 
+//! Add bytes to the current packet as pairs of hex digits
+void RspPacketBuilder::addHex(const uint8_t *buf, std::size_t _len) {
+  if (!grow(len + _len * 2))
+    return;
+  RspCodec::bin2Hex(buf, _len, &data[len]);
+  len += _len * 2;
+}
+
 namespace EmbDebug {
 
 //! Output stream operator
@@ -12,6 +12,7 @@
 #include <cassert>
 #include <cstdarg>
 #include <cstddef>
+#include <cstdint>
 #include <iostream>
 
 #include "embdebug/ByteView.h"
@@ -23,36 +24,44 @@ class RspPacketBuilder;
 
 //! Class for RSP packets
 
-//! Can't be null terminated, since it may include zero bytes
+//! Can't be null terminated, since it may include zero bytes. However a
+//! terminating zero is always maintained one beyond the last char, so that
+//! the data may be handed to C string functions such as sscanf.
+
+//! Packets are move-only. Short packets (such as "OK" and register values)
+//! are held in inline storage, while longer packets borrow a buffer from a
+//! free list, returning it when destroyed. Buffers are sized to the packet
+//! (in powers of two), rather than to the maximum packet size, so a large
+//! maximum costs nothing unless large packets are actually used. Once the
+//! server has warmed up, sending and receiving packets does not touch the
+//! heap.
+
+//! A packet may also be a view of data owned by someone else, such as a
+//! packet received in place in a connection's receive buffer.
+
+//! @note The buffer pool is not thread safe.
 class RspPacket {
-public:
-  //! The data buffer. Allow direct access to avoid unnecessary copying.
+  // The builder shares the buffer pool, and a packet may take ownership of
+  // a builder's buffer.
+  friend class RspPacketBuilder;
 
+public:
   // Constructor and destructor
   RspPacket();
   RspPacket(RspPacket &&other);
-  RspPacket(const RspPacket &other);
+  RspPacket(const RspPacket &other) = delete;
   ~RspPacket();
-  RspPacket(const RspPacketBuilder &builder);
+  RspPacket(RspPacketBuilder &&builder);
+  explicit RspPacket(const RspPacketBuilder &builder);
 
   RspPacket &operator=(const RspPacket &other) = delete;
   RspPacket &operator=(RspPacket &&other);
 
   //! Create packet from constant string
-  RspPacket(const char *X) {
-    data = new char[bufSize];
-    ::memset(data, 0, bufSize);
-    len = ::strlen(X);
-    ::memcpy(data, X, len);
-  }
+  RspPacket(const char *X);
 
   //! Create packet from constant char buffer
-  RspPacket(const char *X, std::size_t _len) {
-    data = new char[bufSize];
-    ::memset(data, 0, bufSize);
-    len = _len;
-    ::memcpy(data, X, len);
-  }
+  RspPacket(const char *X, std::size_t _len);
 
   //! Create packet from printf-style call
   static RspPacket CreateFormatted(const char *format, ...);
@@ -63,10 +72,16 @@ public:
   //! Hex-encode packet from string
   static RspPacket CreateHexStr(const char *str);
 
+  //! Create packet viewing data owned elsewhere, which must be zero
+  //! terminated and outlive the packet.
+  static RspPacket CreateView(const char *data, std::size_t _len);
+
+  //! The default maximum packet size. This is large, so that bulk memory
+  //! transfers need few round trips, but may be reduced for slow transports.
+  static const std::size_t DEFAULT_MAX_PACKET_SIZE = 0x40000;
+
   // Accessors
-  static void setMaxPacketSize(std::size_t _bufSize) {
-    bufSize = _bufSize;
-  }
+  static void setMaxPacketSize(std::size_t _bufSize);
   static std::size_t getMaxPacketSize() { return bufSize; };
   std::size_t getLen() const { return len; };
 
@@ -77,20 +92,52 @@ public:
   ByteView getData() const { return ByteView(data, len); }
 
 private:
-  //! The data buffer size (the same for all, hence static)
+  //! Packets up to this size are held without using the buffer pool.
+  static const std::size_t INLINE_SIZE = 32;
+
+  //! The smallest buffer allocated for the pool
+  static const std::size_t MIN_BUF_SIZE = 256;
+
+  //! The most buffers kept in the pool. The server only has a few packets
+  //! in use at once, so this is ample.
+  static const std::size_t MAX_POOL_COUNT = 8;
+
+  //! The maximum packet size (the same for all, hence static)
   static std::size_t bufSize;
 
-  //! The data pointer
-  char* data;
+  //! Free list of pooled buffers. The link to the next buffer and the
+  //! capacity of the buffer are held in the first bytes of each buffer.
+  static char *freeList;
 
-  //! Number of chars in the data buffer (<= bufSize)
-  std::size_t len = 0;
+  //! Number of buffers in the free list
+  static std::size_t poolCount;
+
+  // Buffer management
+  static char *acquireBuffer(std::size_t size, std::size_t &_cap);
+  static void releaseBuffer(char *buf, std::size_t _cap);
+  void reserve(std::size_t size);
+  bool ownsBuffer() const { return data != inlineData && cap != 0; }
+
+  //! The data pointer, to inlineData, a pooled buffer or (for a view) data
+  //! owned elsewhere
+  char *data;
+
+  //! Number of chars in the data buffer (<= cap)
+  std::size_t len;
+
+  //! Number of chars which may be held in the data buffer, excluding the
+  //! terminating zero. Zero for a view.
+  std::size_t cap;
+
+  //! Inline storage for short packets
+  char inlineData[INLINE_SIZE + 1];
 };
 
 //! RspPacket Builder
 
 //! This provides a convenience mechanism for building up valid packets from a
-//! set of chars/c strings/byte arrays
+//! set of chars/c strings/byte arrays. The data buffer grows as required, up
+//! to the maximum packet size.
 class RspPacketBuilder {
   // RspPacket can see the builders data and length buffers for constructing a
   // packet from the builders current state.
@@ -98,32 +145,37 @@ class RspPacketBuilder {
 
   char *data;
   std::size_t len = 0;
+  std::size_t cap = 0;
+
+  bool grow(std::size_t size);
 
 public:
   // Constructor to allocate data array
   RspPacketBuilder();
   RspPacketBuilder(RspPacket &&other) = delete;
   RspPacketBuilder(const RspPacket &other) = delete;
+  RspPacketBuilder(const RspPacketBuilder &other) = delete;
   ~RspPacketBuilder();
 
+  RspPacketBuilder &operator=(const RspPacketBuilder &other) = delete;
+
   RspPacketBuilder &operator+=(const char *str);
   RspPacketBuilder &operator+=(const char c);
   void addData(const char *str);
   void addData(const char *str, std::size_t _len);
   void addData(const ByteView view) { addData(view.getData(), view.getLen()); }
+  void addHex(const uint8_t *buf, std::size_t _len);
 
   std::size_t getSize() const { return len; }
-  std::size_t getRemaining() const {
-    return RspPacket::getMaxPacketSize() - len;
-  }
+  std::size_t getRemaining() const { return getMaxPacketSize() - len; }
   std::size_t getMaxPacketSize() const {
     return RspPacket::getMaxPacketSize();
   }
 
-  void erase() {
-    ::memset(data, 0, RspPacket::getMaxPacketSize());
-    len = 0;
-  }
+  //! Access the data built so far. This is not zero terminated.
+  const char *getRawData() const { return data; }
+
+  void erase() { len = 0; }
 };
 
 //! Stream output
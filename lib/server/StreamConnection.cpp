@@ -94,20 +94,27 @@ void StreamConnection::rspClose() { mIsConnected = false; }
 //! @return  TRUE if we are connected, FALSE otherwise
 bool StreamConnection::isConnected() { return mIsConnected; }
 
-//! Put a single character out on the RSP connection
+//! Put a block of characters out on the RSP connection
 
 //! Utility routine. This should only be called if the client is open, but we
 //! check for safety.
 
-//! @param[in] c         The character to put out
+//! The OS may accept only part of the block, in which case we keep writing
+//! the remainder until all of it has been sent.
 
-//! @return  TRUE if char sent OK, FALSE if not (communications failure)
+//! @param[in] buf  The characters to put out
+//! @param[in] len  The number of characters to put out
 
-bool StreamConnection::putRspCharRaw(char c) {
+//! @return  TRUE if all chars sent OK, FALSE if not (communications failure)
+
+bool StreamConnection::putRspCharsRaw(const char *buf, std::size_t len) {
   // Write until successful (we retry after interrupts) or catastrophic
   // failure.
-  while (true) {
-    switch (_write(STDOUT_FILENO, &c, sizeof(c))) {
+  while (len > 0) {
+    ssize_t count =
+        _write(STDOUT_FILENO, buf, static_cast<unsigned int>(len));
+
+    switch (count) {
     case -1:
       // Error: only allow interrupts or would block
       if ((EAGAIN != errno) && (EINTR != errno)) {
@@ -122,26 +129,36 @@ bool StreamConnection::putRspCharRaw(char c) {
       break; // Nothing written! Try again
 
     default:
-      return true; // Success, we can return
+      // Partial or complete write, carry on with any remainder
+      buf += count;
+      len -= static_cast<std::size_t>(count);
+      break;
     }
   }
+
+  return true; // Success, we can return
 }
 
-//! Get a single character from the RSP connection
+//! Get a block of characters from the RSP connection
 
 //! Utility routine. This should only be called if the client is open, but we
 //! check for safety.
 
-//! @param[in] blocking  True if the read should block.
-//! @return  The character received or -1 on failure, or if the read would
-//!          block, and blocking is true.
+//! Once input is known to be available, a single read is made, returning
+//! whatever is available up to the size of the buffer.
+
+//! @param[out] buf       Buffer for the received characters.
+//! @param[in]  len       Maximum number of characters to receive.
+//! @param[in]  blocking  True if the read should block.
+//! @return  The number of characters received, 0 if the read would block
+//!          and blocking is false, or -1 on failure.
 
-int StreamConnection::getRspCharRaw(bool blocking) {
+int StreamConnection::getRspCharsRaw(char *buf, std::size_t len,
+                                     bool blocking) {
   // Blocking read until successful (we retry after interrupts) or
   // catastrophic failure.
 
   for (;;) {
-    unsigned char c;
     int res;
     struct timeval timeout;
     fd_set readfds;
@@ -167,20 +184,33 @@ int StreamConnection::getRspCharRaw(bool blocking) {
       break;
 
     case 0:
-      // Timeout, only happens in the blocking case.
-      return -1;
+      // Timeout, only happens in the non-blocking case.
+      return 0;
 
     default: {
       ssize_t count;
 
-      if ((count = _read(STDIN_FILENO, &c, sizeof(c))) == -1)
+      count = _read(STDIN_FILENO, buf, static_cast<unsigned int>(len));
+      if (count == -1)
         return -1;
 
       if (count == 0)
         return -1;
 
-      return c & 0xff; // Success, we can return (no sign extend!)
+      return static_cast<int>(count); // Success, we can return
     }
     }
   }
 }
+
+//! The file descriptor on which client input arrives
+
+//! @return  Standard input, or -1 on Windows, where it cannot be polled
+
+int StreamConnection::getPollFd() {
+#if _WIN32
+  return -1;
+#else
+  return STDIN_FILENO;
+#endif
+}
@@ -33,10 +33,11 @@ public:
   virtual bool isConnected();
 
 private:
-  // Implementation specific routines to handle individual chars.
+  // Implementation specific routines to handle blocks of chars.
 
-  virtual bool putRspCharRaw(char c);
-  virtual int getRspCharRaw(bool blocking);
+  virtual bool putRspCharsRaw(const char *buf, std::size_t len);
+  virtual int getRspCharsRaw(char *buf, std::size_t len, bool blocking);
+  virtual int getPollFd();
 
   // Track whether we are connected or not.
   bool mIsConnected;
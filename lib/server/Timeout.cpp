@@ -6,6 +6,9 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 // ----------------------------------------------------------------------------
 
+#include <cmath>
+#include <limits>
+
 #include "Timeout.h"
 
 using std::chrono::duration;
@@ -138,3 +141,34 @@ bool Timeout::timedOut(ITarget *cpu) const {
     abort();
   }
 }
+
+//! How long to sleep before the timeout must be checked again
+
+//! @return  The time in milliseconds, or -1 if there is no timeout.
+
+int Timeout::pollTimeout() const {
+  switch (mTimeoutType) {
+  case Type::NONE:
+    return -1;
+
+  case Type::REAL: {
+    std::chrono::duration<double, std::milli> remaining =
+        (mRealStamp + mRealTimeout) - std::chrono::system_clock::now();
+    if (remaining.count() <= 0)
+      return 0;
+    if (remaining.count() >= std::numeric_limits<int>::max())
+      return std::numeric_limits<int>::max();
+    // Round up, so as not to wake just before the timeout expires
+    return static_cast<int>(std::ceil(remaining.count()));
+  }
+
+  case Type::CYCLE:
+    return CYCLE_CHECK_PERIOD_MS;
+
+  default:
+
+    std::cerr << "*** ABORT: Impossible clock type in pollTimeout"
+              << std::endl;
+    abort();
+  }
+}
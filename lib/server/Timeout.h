@@ -52,8 +52,14 @@ public:
 
   void timeStamp(ITarget *cpu);
   bool timedOut(ITarget *cpu) const;
+  int pollTimeout() const;
 
 private:
+  //! How often (in milliseconds) a cycle count timeout is checked while
+  //! sleeping, since the time the cycles will take is not known.
+
+  static const int CYCLE_CHECK_PERIOD_MS = 100;
+
   //! An enumeration for the timeout type.
 
   enum class Type {
@@ -12,6 +12,7 @@
 #include <cstring>
 #include <iostream>
 
+#include "RspCodec.h"
 #include "Utils.h"
 
 using std::cout;
@@ -53,26 +54,21 @@ void Utils::regVal2Hex(uint64_t val, char *buf, std::size_t numBytes,
                        bool isLittleEndianP) {
   assert(buf);
   assert(numBytes <= sizeof(uint64_t));
+  uint8_t bytes[sizeof(uint64_t)];
+
   if (isLittleEndianP) {
     for (std::size_t n = 0; n < numBytes; n++) {
-      unsigned char byte = val & 0xff;
-
-      buf[n * 2] = hex2Char((byte >> 4) & 0xf);
-      buf[n * 2 + 1] = hex2Char(byte & 0xf);
-
+      bytes[n] = val & 0xff;
       val = val / 256;
     }
   } else {
     for (std::size_t n = numBytes; n-- > 0;) {
-      unsigned char byte = val & 0xff;
-
-      buf[n * 2] = hex2Char((byte >> 4) & 0xf);
-      buf[n * 2 + 1] = hex2Char(byte & 0xf);
-
+      bytes[n] = val & 0xff;
       val = val / 256;
     }
   }
 
+  RspCodec::bin2Hex(bytes, numBytes, buf);
   buf[numBytes * 2] = '\0'; // Useful to terminate as string
 }
 
@@ -80,19 +76,19 @@ uint64_t Utils::hex2RegVal(const char *buf, std::size_t numBytes,
                            bool isLittleEndianP) {
   assert(buf);
   assert(numBytes <= sizeof(uint64_t));
-  assert(isHexStr(buf, numBytes));
+  uint8_t bytes[sizeof(uint64_t)];
   uint64_t val = 0; // The result
 
+  bool valid = RspCodec::hex2Bin(buf, numBytes, bytes);
+  assert(valid && "Register value is not a hex string");
+  (void)valid;
+
   if (isLittleEndianP) {
-    for (std::size_t n = numBytes; n-- > 0;) {
-      val = (val << 4) | char2Hex(buf[n * 2]);
-      val = (val << 4) | char2Hex(buf[n * 2 + 1]);
-    }
+    for (std::size_t n = numBytes; n-- > 0;)
+      val = (val << 8) | bytes[n];
   } else {
-    for (std::size_t n = 0; n < numBytes; n++) {
-      val = (val << 4) | char2Hex(buf[n * 2]);
-      val = (val << 4) | char2Hex(buf[n * 2 + 1]);
-    }
+    for (std::size_t n = 0; n < numBytes; n++)
+      val = (val << 8) | bytes[n];
   }
 
   return val;
@@ -135,47 +131,48 @@ uint64_t Utils::hex2Val(const char *buf, std::size_t len) {
 }
 
 void Utils::ascii2Hex(char *dest, const char *src) {
-  int i;
+  std::size_t len = strlen(src);
 
-  // Step through converting the source string
-  for (i = 0; src[i] != '\0'; i++) {
-    char ch = src[i];
-
-    dest[i * 2] = hex2Char(ch >> 4 & 0xf);
-    dest[i * 2 + 1] = hex2Char(ch & 0xf);
-  }
-
-  dest[i * 2] = '\0';
+  RspCodec::bin2Hex(reinterpret_cast<const uint8_t *>(src), len, dest);
+  dest[len * 2] = '\0';
 }
 
 void Utils::hex2Ascii(char *dest, const char *src) {
-  int i;
-
-  // Step through convering the source hex digit pairs
-  for (i = 0; src[i * 2] != '\0' && src[i * 2 + 1] != '\0'; i++) {
-    assert(isHexStr(&src[i * 2], 2));
-    dest[i] =
-        ((char2Hex(src[i * 2]) & 0xf) << 4) | (char2Hex(src[i * 2 + 1]) & 0xf);
-  }
-
-  dest[i] = '\0';
+  // Only complete pairs of hex digits are converted
+  std::size_t len = strlen(src) / 2;
+
+  bool valid =
+      RspCodec::hex2Bin(src, len, reinterpret_cast<uint8_t *>(dest));
+  assert(valid && "ASCII string is not hex encoded");
+  (void)valid;
+  dest[len] = '\0';
 }
 
 std::size_t Utils::rspUnescape(char *buf, std::size_t len) {
+  return rspUnescape(buf, len, reinterpret_cast<uint8_t *>(buf));
+}
+
+std::size_t Utils::rspUnescape(const char *src, std::size_t len,
+                               uint8_t *dest) {
   std::size_t fromOffset = 0; // Offset to source char
   std::size_t toOffset = 0;   // Offset to dest char
 
   while (fromOffset < len) {
-    // Is it escaped
-    if ('}' == buf[fromOffset]) {
-      fromOffset++;
-      buf[toOffset] = buf[fromOffset] ^ 0x20;
+    // Copy everything up to the next escape char in one go
+    const char *esc = static_cast<const char *>(
+        memchr(&src[fromOffset], '}', len - fromOffset));
+    std::size_t run = (esc == nullptr ? len : esc - src) - fromOffset;
+    memmove(&dest[toOffset], &src[fromOffset], run);
+    fromOffset += run;
+    toOffset += run;
+
+    // Then the escaped char, if there is one
+    if (fromOffset + 1 < len) {
+      dest[toOffset++] = static_cast<uint8_t>(src[fromOffset + 1] ^ 0x20);
+      fromOffset += 2;
     } else {
-      buf[toOffset] = buf[fromOffset];
+      fromOffset = len;
     }
-
-    fromOffset++;
-    toOffset++;
   }
 
   return toOffset;
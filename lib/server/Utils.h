@@ -132,6 +132,17 @@ void hex2Ascii(char *dest, const char *src);
 //! \return  The number of bytes AFTER conversion
 std::size_t rspUnescape(char *buf, std::size_t len);
 
+//! \brief "Unescape" RSP binary data into a separate buffer
+//!
+//! As above, but the source is left untouched and the result written to
+//! \p dest, which may be the same as \p src.
+//!
+//! \param[in]  src   The array of bytes to convert
+//! \param[in]  len   The number of bytes to be converted
+//! \param[out] dest  Buffer of at least \p len bytes for the result
+//! \return  The number of bytes AFTER conversion
+std::size_t rspUnescape(const char *src, std::size_t len, uint8_t *dest);
+
 //! \brief Split a string into delimited tokens
 //!
 //! \param[in]  s      The string of tokes
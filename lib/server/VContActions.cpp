@@ -10,6 +10,8 @@
 #include "Utils.h"
 
 #include <cassert>
+#include <cctype>
+#include <cstdlib>
 #include <cstring>
 #include <string>
 #include <vector>
@@ -51,8 +53,13 @@ bool VContActions::parse(const char *str) {
       }
     }
 
-    // Store the details into the actions vector.
+    // A range step must have a valid range.
     std::string action = *it;
+    uint_addr_t start, end;
+    if ((action[0] == 'r') && !parseRange(action, start, end))
+      return false;
+
+    // Store the details into the actions vector.
     mActions.push_back(std::make_pair(action, ptid));
   }
 
@@ -104,3 +111,41 @@ char VContActions::getCoreAction(unsigned int num) const {
 
   return '\0';
 }
+
+// Return in START and END the range of core NUM's 'r' action.  Return false
+// if the action applied to core NUM is not a range step.
+
+bool VContActions::getCoreRange(unsigned int num, uint_addr_t &start,
+                                uint_addr_t &end) const {
+  for (auto it = mActions.begin(); it != mActions.end(); ++it) {
+    unsigned int pid = it->second.pid();
+
+    assert(pid != 0);
+    if ((pid == ((unsigned int)-1)) || pid == num)
+      return (it->first[0] == 'r') && parseRange(it->first, start, end);
+  }
+
+  return false;
+}
+
+// Parse the range of an 'r' action in ACTION, which has the form
+// 'rSTART,END' optionally followed by ':' and a thread id.  The addresses
+// are in hex.  Return true if the range is valid.
+
+bool VContActions::parseRange(const std::string &action, uint_addr_t &start,
+                              uint_addr_t &end) {
+  const char *str = action.c_str() + 1;
+  char *endp;
+
+  if (!isxdigit(static_cast<unsigned char>(*str)))
+    return false;
+  start = strtoull(str, &endp, 16);
+  if (*endp != ',')
+    return false;
+
+  str = endp + 1;
+  if (!isxdigit(static_cast<unsigned char>(*str)))
+    return false;
+  end = strtoull(str, &endp, 16);
+  return (*endp == '\0') || (*endp == ':');
+}
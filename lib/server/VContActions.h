@@ -10,7 +10,9 @@
 #define VCONT_ACTIONS_H
 
 #include "Ptid.h"
+#include "embdebug/Types.h"
 
+#include <string>
 #include <vector>
 
 namespace EmbDebug {
@@ -29,11 +31,17 @@ public:
   // Return true if the vCont packet effected more than one core.
   bool effectsMultipleCores(void) const;
 
-  // Return the action letter 'c', 'C', 's', or 'S' that is applied to core
-  // NUM.  If/when we want to support signals in the future this interface
-  // will need to be expanded.
+  // Return the action letter 'c', 'C', 's', 'S' or 'r' that is applied to
+  // core NUM.  If/when we want to support signals in the future this
+  // interface will need to be expanded.
   char getCoreAction(unsigned int num) const;
 
+  // Return in START and END the range of addresses that core NUM is to
+  // step within, when its action is 'r'.  Return false if it has no
+  // range.
+  bool getCoreRange(unsigned int num, uint_addr_t &start,
+                    uint_addr_t &end) const;
+
 private:
   // Delete alternative constructors.
   VContActions() = delete;
@@ -43,6 +51,10 @@ private:
   // otherwise return false.
   bool parse(const char *str);
 
+  // Parse the range of an 'r' action.
+  static bool parseRange(const std::string &action, uint_addr_t &start,
+                         uint_addr_t &end);
+
   // Is this object valid.
   bool mValid;
 
@@ -0,0 +1,139 @@
+// GDB wait budget: definition
+//
+// This file is part of the Embecosm GDB Server.
+//
+// Copyright (C) 2019 Embecosm Limited
+// SPDX-License-Identifier: GPL-3.0-or-later
+// ----------------------------------------------------------------------------
+
+#include "WaitBudget.h"
+
+using std::chrono::duration;
+
+using namespace EmbDebug;
+
+//! Constructor
+
+//! The budget starts with the default maximum interrupt latency, and a
+//! modest number of instructions.
+
+WaitBudget::WaitBudget()
+    : mMaxLatency(std::chrono::milliseconds(
+          static_cast<int>(DEFAULT_MAX_LATENCY_MS))),
+      mInstructions(INITIAL_INSTRUCTIONS), mSupported(true), mSent(false),
+      mLastTimedOut(false), mOverhead(duration<double>::zero()),
+      mStartInstructions(0) {}
+
+//! Destructor
+
+WaitBudget::~WaitBudget() {}
+
+//! Get the maximum interrupt latency
+
+//! @return  The maximum interrupt latency
+
+duration<double> WaitBudget::maxLatency() const { return mMaxLatency; }
+
+//! Set the maximum interrupt latency
+
+//! @param[in] maxLatency  The maximum interrupt latency
+
+void WaitBudget::maxLatency(const duration<double> maxLatency) {
+  mMaxLatency = maxLatency;
+  mSent = false;
+}
+
+//! Get the number of instructions the target may run in one wait
+
+//! @return  The number of instructions
+
+uint64_t WaitBudget::instructions() const { return mInstructions; }
+
+//! Note the start of a wait
+
+//! Gives the target the budget if it has changed. The time since the last
+//! wait is the overhead of checking for a break, if that wait returned
+//! TIMEOUT.
+
+//! @param[in] cpu  The CPU which is about to wait
+
+void WaitBudget::startWait(ITarget *cpu) {
+  if (!mSupported)
+    return;
+
+  Clock::time_point now = Clock::now();
+  mOverhead = mLastTimedOut ? now - mEnd : duration<double>::zero();
+
+  if (!mSent) {
+    mSupported = cpu->setWaitBudget(mInstructions, mMaxLatency);
+    mSent = true;
+    if (!mSupported)
+      return;
+  }
+
+  mStartInstructions = cpu->getInstrCount();
+  mStart = now;
+}
+
+//! Note the end of a wait
+
+//! A wait which returned TIMEOUT, following one which did too, ran for its
+//! budget between two checks for a break, so the budget is adapted to it.
+
+//! @param[in] cpu       The CPU which waited
+//! @param[in] timedOut  TRUE if the wait returned TIMEOUT
+
+void WaitBudget::endWait(ITarget *cpu, bool timedOut) {
+  if (!mSupported)
+    return;
+
+  Clock::time_point now = Clock::now();
+  if (timedOut && (mOverhead > duration<double>::zero()))
+    adapt(cpu->getInstrCount() - mStartInstructions, now - mStart, mOverhead);
+
+  mLastTimedOut = timedOut;
+  mEnd = now;
+}
+
+//! Adapt the budget to a measured wait
+
+//! The target should run OVERHEAD_RATIO times as long as the server takes
+//! between waits, but no longer than the maximum interrupt latency. The
+//! number of instructions which would take that long at the measured rate
+//! becomes the new budget, changing by at most a factor of MAX_STEP at a
+//! time.
+
+//! @param[in] instructions  The number of instructions run
+//! @param[in] runTime       The time spent in wait()
+//! @param[in] overhead      The time spent between this wait and the last
+
+void WaitBudget::adapt(uint64_t instructions, duration<double> runTime,
+                       duration<double> overhead) {
+  if ((instructions == 0) || (runTime <= duration<double>::zero()))
+    return;
+
+  duration<double> wantedTime = overhead * static_cast<double>(OVERHEAD_RATIO);
+  if (wantedTime > mMaxLatency)
+    wantedTime = mMaxLatency;
+
+  double wanted = static_cast<double>(instructions) * (wantedTime / runTime);
+  double lo = static_cast<double>(mInstructions / MAX_STEP);
+  double hi = static_cast<double>(mInstructions) * MAX_STEP;
+  if (wanted < lo)
+    wanted = lo;
+  else if (wanted > hi)
+    wanted = hi;
+
+  uint64_t budget;
+  if (wanted < MIN_INSTRUCTIONS)
+    budget = MIN_INSTRUCTIONS;
+  else if (wanted > MAX_INSTRUCTIONS)
+    budget = MAX_INSTRUCTIONS;
+  else
+    budget = static_cast<uint64_t>(wanted);
+
+  if (budget != mInstructions) {
+    mInstructions = budget;
+    mSent = false;
+  }
+}
@@ -0,0 +1,124 @@
+// GDB wait budget: declaration
+//
+// This file is part of the Embecosm GDB Server.
+//
+// Copyright (C) 2019 Embecosm Limited
+// SPDX-License-Identifier: GPL-3.0-or-later
+// ----------------------------------------------------------------------------
+
+#ifndef EMBDEBUG_WAIT_BUDGET_H
+#define EMBDEBUG_WAIT_BUDGET_H
+
+#include <chrono>
+#include <cstdint>
+
+#include "embdebug/ITarget.h"
+
+namespace EmbDebug {
+
+//! Class representing how long the target may run in each call to wait()
+
+//! While the target runs, the server checks for a break from the client
+//! each time wait() returns TIMEOUT. A target which returns too often
+//! spends its time in those checks, and one which returns too rarely is slow
+//! to respond to a break.
+
+//! The budget is given to the target as a number of instructions and a
+//! wall clock time, whichever runs out first. The time is the maximum
+//! interrupt latency, set by the client. The number of instructions is
+//! adapted to how fast the target runs and how long each check takes, so
+//! that the target runs for long enough that checking costs little, but no
+//! longer.
+
+//! If the target does not take a budget, nothing is measured.
+
+class WaitBudget {
+public:
+  // Constructor and destructor
+
+  WaitBudget();
+  ~WaitBudget();
+
+  // Accessors
+
+  std::chrono::duration<double> maxLatency() const;
+  void maxLatency(const std::chrono::duration<double> maxLatency);
+  uint64_t instructions() const;
+
+  // Measure each wait
+
+  void startWait(ITarget *cpu);
+  void endWait(ITarget *cpu, bool timedOut);
+
+  // Adapt the budget to a measured wait
+
+  void adapt(uint64_t instructions, std::chrono::duration<double> runTime,
+             std::chrono::duration<double> overhead);
+
+private:
+  //! The clock used for measurements
+
+  typedef std::chrono::steady_clock Clock;
+
+  //! Default maximum interrupt latency in milliseconds
+
+  static const int DEFAULT_MAX_LATENCY_MS = 100;
+
+  //! Number of instructions run in the first wait, before anything has been
+  //! measured
+
+  static const uint64_t INITIAL_INSTRUCTIONS = 10000;
+
+  //! Limits on the number of instructions run in one wait
+
+  static const uint64_t MIN_INSTRUCTIONS = 100;
+  static const uint64_t MAX_INSTRUCTIONS = 1000000000;
+
+  //! How many times longer the target should run than the server takes to
+  //! check for a break between waits
+
+  static const int OVERHEAD_RATIO = 100;
+
+  //! Largest factor by which the budget changes after one wait, so that one
+  //! unusual measurement does not upset it
+
+  static const uint64_t MAX_STEP = 4;
+
+  //! Maximum interrupt latency
+
+  std::chrono::duration<double> mMaxLatency;
+
+  //! Number of instructions the target may run in one wait
+
+  uint64_t mInstructions;
+
+  //! Whether the target takes a budget. Assumed until it says otherwise.
+
+  bool mSupported;
+
+  //! Whether the target has been given the current budget
+
+  bool mSent;
+
+  //! Whether the last wait returned TIMEOUT, so that the time since it
+  //! ended was spent checking for a break
+
+  bool mLastTimedOut;
+
+  //! When the last wait started and ended
+
+  Clock::time_point mStart;
+  Clock::time_point mEnd;
+
+  //! How long the server took between the last two waits
+
+  std::chrono::duration<double> mOverhead;
+
+  //! Instruction count when the last wait started
+
+  uint64_t mStartInstructions;
+};
+
+} // namespace EmbDebug
+
+#endif
@@ -13,6 +13,155 @@
 
 using namespace EmbDebug;
 
+//! Default implementation of finding a register with a role
+
+//! @return  -1, since no such registers are known
+
+int ITarget::getRegisterNumber(const RegisterRole role EMBDEBUG_ATTR_UNUSED)
+    const {
+  return -1;
+}
+
+//! Default implementation of getting the registers to send with stops
+
+//! @param[out] regs  The registers, which is left empty
+
+void ITarget::getExpeditedRegisters(std::vector<int> &regs) const {
+  regs.clear();
+}
+
+//! Default implementation of reading a range of registers
+
+//! @param[in]  firstReg  The first register to read
+//! @param[in]  count     The number of registers to read
+//! @param[out] values    The values read
+//! @param[out] sizes     The sizes of the registers read
+//! @return  The number of registers read
+
+int ITarget::readRegisters(const int firstReg, const int count,
+                           uint_reg_t *values, std::size_t *sizes) {
+  for (int i = 0; i < count; i++)
+    sizes[i] = readRegister(firstReg + i, values[i]);
+  return count;
+}
+
+//! Default implementation of writing a range of registers
+
+//! @param[in]  firstReg  The first register to write
+//! @param[in]  count     The number of registers to write
+//! @param[in]  values    The values to write
+//! @param[out] sizes     The sizes of the registers written
+//! @return  The number of registers written
+
+int ITarget::writeRegisters(const int firstReg, const int count,
+                            const uint_reg_t *values, std::size_t *sizes) {
+  for (int i = 0; i < count; i++)
+    sizes[i] = writeRegister(firstReg + i, values[i]);
+  return count;
+}
+
+//! Default implementation of reading several ranges of memory
+
+//! @param[in]  ranges  The ranges to read
+//! @param[in]  count   The number of ranges
+//! @param[out] buffer  The data read from each range in turn
+//! @return  The total number of bytes read
+
+std::size_t ITarget::readv(const MemoryRange *ranges, const std::size_t count,
+                           uint8_t *buffer) {
+  std::size_t total = 0;
+  for (std::size_t i = 0; i < count; i++) {
+    std::size_t done = read(ranges[i].addr, buffer + total, ranges[i].size);
+    total += done;
+    if (done != ranges[i].size)
+      break;
+  }
+  return total;
+}
+
+//! Default implementation of writing several ranges of memory
+
+//! @param[in] ranges  The ranges to write
+//! @param[in] count   The number of ranges
+//! @param[in] buffer  The data to write to each range in turn
+//! @return  The total number of bytes written
+
+std::size_t ITarget::writev(const MemoryRange *ranges, const std::size_t count,
+                            const uint8_t *buffer) {
+  std::size_t total = 0;
+  for (std::size_t i = 0; i < count; i++) {
+    std::size_t done = write(ranges[i].addr, buffer + total, ranges[i].size);
+    total += done;
+    if (done != ranges[i].size)
+      break;
+  }
+  return total;
+}
+
+//! Default implementation of checking whether memory may be cached
+
+//! @param[in] addr  The start of the range
+//! @param[in] size  The size of the range
+//! @return  FALSE, since by default reading memory the client did not ask
+//!          for may have side effects
+
+bool ITarget::isCacheable(const uint_addr_t addr EMBDEBUG_ATTR_UNUSED,
+                          const std::size_t size EMBDEBUG_ATTR_UNUSED) const {
+  return false;
+}
+
+//! Default implementation of setting a range to step within
+
+//! @param[in] start  The first address of the range
+//! @param[in] end    The address just after the range
+//! @return  FALSE, since by default the server steps through the range
+
+bool ITarget::setStepRange(const uint_addr_t start EMBDEBUG_ATTR_UNUSED,
+                           const uint_addr_t end EMBDEBUG_ATTR_UNUSED) {
+  return false;
+}
+
+//! Default implementation of getting the stop event file descriptor
+
+//! @return  -1, since by default wait() is polled for stop events
+
+int ITarget::getEventFd() { return -1; }
+
+//! Default implementation of interrupting wait()
+
+//! Does nothing, so the client is served when wait() next returns.
+
+void ITarget::interruptWait() {}
+
+//! Default implementation of setting the wait budget
+
+//! @param[in] instructions  The number of instructions to run
+//! @param[in] time          The longest time to run
+//! @return  FALSE, since by default the target chooses its own quantum
+
+bool ITarget::setWaitBudget(
+    const uint64_t instructions EMBDEBUG_ATTR_UNUSED,
+    const std::chrono::duration<double> time EMBDEBUG_ATTR_UNUSED) {
+  return false;
+}
+
+//! Default implementation of selecting non-stop mode
+
+//! @param[in] enable  TRUE to select non-stop mode
+//! @return  TRUE only if all-stop mode was selected, since by default cores
+//!          cannot run independently
+
+bool ITarget::setNonStop(const bool enable) { return !enable; }
+
+//! Default implementation of halting one core
+
+//! @param[in] index  The index of the CPU to halt
+//! @return  FALSE, since by default cores cannot be halted independently
+
+bool ITarget::haltCpu(const unsigned int index EMBDEBUG_ATTR_UNUSED) {
+  return false;
+}
+
 namespace EmbDebug {
 
 //! Output operator for ResumeType enumeration
@@ -34,6 +183,9 @@ std::ostream &operator<<(std::ostream &s, ITarget::ResumeType p) {
   case ITarget::ResumeType::NONE:
     name = "none";
     break;
+  case ITarget::ResumeType::RANGE_STEP:
+    name = "range step";
+    break;
   default:
     name = "unknown";
     break;
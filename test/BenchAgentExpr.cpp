@@ -0,0 +1,96 @@
+// Microbenchmark of agent expression evaluation
+//
+// This file is part of the Embecosm GDB Server.
+//
+// Copyright (C) 2019 Embecosm Limited
+// SPDX-License-Identifier: GPL-3.0-or-later
+// ----------------------------------------------------------------------------
+
+// Reports the number of evaluations per second of some typical breakpoint
+// conditions. Registers and memory are served from arrays, so the time is
+// that of the evaluator alone.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "AgentExpr.h"
+
+using namespace EmbDebug;
+
+class BenchContext : public AgentExpr::Context {
+public:
+  BenchContext() {
+    for (std::size_t i = 0; i < sizeof(mMem); i++)
+      mMem[i] = static_cast<uint8_t>(i);
+  }
+
+  bool readRegister(int reg, uint_reg_t &value) override {
+    if ((reg < 0) || (reg >= 32))
+      return false;
+    value = static_cast<uint_reg_t>(reg);
+    return true;
+  }
+
+  bool readMemory(uint_addr_t addr, uint8_t *buf, std::size_t size) override {
+    if ((addr >= sizeof(mMem)) || (size > sizeof(mMem) - addr))
+      return false;
+    ::memcpy(buf, &mMem[addr], size);
+    return true;
+  }
+
+  void output(const std::string &text) override {
+    std::fputs(text.c_str(), stdout);
+  }
+
+private:
+  uint8_t mMem[256];
+};
+
+struct Bench {
+  const char *name;
+  const char *hex;
+};
+
+static const Bench benches[] = {
+    // $x5 == 7
+    {"register compare", "26000522071327"},
+    // *(int *)($sp + 16) < 100
+    {"memory compare", "26000222100219162022641427"},
+    // Count down from 10
+    {"loop", "220a" "28" "200007" "27" "2201" "03" "210002"},
+};
+
+int main(int argc, char **argv) {
+  long iterations = (argc > 1) ? std::atol(argv[1]) : 10000000;
+  BenchContext ctx;
+
+  for (const Bench &bench : benches) {
+    AgentExpr expr;
+    if (!expr.parse(bench.hex, ::strlen(bench.hex) / 2)) {
+      std::fprintf(stderr, "%s: invalid bytecode\n", bench.name);
+      return EXIT_FAILURE;
+    }
+
+    uint64_t sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < iterations; i++) {
+      uint64_t result;
+      if (!expr.evaluate(ctx, result)) {
+        std::fprintf(stderr, "%s: evaluation failed\n", bench.name);
+        return EXIT_FAILURE;
+      }
+      sum += result;
+    }
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    std::printf("%-20s %12.0f evaluations/s (result sum %llu)\n", bench.name,
+                static_cast<double>(iterations) / elapsed.count(),
+                static_cast<unsigned long long>(sum));
+  }
+
+  return EXIT_SUCCESS;
+}
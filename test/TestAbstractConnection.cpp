@@ -1,4 +1,15 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
 #include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
 
 #include "embdebug/Compat.h"
 
@@ -18,7 +29,8 @@ using namespace EmbDebug;
 class TestConnection : public AbstractConnection {
 public:
   TestConnection(TraceFlags *traceFlags)
-      : AbstractConnection(traceFlags), _pos(0), _buf(nullptr) {}
+      : AbstractConnection(traceFlags), _pos(0), _buf(nullptr), _writes(0),
+        _pollFd(-1) {}
   virtual ~TestConnection() override {}
 
   virtual bool rspConnect() override { return true; }
@@ -29,21 +41,36 @@ public:
     _buf = buf;
     _pos = 0;
   }
+  const std::string &getOutBuf() const { return _out; }
+  int getWriteCount() const { return _writes; }
+  void setPollFd(int fd) { _pollFd = fd; }
 
 protected:
-  virtual bool putRspCharRaw(char c EMBDEBUG_ATTR_UNUSED) override { /* TBC */
+  virtual bool putRspCharsRaw(const char *buf, std::size_t len) override {
+    _out.append(buf, len);
+    _writes++;
     return true;
   }
-  virtual int getRspCharRaw(bool blocking EMBDEBUG_ATTR_UNUSED) override {
-    if (_buf)
-      return _buf[_pos++];
-    else
+  virtual int getRspCharsRaw(char *buf, std::size_t len,
+                            bool blocking) override {
+    if (!_buf)
       throw std::runtime_error("Buffer accessed before being set");
+
+    std::size_t count = 0;
+    while (count < len && _buf[_pos] != '\0')
+      buf[count++] = _buf[_pos++];
+    if (count == 0 && blocking)
+      throw std::runtime_error("Ran out of input");
+    return static_cast<int>(count);
   }
+  virtual int getPollFd() override { return _pollFd; }
 
 private:
   size_t _pos;
   const char *_buf;
+  std::string _out;
+  int _writes;
+  int _pollFd;
 };
 
 class AbstractConnectionTest : public ::testing::TestWithParam<std::string> {
@@ -88,6 +115,27 @@ TEST_P(AbstractConnectionTest, BadChecksum) {
 }
 */
 
+TEST_P(AbstractConnectionTest, BreakBeforePkt) {
+  std::string buf = "\x03" + GetParam();
+  tc->setBuf(buf.c_str());
+  EXPECT_TRUE(tc->haveBreak());
+  EXPECT_FALSE(tc->haveBreak());
+  bool success;
+  std::tie(success, *pkt) = tc->getPkt();
+  EXPECT_TRUE(success);
+  EXPECT_EQ(packetData(GetParam()), pkt->getRawData());
+}
+
+TEST_P(AbstractConnectionTest, NoBreakBeforePkt) {
+  std::string buf = GetParam();
+  tc->setBuf(buf.c_str());
+  EXPECT_FALSE(tc->haveBreak());
+  bool success;
+  std::tie(success, *pkt) = tc->getPkt();
+  EXPECT_TRUE(success);
+  EXPECT_EQ(packetData(buf), pkt->getRawData());
+}
+
 // FIXME: Presently disabled, causes a segfault due to bad read of buffer.
 TEST_P(AbstractConnectionTest, DISABLED_BufferOverrun) {
   std::string buf = GetParam();
@@ -98,15 +146,197 @@ TEST_P(AbstractConnectionTest, DISABLED_BufferOverrun) {
   EXPECT_FALSE(success);
 }
 
-// PutPkt test is a work in progress.
-/*
 TEST_P(AbstractConnectionTest, PutPkt) {
-  std::string inbuf = GetParam();
-  const char* outbuf = calloc(sizeof(const char*) * 32);
-  tc->setBuf(outbuf);
-  EXPECT
-  free(outbuf);
-}*/
+  std::string frame = GetParam();
+  std::string data = packetData(frame);
+  tc->setBuf("+");
+  EXPECT_TRUE(tc->putPkt(RspPacket(data.c_str(), data.size())));
+  EXPECT_EQ(frame, tc->getOutBuf());
+  EXPECT_EQ(1, tc->getWriteCount());
+}
+
+TEST_P(AbstractConnectionTest, PutPktResend) {
+  std::string frame = GetParam();
+  std::string data = packetData(frame);
+  tc->setBuf("-+");
+  EXPECT_TRUE(tc->putPkt(RspPacket(data.c_str(), data.size())));
+  EXPECT_EQ(frame + frame, tc->getOutBuf());
+  EXPECT_EQ(2, tc->getWriteCount());
+}
+
+TEST(AbstractConnectionEscapeTest, PutPktEscaped) {
+  TraceFlags flags;
+  TestConnection tc(&flags);
+  tc.setBuf("+");
+  EXPECT_TRUE(tc.putPkt(RspPacket("a$b#c*d}")));
+  EXPECT_EQ("$a}\x04" "b}\x03" "c}\x0a" "d}]#ec", tc.getOutBuf());
+  EXPECT_EQ(1, tc.getWriteCount());
+}
+
+TEST(AbstractConnectionEscapeTest, PutPktRunLengthEncoded) {
+  TraceFlags flags;
+  TestConnection tc(&flags);
+  tc.setRunLengthEncoding(true);
+  tc.setBuf("+");
+  EXPECT_TRUE(tc.putPkt(RspPacket("00000000$$$$$$")));
+  EXPECT_EQ("$0*\"00}\x04}\x04}\x04}\x04}\x04}\x04#e2", tc.getOutBuf());
+}
+
+// Compare the bytes sent for typical replies with and without run-length
+// encoding.
+static std::size_t framedSize(const std::string &data, bool rle) {
+  TraceFlags flags;
+  TestConnection tc(&flags);
+  tc.setRunLengthEncoding(rle);
+  tc.setBuf("+");
+  EXPECT_TRUE(tc.putPkt(RspPacket(data.c_str(), data.size())));
+  return tc.getOutBuf().size();
+}
+
+TEST(AbstractConnectionRunLengthTest, BytesSaved) {
+  // A mostly zero 32 register g reply, a 1KiB zero filled m reply and a 1KiB
+  // m reply of code.
+  std::string regs = std::string(32 * 8, '0');
+  regs.replace(8, 8, "0000b0ff");
+  regs.replace(16, 8, "f0ff3f00");
+  std::string code;
+  for (int i = 0; i < 128; i++)
+    code += "9307000013050500";
+
+  const struct {
+    const char *name;
+    std::string data;
+  } replies[] = {{"g", regs},
+                 {"m bss", std::string(2048, '0')},
+                 {"m code", code}};
+
+  for (const auto &reply : replies) {
+    std::size_t plain = framedSize(reply.data, false);
+    std::size_t encoded = framedSize(reply.data, true);
+    std::cout << reply.name << ": " << plain << " bytes, " << encoded
+              << " bytes run-length encoded" << std::endl;
+    EXPECT_LE(encoded, plain);
+  }
+
+  EXPECT_LT(framedSize(regs, true) * 4, framedSize(regs, false));
+  EXPECT_LT(framedSize(std::string(2048, '0'), true) * 20,
+            framedSize(std::string(2048, '0'), false));
+}
+
+// Packets arriving back to back are parsed in place in the receive buffer,
+// so some of them will wrap around its end.
+TEST(AbstractConnectionStreamTest, GetPktStream) {
+  TraceFlags flags;
+  TestConnection tc(&flags);
+  std::string in;
+  std::vector<std::string> datas;
+  for (int n = 0; n < 200; n++) {
+    std::string data = "X" + std::to_string(n) + ":" +
+                       std::string(997 + n, static_cast<char>('a' + n % 26));
+    unsigned char checksum = 0;
+    for (char c : data)
+      checksum += static_cast<unsigned char>(c);
+    char trailer[4];
+    snprintf(trailer, sizeof(trailer), "#%02x", checksum);
+    in += "$" + data + trailer;
+    datas.push_back(data);
+  }
+  tc.setBuf(in.c_str());
+
+  for (const std::string &data : datas) {
+    bool success;
+    RspPacket pkt;
+    std::tie(success, pkt) = tc.getPkt();
+    ASSERT_TRUE(success);
+    EXPECT_EQ(data.size(), pkt.getLen());
+    EXPECT_EQ(data, pkt.getRawData());
+  }
+}
+
+// A '$' in the middle of a packet starts it again.
+TEST(AbstractConnectionStreamTest, GetPktRestart) {
+  TraceFlags flags;
+  TestConnection tc(&flags);
+  tc.setBuf("$qOff$qOffsets#4b");
+  bool success;
+  RspPacket pkt;
+  std::tie(success, pkt) = tc.getPkt();
+  EXPECT_TRUE(success);
+  EXPECT_EQ(std::string("qOffsets"), pkt.getRawData());
+}
+
+#ifndef _WIN32
+// The server sleeps until the target signals an event or the client sends
+// something, but never while input is already buffered.
+TEST(AbstractConnectionWaitTest, WaitForInput) {
+  TraceFlags flags;
+  TestConnection tc(&flags);
+  int clientPipe[2];
+  int eventPipe[2];
+  ASSERT_EQ(0, pipe(clientPipe));
+  ASSERT_EQ(0, pipe(eventPipe));
+  tc.setPollFd(clientPipe[0]);
+
+  auto start = std::chrono::steady_clock::now();
+  tc.waitForInput(eventPipe[0], 50);
+  EXPECT_GE(std::chrono::steady_clock::now() - start,
+            std::chrono::milliseconds(50));
+
+  ASSERT_EQ(1, write(eventPipe[1], "x", 1));
+  tc.waitForInput(eventPipe[0], -1);
+
+  char c;
+  ASSERT_EQ(1, read(eventPipe[0], &c, 1));
+  ASSERT_EQ(1, write(clientPipe[1], "+", 1));
+  tc.waitForInput(eventPipe[0], -1);
+
+  // The client's input is now buffered, so is not seen by poll
+  ASSERT_EQ(1, read(clientPipe[0], &c, 1));
+  tc.setBuf("+");
+  EXPECT_FALSE(tc.haveBreak());
+  tc.waitForInput(eventPipe[0], -1);
+
+  for (int fd : {clientPipe[0], clientPipe[1], eventPipe[0], eventPipe[1]})
+    close(fd);
+}
+
+// The watcher calls back as soon as the client sends anything, and until
+// then the connection is known to be quiet without being read.
+TEST(AbstractConnectionWaitTest, Watch) {
+  TraceFlags flags;
+  TestConnection tc(&flags);
+  int clientPipe[2];
+  ASSERT_EQ(0, pipe(clientPipe));
+  tc.setPollFd(clientPipe[0]);
+
+  std::atomic<int> calls(0);
+  ASSERT_TRUE(tc.startWatch([&calls]() { calls++; }));
+  EXPECT_TRUE(tc.startWatch([&calls]() { calls += 100; }));
+  EXPECT_FALSE(tc.haveBreak());
+  EXPECT_FALSE(tc.havePkt());
+
+  ASSERT_EQ(1, write(clientPipe[1], "\x03", 1));
+  auto start = std::chrono::steady_clock::now();
+  while ((calls == 0) &&
+         (std::chrono::steady_clock::now() - start < std::chrono::seconds(5)))
+    std::this_thread::yield();
+  EXPECT_EQ(1, calls);
+
+  tc.setBuf("\x03");
+  EXPECT_TRUE(tc.haveBreak());
+  tc.stopWatch();
+
+  // Stopping a watcher which has seen nothing does not call back
+  char c;
+  ASSERT_EQ(1, read(clientPipe[0], &c, 1));
+  ASSERT_TRUE(tc.startWatch([&calls]() { calls++; }));
+  tc.stopWatch();
+  EXPECT_EQ(1, calls);
+
+  for (int fd : clientPipe)
+    close(fd);
+}
+#endif
 
 INSTANTIATE_TEST_CASE_P(SimplePackets, AbstractConnectionTest,
                         ::testing::Values("$Hc-1#09", "$qOffsets#4b", "$p20#d2",
@@ -0,0 +1,256 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "AgentExpr.h"
+
+#include "gtest/gtest.h"
+
+using namespace EmbDebug;
+
+// Four registers, holding their number times 0x10, 16 bytes of memory at
+// 0x1000, holding their offset, and the string "hello" at 0x2000. Output is
+// collected.
+class TestContext : public AgentExpr::Context {
+public:
+  bool readRegister(int reg, uint_reg_t &value) override {
+    if ((reg < 0) || (reg >= 4))
+      return false;
+    value = static_cast<uint_reg_t>(reg) * 0x10;
+    return true;
+  }
+
+  bool readMemory(uint_addr_t addr, uint8_t *buf, std::size_t size) override {
+    static const char str[] = "hello";
+    if ((addr >= 0x2000) && (addr + size <= 0x2000 + sizeof(str))) {
+      ::memcpy(buf, &str[addr - 0x2000], size);
+      return true;
+    }
+    if ((addr < 0x1000) || (addr + size > 0x1010))
+      return false;
+    for (std::size_t i = 0; i < size; i++)
+      buf[i] = static_cast<uint8_t>(addr - 0x1000 + i);
+    return true;
+  }
+
+  void output(const std::string &text) override { mOutput += text; }
+
+  std::string mOutput;
+};
+
+// Parse and evaluate an expression given as hex
+static bool eval(const std::string &hex, uint64_t &result) {
+  AgentExpr expr;
+  TestContext ctx;
+  return expr.parse(hex.c_str(), hex.size() / 2) &&
+         expr.evaluate(ctx, result);
+}
+
+static uint64_t evalOk(const std::string &hex) {
+  uint64_t result = 0xdeadbeef;
+  EXPECT_TRUE(eval(hex, result)) << hex;
+  return result;
+}
+
+static bool parses(const std::string &hex) {
+  AgentExpr expr;
+  return expr.parse(hex.c_str(), hex.size() / 2);
+}
+
+TEST(AgentExpr, Constants) {
+  EXPECT_EQ(0x80u, evalOk("228027"));
+  EXPECT_EQ(0x1234u, evalOk("23123427"));
+  EXPECT_EQ(0x89abcdefu, evalOk("2489abcdef27"));
+  EXPECT_EQ(0x0123456789abcdefu, evalOk("250123456789abcdef27"));
+}
+
+TEST(AgentExpr, Arithmetic) {
+  EXPECT_EQ(5u, evalOk("220222030227"));
+  EXPECT_EQ(static_cast<uint64_t>(-1), evalOk("220222030327"));
+  EXPECT_EQ(6u, evalOk("220222030427"));
+  EXPECT_EQ(static_cast<uint64_t>(-3), evalOk("220322060327"));
+}
+
+TEST(AgentExpr, Division) {
+  // -7 / 2 and -7 % 2, sign extended from 8 bits
+  EXPECT_EQ(static_cast<uint64_t>(-3), evalOk("22f9160822020527"));
+  EXPECT_EQ(static_cast<uint64_t>(-1), evalOk("22f9160822020727"));
+  EXPECT_EQ(0x7cu, evalOk("22f922020627"));
+  EXPECT_EQ(1u, evalOk("22f922020827"));
+
+  uint64_t result;
+  EXPECT_FALSE(eval("220722000527", result));
+  EXPECT_FALSE(eval("220722000827", result));
+}
+
+TEST(AgentExpr, Shifts) {
+  EXPECT_EQ(0x10u, evalOk("220122040927"));
+  EXPECT_EQ(0u, evalOk("220122400927"));
+  EXPECT_EQ(static_cast<uint64_t>(-1), evalOk("22801608220a0a27"));
+  EXPECT_EQ(static_cast<uint64_t>(-1), evalOk("22801608227f0a27"));
+  EXPECT_EQ(0x08u, evalOk("228022040b27"));
+}
+
+TEST(AgentExpr, Logic) {
+  EXPECT_EQ(1u, evalOk("22000e27"));
+  EXPECT_EQ(0u, evalOk("22050e27"));
+  EXPECT_EQ(0x0cu, evalOk("220c220f0f27"));
+  EXPECT_EQ(0x0fu, evalOk("220c22031027"));
+  EXPECT_EQ(0x05u, evalOk("220c22091127"));
+  EXPECT_EQ(~static_cast<uint64_t>(0), evalOk("22001227"));
+}
+
+TEST(AgentExpr, Comparisons) {
+  EXPECT_EQ(1u, evalOk("220522051327"));
+  EXPECT_EQ(0u, evalOk("220522061327"));
+  // -1 < 1 signed, but not unsigned
+  EXPECT_EQ(1u, evalOk("22ff160822011427"));
+  EXPECT_EQ(0u, evalOk("22ff160822011527"));
+}
+
+TEST(AgentExpr, Extension) {
+  EXPECT_EQ(static_cast<uint64_t>(-2), evalOk("22fe160827"));
+  EXPECT_EQ(0x7eu, evalOk("227e160827"));
+  EXPECT_EQ(0x0fu, evalOk("22ff2a0427"));
+  EXPECT_EQ(0xffu, evalOk("22ff2a4027"));
+  EXPECT_FALSE(parses("22ff2a0027"));
+  EXPECT_FALSE(parses("22ff164127"));
+}
+
+TEST(AgentExpr, Registers) {
+  EXPECT_EQ(0x30u, evalOk("26000327"));
+
+  uint64_t result;
+  EXPECT_FALSE(eval("26000427", result));
+}
+
+TEST(AgentExpr, Memory) {
+  EXPECT_EQ(0x04u, evalOk("2310041727"));
+  EXPECT_EQ(0x0504u, evalOk("2310041827"));
+  EXPECT_EQ(0x07060504u, evalOk("2310041927"));
+  EXPECT_EQ(0x0f0e0d0c0b0a0908u, evalOk("2310081a27"));
+
+  uint64_t result;
+  EXPECT_FALSE(eval("23100c1a27", result));
+}
+
+TEST(AgentExpr, Stack) {
+  EXPECT_EQ(2u, evalOk("2201280227"));
+  EXPECT_EQ(1u, evalOk("220122022927"));
+  EXPECT_EQ(1u, evalOk("220122022b27"));
+  EXPECT_EQ(1u, evalOk("220122022203320227"));
+  // a b c => c a b
+  EXPECT_EQ(2u, evalOk("2201220222033327"));
+  EXPECT_EQ(1u, evalOk("220122022203332927"));
+}
+
+TEST(AgentExpr, Jumps) {
+  // if (1) 5 else 6
+  EXPECT_EQ(5u, evalOk("2201200008" "2206" "27" "2205" "27"));
+  EXPECT_EQ(6u, evalOk("2200200008" "2206" "27" "2205" "27"));
+  // Count down from 3 to 0
+  EXPECT_EQ(0u, evalOk("2203" "28" "20000727" "2201" "03" "210002"));
+}
+
+TEST(AgentExpr, InvalidBytecode) {
+  // Not hex, unsupported opcodes, missing operand, jump into an operand
+  EXPECT_FALSE(parses("zz"));
+  EXPECT_FALSE(parses("01"));
+  EXPECT_FALSE(parses("0c"));
+  EXPECT_FALSE(parses("2c0000"));
+  EXPECT_FALSE(parses("23ff"));
+  EXPECT_FALSE(parses("21000127"));
+  EXPECT_FALSE(parses("21000927"));
+}
+
+// The stack must be used the same way however an instruction is reached.
+TEST(AgentExpr, StackChecking) {
+  // Underflow
+  EXPECT_FALSE(parses("0227"));
+  EXPECT_FALSE(parses("2b27"));
+  EXPECT_FALSE(parses("2201320127"));
+  // Running off the end
+  EXPECT_FALSE(parses("2201"));
+  EXPECT_FALSE(parses("220120000327"));
+  // Growing in a loop
+  EXPECT_FALSE(parses("2201" "28" "210002"));
+  // Different depths after a jump
+  EXPECT_FALSE(parses("2201" "20000c" "2202" "2203" "21000e" "2204" "27"));
+  // Overflow
+  std::string deep;
+  for (int i = 0; i < 65; i++)
+    deep += "2201";
+  EXPECT_FALSE(parses(deep + "27"));
+  EXPECT_TRUE(parses(deep.substr(4) + "27"));
+}
+
+TEST(AgentExpr, EvaluationErrors) {
+  uint64_t result;
+  // Loops forever
+  EXPECT_FALSE(eval("210000", result));
+
+  AgentExpr empty;
+  TestContext ctx;
+  EXPECT_FALSE(empty.evaluate(ctx, result));
+}
+
+// The printf bytecode for a format and number of arguments. The arguments,
+// channel and function must already be pushed.
+static std::string printfHex(const std::string &fmt, unsigned nargs) {
+  char buf[16];
+  std::snprintf(buf, sizeof(buf), "34%02x%04x", nargs,
+                static_cast<unsigned>(fmt.size() + 1));
+  std::string hex = buf;
+  for (char c : fmt) {
+    std::snprintf(buf, sizeof(buf), "%02x", static_cast<uint8_t>(c));
+    hex += buf;
+  }
+  return hex + "00";
+}
+
+// Evaluate a printf, returning its output
+static std::string printfOk(const std::string &args, const std::string &fmt,
+                            unsigned nargs) {
+  std::string hex = args + "2200" "2200" + printfHex(fmt, nargs) + "27";
+  AgentExpr expr;
+  TestContext ctx;
+  uint64_t result;
+  EXPECT_TRUE(expr.parse(hex.c_str(), hex.size() / 2)) << hex;
+  EXPECT_TRUE(expr.evaluate(ctx, result)) << hex;
+  return ctx.mOutput;
+}
+
+TEST(AgentExpr, Printf) {
+  EXPECT_EQ("x=-5\n", printfOk("22fb1608", "x=%d\n", 1));
+  EXPECT_EQ("251", printfOk("22fb", "%u", 1));
+  EXPECT_EQ("100%", printfOk("2264", "%d%%", 1));
+  EXPECT_EQ("[   2a|0x2a]", printfOk("222a" "222a", "[%5x|%#x]", 2));
+  // Arguments are pushed last first
+  EXPECT_EQ("A hello", printfOk("232000" "2241", "%c %s", 2));
+  EXPECT_EQ("ffffffff", printfOk("22ff1608", "%x", 1));
+  EXPECT_EQ("ffffffffffffffff", printfOk("22ff1608", "%llx", 1));
+  EXPECT_EQ("no args", printfOk("", "no args", 0));
+}
+
+TEST(AgentExpr, PrintfErrors) {
+  // Wrong number of arguments, floating point, missing terminator, too few
+  // values on the stack
+  EXPECT_FALSE(parses("2201" "2200" "2200" + printfHex("%d %d", 1) + "27"));
+  EXPECT_FALSE(parses("2201" "2200" "2200" + printfHex("%f", 1) + "27"));
+  EXPECT_FALSE(parses("2200" "2200" "3400000268692700"));
+  EXPECT_FALSE(parses("2200" + printfHex("%d", 1) + "27"));
+
+  // Huge field width or precision
+  EXPECT_FALSE(
+      parses("2201" "2200" "2200" + printfHex("%999999999d", 1) + "27"));
+  EXPECT_FALSE(parses("2201" "2200" "2200" + printfHex("%.257d", 1) + "27"));
+  EXPECT_TRUE(parses("2201" "2200" "2200" + printfHex("%256.256d", 1) + "27"));
+
+  // Unreadable string
+  std::string hex = "2230" "2200" "2200" + printfHex("%s", 1) + "27";
+  AgentExpr expr;
+  TestContext ctx;
+  uint64_t result;
+  ASSERT_TRUE(expr.parse(hex.c_str(), hex.size() / 2));
+  EXPECT_FALSE(expr.evaluate(ctx, result));
+}
@@ -0,0 +1,196 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+#include "AbstractConnection.h"
+#include "GdbServer.h"
+#include "RspPacket.h"
+#include "StubTarget.h"
+#include "TraceFlags.h"
+#include "embdebug/Compat.h"
+#include "embdebug/ITarget.h"
+
+#include "gtest/gtest.h"
+
+using namespace EmbDebug;
+
+// Count heap allocations while enabled, by replacing the global allocation
+// functions for this test program.
+
+static bool countAllocations = false;
+static std::size_t allocationCount = 0;
+
+static void *countedAlloc(std::size_t size) {
+  if (countAllocations)
+    allocationCount++;
+  void *p = std::malloc(size == 0 ? 1 : size);
+  if (p == nullptr)
+    throw std::bad_alloc();
+  return p;
+}
+
+void *operator new(std::size_t size) { return countedAlloc(size); }
+void *operator new[](std::size_t size) { return countedAlloc(size); }
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+
+// A connection which replays a fixed input stream. Output is appended to a
+// buffer reserved up front, so that recording it does not allocate.
+class ReplayConnection : public AbstractConnection {
+public:
+  ReplayConnection(TraceFlags *traceFlags)
+      : AbstractConnection(traceFlags), mInBuf(), mInBufPos(0), mOutBuf() {
+    mOutBuf.reserve(65536);
+  }
+  ~ReplayConnection() override {}
+
+  bool rspConnect() override { return true; }
+  void rspClose() override {}
+  bool isConnected() override { return true; }
+
+  void setInBuf(const std::string &buf) {
+    mInBuf = buf;
+    mInBufPos = 0;
+    mOutBuf.clear();
+  }
+  const std::string &getOutBuf() const { return mOutBuf; }
+
+protected:
+  bool putRspCharsRaw(const char *buf, std::size_t len) override {
+    mOutBuf.append(buf, len);
+    return true;
+  }
+  int getRspCharsRaw(char *buf, std::size_t len,
+                     bool EMBDEBUG_ATTR_UNUSED blocking) override {
+    if (mInBufPos == mInBuf.size())
+      throw std::runtime_error("Ran out of RSP input");
+
+    std::size_t count = std::min(len, mInBuf.size() - mInBufPos);
+    ::memcpy(buf, mInBuf.data() + mInBufPos, count);
+    mInBufPos += count;
+    return static_cast<int>(count);
+  }
+
+private:
+  std::string mInBuf;
+  std::size_t mInBufPos;
+  std::string mOutBuf;
+};
+
+// A single core target with some registers and memory.
+class MemoryTarget : public StubTarget {
+public:
+  static const int REG_COUNT = 32;
+  static const std::size_t MEM_SIZE = 4096;
+
+  MemoryTarget(const TraceFlags *traceFlags) : StubTarget(traceFlags) {
+    ::memset(mRegs, 0, sizeof(mRegs));
+    ::memset(mMem, 0, sizeof(mMem));
+  }
+
+  unsigned int getCpuCount() override { return 1; }
+  int getRegisterCount() const override { return REG_COUNT; }
+  int getRegisterSize() const override { return 4; }
+
+  std::size_t readRegister(const int reg, uint_reg_t &value) override {
+    value = mRegs[reg];
+    return 4;
+  }
+  std::size_t writeRegister(const int reg, const uint_reg_t value) override {
+    mRegs[reg] = value;
+    return 4;
+  }
+  std::size_t read(const uint_addr_t addr, uint8_t *buffer,
+                   const std::size_t size) override {
+    if (addr + size > MEM_SIZE)
+      return 0;
+    ::memcpy(buffer, &mMem[addr], size);
+    return size;
+  }
+  std::size_t write(const uint_addr_t addr, const uint8_t *buffer,
+                    const std::size_t size) override {
+    if (addr + size > MEM_SIZE)
+      return 0;
+    ::memcpy(&mMem[addr], buffer, size);
+    return size;
+  }
+
+private:
+  uint_reg_t mRegs[REG_COUNT];
+  uint8_t mMem[MEM_SIZE];
+};
+
+// Expose the request handler, so that a single request can be serviced.
+class RequestServer : public GdbServer {
+public:
+  RequestServer(AbstractConnection *conn, ITarget *cpu, TraceFlags *flags)
+      : GdbServer(conn, cpu, flags, EXIT_ON_KILL) {}
+
+  void serveRequest() { rspClientRequest(); }
+};
+
+// Frame a packet, followed by an acknowledgement of the reply.
+static std::string framePacket(const std::string &data) {
+  unsigned char checksum = 0;
+  for (char c : data)
+    checksum += static_cast<unsigned char>(c);
+  char trailer[5];
+  snprintf(trailer, sizeof(trailer), "#%02x+", checksum);
+  return "$" + data + trailer;
+}
+
+class AllocationTest : public ::testing::TestWithParam<std::string> {
+protected:
+  void SetUp() override {
+    flags = new TraceFlags();
+    conn = new ReplayConnection(flags);
+    target = new MemoryTarget(flags);
+    server = new RequestServer(conn, target, flags);
+  }
+  void TearDown() override {
+    countAllocations = false;
+    delete server;
+    delete target;
+    delete conn;
+    delete flags;
+  }
+
+  // Service one request, returning the number of allocations made while
+  // doing so.
+  std::size_t serve(const std::string &request) {
+    conn->setInBuf(request);
+    allocationCount = 0;
+    countAllocations = true;
+    server->serveRequest();
+    countAllocations = false;
+    return allocationCount;
+  }
+
+  TraceFlags *flags;
+  ReplayConnection *conn;
+  MemoryTarget *target;
+  RequestServer *server;
+};
+
+// Once the first request has warmed up the packet buffer pool and scratch
+// buffers, repeating a request should not touch the heap.
+TEST_P(AllocationTest, SteadyStateIsAllocationFree) {
+  std::string request = framePacket(GetParam());
+
+  serve(request);
+  for (int i = 0; i < 3; i++) {
+    EXPECT_EQ(0u, serve(request)) << "Request: " << GetParam();
+    EXPECT_EQ(0u, conn->getOutBuf().find("+$"));
+    EXPECT_NE(0u, conn->getOutBuf().find("+$E"));
+  }
+}
+
+INSTANTIATE_TEST_CASE_P(
+    SteadyState, AllocationTest,
+    ::testing::Values("m100,40", "m0,400", "x100,40", "M100,4:01020304",
+                      "X100,4:abcd",
+                      "g",
+                      "G" + std::string(MemoryTarget::REG_COUNT * 8, '5'),
+                      "p5", "P5=01000000"));
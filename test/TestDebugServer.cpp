@@ -14,7 +14,7 @@ using namespace EmbDebug;
 class TraceConnection : public AbstractConnection {
 public:
   TraceConnection(TraceFlags *traceFlags)
-      : AbstractConnection(traceFlags), mInBuf(), mInBufPos(mInBuf.end()),
+      : AbstractConnection(traceFlags), mInBursts(), mBurst(0), mBurstPos(0),
         mOutBuf() {}
   ~TraceConnection() override {}
 
@@ -22,27 +22,44 @@ public:
   void rspClose() override {}
   bool isConnected() override { return true; }
 
-  void setInBuf(std::string buf) {
-    mInBuf = buf;
-    mInBufPos = mInBuf.begin();
+  void setInBuf(std::string buf) { setInBursts({buf}); }
+
+  // Input which arrives in bursts. Once a burst is used up, a non-blocking
+  // read finds nothing, and a blocking read starts on the next burst.
+  void setInBursts(const std::vector<std::string> &bursts) {
+    mInBursts = bursts;
+    mBurst = 0;
+    mBurstPos = 0;
   }
   std::string getOutBuf() { return mOutBuf; }
 
 protected:
-  bool putRspCharRaw(char c) override {
-    mOutBuf.push_back(c);
+  bool putRspCharsRaw(const char *buf, std::size_t len) override {
+    mOutBuf.append(buf, len);
     return true;
   }
-  int getRspCharRaw(bool EMBDEBUG_ATTR_UNUSED blocking) override {
-    if (mInBufPos == mInBuf.end())
+  int getRspCharsRaw(char *buf, std::size_t len, bool blocking) override {
+    while ((mBurst < mInBursts.size()) &&
+           (mBurstPos == mInBursts[mBurst].size())) {
+      if (!blocking)
+        return 0;
+      mBurst++;
+      mBurstPos = 0;
+    }
+    if (mBurst == mInBursts.size())
       throw std::runtime_error("Ran out of RSP input");
 
-    return *(mInBufPos++);
+    const std::string &burst = mInBursts[mBurst];
+    std::size_t count = 0;
+    while (count < len && mBurstPos != burst.size())
+      buf[count++] = burst[mBurstPos++];
+    return static_cast<int>(count);
   }
 
 private:
-  std::string mInBuf;
-  std::string::iterator mInBufPos;
+  std::vector<std::string> mInBursts;
+  std::size_t mBurst;
+  std::size_t mBurstPos;
 
   std::string mOutBuf;
 };
@@ -60,6 +77,9 @@ public:
     PREPARE,
     RESUME,
     WAIT,
+    INSERT_MATCHPOINT,
+    REMOVE_MATCHPOINT,
+    HALT_CPU,
   };
   union ITargetCall {
     ITargetFunc func;
@@ -127,6 +147,19 @@ public:
       ITarget::WaitRes outWaitResult;
     } waitState;
 
+    struct MatchpointState {
+      ITargetFunc func;
+      uint_addr_t inAddr;
+      ITarget::MatchType inMatchType;
+      bool outSuccess;
+    } matchpointState;
+
+    struct HaltCpuState {
+      ITargetFunc func;
+      unsigned int inIndex;
+      bool outSuccess;
+    } haltCpuState;
+
     ITargetCall(const ReadRegisterState &other) : readRegisterState(other) {}
     ITargetCall(const WriteRegisterState &other) : writeRegisterState(other) {}
     ITargetCall(const ReadState &other) : readState(other) {}
@@ -137,6 +170,8 @@ public:
     ITargetCall(const PrepareState &other) : prepareState(other) {}
     ITargetCall(const ResumeState &other) : resumeState(other) {}
     ITargetCall(const WaitState &other) : waitState(other) {}
+    ITargetCall(const MatchpointState &other) : matchpointState(other) {}
+    ITargetCall(const HaltCpuState &other) : haltCpuState(other) {}
   };
 
   TraceTarget(const TraceFlags *traceFlags, int regCount, int regSize,
@@ -190,6 +225,13 @@ public:
   int getRegisterCount() const override { return mRegisterCount; }
   int getRegisterSize() const override { return mRegisterSize; }
 
+  // Memory caching would turn the reads in each trace into page reads, so
+  // the traces instead record exactly the accesses GDB asks for.
+  bool isCacheable(const uint_addr_t EMBDEBUG_ATTR_UNUSED addr,
+                   const std::size_t EMBDEBUG_ATTR_UNUSED size) const override {
+    return false;
+  }
+
   bool getSyscallArgLocs(SyscallArgLoc &syscallIDLoc,
                          std::vector<SyscallArgLoc> &syscallArgLocs,
                          SyscallArgLoc &syscallReturnLoc) const override {
@@ -268,6 +310,7 @@ public:
     return call.instrCountState.outValue;
   }
 
+  unsigned int getCurrentCpu() override { return 0; }
   void setCurrentCpu(unsigned int EMBDEBUG_ATTR_UNUSED index) override {}
 
   bool prepare(const std::vector<ResumeType> &actions) override {
@@ -292,6 +335,31 @@ public:
     return call.waitState.outWaitResult;
   }
 
+  bool insertMatchpoint(const uint_addr_t addr,
+                        const MatchType matchType) override {
+    auto &call = popAndVerifyCall(ITargetFunc::INSERT_MATCHPOINT);
+    if (addr != call.matchpointState.inAddr ||
+        matchType != call.matchpointState.inMatchType)
+      throw std::runtime_error("Argument mismatch");
+    return call.matchpointState.outSuccess;
+  }
+
+  bool removeMatchpoint(const uint_addr_t addr,
+                        const MatchType matchType) override {
+    auto &call = popAndVerifyCall(ITargetFunc::REMOVE_MATCHPOINT);
+    if (addr != call.matchpointState.inAddr ||
+        matchType != call.matchpointState.inMatchType)
+      throw std::runtime_error("Argument mismatch");
+    return call.matchpointState.outSuccess;
+  }
+
+  bool haltCpu(const unsigned int index) override {
+    auto &call = popAndVerifyCall(ITargetFunc::HALT_CPU);
+    if (index != call.haltCpuState.inIndex)
+      throw std::runtime_error("Argument mismatch");
+    return call.haltCpuState.outSuccess;
+  }
+
   bool supportsTargetXML(void) override { return true; }
 
   const char *getTargetXML(ByteView name) override {
@@ -458,10 +526,169 @@ GdbServerTestCase testRegisterWriteAll = {
             {TraceTarget::ITargetFunc::WRITE_REGISTER, 5, 0x05, 1}),
     }};
 
+// Registers are cached while the target is stopped, and written through
+GdbServerTestCase testRegisterReadCached = {
+    /*reg count*/ 4,
+    /*reg size*/ 2,
+    "$g#67+$p2#a2+$g#67+$vKill;1#6e+",
+    "+$bbcae5a901c00710#78+$01c0#f4+$bbcae5a901c00710#78+$OK#9a",
+    {
+        TraceTarget::ITargetCall::ReadRegisterState(
+            {TraceTarget::ITargetFunc::READ_REGISTER, 0, 0xcabb, 2}),
+        TraceTarget::ITargetCall::ReadRegisterState(
+            {TraceTarget::ITargetFunc::READ_REGISTER, 1, 0xa9e5, 2}),
+        TraceTarget::ITargetCall::ReadRegisterState(
+            {TraceTarget::ITargetFunc::READ_REGISTER, 2, 0xc001, 2}),
+        TraceTarget::ITargetCall::ReadRegisterState(
+            {TraceTarget::ITargetFunc::READ_REGISTER, 3, 0x1007, 2}),
+    }};
+GdbServerTestCase testRegisterWriteThrough = {
+    /*reg count*/ 4,
+    /*reg size*/ 2,
+    "$P1=3412#88+$p1#a1+$vKill;1#6e+",
+    "+$OK#9a+$3412#ca+$OK#9a",
+    {
+        TraceTarget::ITargetCall::WriteRegisterState(
+            {TraceTarget::ITargetFunc::WRITE_REGISTER, 1, 0x1234, 2}),
+    }};
+GdbServerTestCase testRegisterReadAfterStep = {
+    /*reg count*/ 16,
+    /*reg size*/ 4,
+    "$pa#d1+$vCont:s#b7+$pa#d1+$vKill;1#6e+",
+    "+$efbe0000#52+$S05#b8+$f3be0000#20+$OK#9a",
+    {
+        TraceTarget::ITargetCall::ReadRegisterState(
+            {TraceTarget::ITargetFunc::READ_REGISTER, 10, 0xbeef, 4}),
+        TraceTarget::ITargetCall::PrepareState(
+            {TraceTarget::ITargetFunc::PREPARE, ITarget::ResumeType::STEP,
+             true}),
+        TraceTarget::ITargetCall::CycleCountState(
+            {TraceTarget::ITargetFunc::CYCLE_COUNT, 1234}),
+        TraceTarget::ITargetCall::ResumeState(
+            {TraceTarget::ITargetFunc::RESUME, true}),
+        TraceTarget::ITargetCall::WaitState({TraceTarget::ITargetFunc::WAIT,
+                                             ITarget::ResumeRes::STEPPED,
+                                             ITarget::WaitRes::EVENT_OCCURRED}),
+        TraceTarget::ITargetCall::ReadRegisterState(
+            {TraceTarget::ITargetFunc::READ_REGISTER, 10, 0xbef3, 4}),
+    }};
+
 INSTANTIATE_TEST_CASE_P(RegisterReadWriteRSPTest, GdbServerTest,
                         ::testing::Values(testRegisterRead, testRegisterWrite,
                                           testRegisterReadAll,
-                                          testRegisterWriteAll));
+                                          testRegisterWriteAll,
+                                          testRegisterReadCached,
+                                          testRegisterWriteThrough,
+                                          testRegisterReadAfterStep));
+
+// A target which asks for registers to be expedited in stop replies
+class ExpeditingTraceTarget : public TraceTarget {
+public:
+  ExpeditingTraceTarget(const TraceFlags *traceFlags,
+                        std::vector<ITargetCall> targetTrace)
+      : TraceTarget(traceFlags, 33, 4, targetTrace) {}
+
+  int getRegisterNumber(const RegisterRole role) const override {
+    switch (role) {
+    case RegisterRole::PC:
+      return 32;
+    case RegisterRole::SP:
+      return 2;
+    case RegisterRole::FP:
+      return 8;
+    default:
+      return -1;
+    }
+  }
+
+  void getExpeditedRegisters(std::vector<int> &regs) const override {
+    regs = {5, 2};
+  }
+};
+
+// The stop reply after a step carries the PC, SP, FP and target requested
+// registers, after which reading them does not touch the target.
+TEST(GdbServerExpeditedTest, StepReportsRegisters) {
+  TraceFlags flags;
+  TraceConnection conn(&flags);
+  ExpeditingTraceTarget target(
+      &flags,
+      {
+          TraceTarget::ITargetCall::PrepareState(
+              {TraceTarget::ITargetFunc::PREPARE, ITarget::ResumeType::STEP,
+               true}),
+          TraceTarget::ITargetCall::CycleCountState(
+              {TraceTarget::ITargetFunc::CYCLE_COUNT, 1234}),
+          TraceTarget::ITargetCall::ResumeState(
+              {TraceTarget::ITargetFunc::RESUME, true}),
+          TraceTarget::ITargetCall::WaitState(
+              {TraceTarget::ITargetFunc::WAIT, ITarget::ResumeRes::STEPPED,
+               ITarget::WaitRes::EVENT_OCCURRED}),
+          TraceTarget::ITargetCall::ReadRegisterState(
+              {TraceTarget::ITargetFunc::READ_REGISTER, 32, 0x100, 4}),
+          TraceTarget::ITargetCall::ReadRegisterState(
+              {TraceTarget::ITargetFunc::READ_REGISTER, 2, 0xfff0, 4}),
+          TraceTarget::ITargetCall::ReadRegisterState(
+              {TraceTarget::ITargetFunc::READ_REGISTER, 8, 0x0, 4}),
+          TraceTarget::ITargetCall::ReadRegisterState(
+              {TraceTarget::ITargetFunc::READ_REGISTER, 5, 0x7, 4}),
+      });
+  GdbServer server(&conn, &target, &flags, EXIT_ON_KILL);
+
+  conn.setInBuf("$vCont:s#b7+$p20#d2+$vKill;1#6e+");
+  server.rspServer();
+  EXPECT_EQ("+$T0520:00010000;2:f0ff0000;8:00000000;5:07000000;#38"
+            "+$00010000#81+$OK#9a",
+            conn.getOutBuf());
+}
+
+// A range step the target declines is done by the server, which steps the
+// core until it leaves the range and only reports that stop.
+TEST(GdbServerExpeditedTest, RangeStep) {
+  TraceFlags flags;
+  TraceConnection conn(&flags);
+  ExpeditingTraceTarget target(
+      &flags,
+      {
+          TraceTarget::ITargetCall::PrepareState(
+              {TraceTarget::ITargetFunc::PREPARE, ITarget::ResumeType::STEP,
+               true}),
+          TraceTarget::ITargetCall::CycleCountState(
+              {TraceTarget::ITargetFunc::CYCLE_COUNT, 1234}),
+          TraceTarget::ITargetCall::ResumeState(
+              {TraceTarget::ITargetFunc::RESUME, true}),
+          TraceTarget::ITargetCall::WaitState(
+              {TraceTarget::ITargetFunc::WAIT, ITarget::ResumeRes::STEPPED,
+               ITarget::WaitRes::EVENT_OCCURRED}),
+          // Still in the range
+          TraceTarget::ITargetCall::ReadRegisterState(
+              {TraceTarget::ITargetFunc::READ_REGISTER, 32, 0x104, 4}),
+          TraceTarget::ITargetCall::PrepareState(
+              {TraceTarget::ITargetFunc::PREPARE, ITarget::ResumeType::STEP,
+               true}),
+          TraceTarget::ITargetCall::ResumeState(
+              {TraceTarget::ITargetFunc::RESUME, true}),
+          TraceTarget::ITargetCall::WaitState(
+              {TraceTarget::ITargetFunc::WAIT, ITarget::ResumeRes::STEPPED,
+               ITarget::WaitRes::EVENT_OCCURRED}),
+          // Left the range
+          TraceTarget::ITargetCall::ReadRegisterState(
+              {TraceTarget::ITargetFunc::READ_REGISTER, 32, 0x108, 4}),
+          TraceTarget::ITargetCall::ReadRegisterState(
+              {TraceTarget::ITargetFunc::READ_REGISTER, 2, 0xfff0, 4}),
+          TraceTarget::ITargetCall::ReadRegisterState(
+              {TraceTarget::ITargetFunc::READ_REGISTER, 8, 0x0, 4}),
+          TraceTarget::ITargetCall::ReadRegisterState(
+              {TraceTarget::ITargetFunc::READ_REGISTER, 5, 0x7, 4}),
+      });
+  GdbServer server(&conn, &target, &flags, EXIT_ON_KILL);
+
+  conn.setInBuf("$vCont;r100,108#0d+$vKill;1#6e+");
+  server.rspServer();
+  EXPECT_EQ("+$T0520:08010000;2:f0ff0000;8:00000000;5:07000000;#40"
+            "+$OK#9a",
+            conn.getOutBuf());
+}
 
 // Tests of memory reads and writes
 GdbServerTestCase testMemoryInvalidRead1 = {
@@ -509,6 +736,39 @@ GdbServerTestCase testMemoryWrite = {
         }),
     },
 };
+GdbServerTestCase testMemoryWriteBlock = {
+    "$M9a8,4:4e6f7021#b8+$vKill;1#6e+",
+    "+$OK#9a+$OK#9a",
+    {
+        TraceTarget::ITargetCall::WriteState({
+            TraceTarget::ITargetFunc::WRITE,
+            0x9a8,
+            (const uint8_t *)"\x4e\x6f\x70\x21",
+            4,
+            4,
+        }),
+    },
+};
+GdbServerTestCase testMemoryWritePartial = {
+    "$M9a8,4:4e6f7021#b8+$vKill;1#6e+",
+    "+$OK#9a+$OK#9a",
+    {
+        TraceTarget::ITargetCall::WriteState({
+            TraceTarget::ITargetFunc::WRITE,
+            0x9a8,
+            (const uint8_t *)"\x4e\x6f\x70\x21",
+            4,
+            3,
+        }),
+        TraceTarget::ITargetCall::WriteState({
+            TraceTarget::ITargetFunc::WRITE,
+            0x9ab,
+            (const uint8_t *)"\x21",
+            1,
+            1,
+        }),
+    },
+};
 GdbServerTestCase testMemoryBinaryWrite = {
     "$X88,4:\x11\x22\x33\x44#0c+$vKill;1#6e+",
     "+$OK#9a+$OK#9a",
@@ -522,6 +782,17 @@ GdbServerTestCase testMemoryBinaryWrite = {
         }),
     },
 };
+GdbServerTestCase testMemoryBinaryRead = {
+    "$x124,3#6e+$vKill;1#6e+",
+    "+$b}\x03" "A}]#fd+$OK#9a",
+    {
+        TraceTarget::ITargetCall::ReadState({TraceTarget::ITargetFunc::READ,
+                                             0x124, 3,
+                                             (const uint8_t *)"#A}", 3}),
+    },
+};
+GdbServerTestCase testMemoryInvalidBinaryRead = {
+    "$x124#0f+$vKill;1#6e+", "+$E01#a6+$OK#9a", {}};
 
 INSTANTIATE_TEST_CASE_P(
     MemoryReadWriteRSPTest, GdbServerTest,
@@ -531,11 +802,30 @@ INSTANTIATE_TEST_CASE_P(
                       testMemoryInvalidWrite3, testMemoryInvalidWrite4,
                       testMemoryWriteBufferTooLong,
                       testMemoryWriteBufferTooShort, testMemoryRead,
-                      testMemoryWrite, testMemoryBinaryWrite));
+                      testMemoryWrite, testMemoryWriteBlock,
+                      testMemoryWritePartial, testMemoryBinaryWrite,
+                      testMemoryBinaryRead, testMemoryInvalidBinaryRead));
+
+// Test of the features reported by qSupported
+GdbServerTestCase testQSupported = {
+    "$qSupported:multiprocess+#c6+$vKill;1#6e+",
+    "+$PacketSize=40000;QNonStop+;VContSupported+;QStartNoAckMode+;"
+    "binary-upload+;swbreak+;hwbreak+;ConditionalBreakpoints+;"
+    "BreakpointCommands+;qXfer:features:read+;multiprocess+#82"
+    "+$OK#9a",
+    {}};
+
+// Non-stop mode needs the target to run cores independently
+GdbServerTestCase testNonStopUnsupported = {
+    "$QNonStop:1#8d+$vKill;1#6e+", "+$E01#a6+$OK#9a", {}};
+
+INSTANTIATE_TEST_CASE_P(QueryRSPTest, GdbServerTest,
+                        ::testing::Values(testQSupported,
+                                          testNonStopUnsupported));
 
 // Tests of vCont packets - stepping and continuing the target
 GdbServerTestCase testVContQuery = {
-    "$vCont?#49+$vKill;1#6e+", "+$vCont;c;C;s;S#62+$OK#9a", {}};
+    "$vCont?#49+$vKill;1#6e+", "+$vCont;c;C;s;S;t;r#be+$OK#9a", {}};
 GdbServerTestCase testVContStep1 = {
     "$vCont:s#b7+$vKill;1#6e+",
     "+$S05#b8+$OK#9a",
@@ -600,6 +890,8 @@ GdbServerTestCase testVContContinue2 = {
                                              ITarget::WaitRes::EVENT_OCCURRED}),
     },
 };
+GdbServerTestCase testVContRangeInvalid = {
+    "$vCont;r100#48+$vKill;1#6e+", "+$E01#a6+$OK#9a", {}};
 // Test continue in this block by emulating as vCont packets
 GdbServerTestCase testStep1 = {
     "$s#73+$vKill;1#6e+",
@@ -671,7 +963,601 @@ INSTANTIATE_TEST_CASE_P(RSPVContTest, GdbServerTest,
                                           testVContStep2, testVContContinue1,
                                           testVContContinue2, testStep1,
                                           testStep2, testContinue1,
-                                          testContinue2));
+                                          testContinue2,
+                                          testVContRangeInvalid));
+
+// A target which runs its cores independently
+class NonStopTraceTarget : public TraceTarget {
+public:
+  NonStopTraceTarget(const TraceFlags *traceFlags,
+                     std::vector<ITargetCall> targetTrace)
+      : TraceTarget(traceFlags, 1, 1, targetTrace) {}
+
+  bool setNonStop(const bool EMBDEBUG_ATTR_UNUSED enable) override {
+    return true;
+  }
+};
+
+// In non-stop mode vCont is answered at once, and the stop is reported in a
+// notification when the target is next found to have stopped.
+TEST(GdbServerNonStopTest, StopNotification) {
+  TraceFlags flags;
+  TraceConnection conn(&flags);
+  NonStopTraceTarget target(
+      &flags,
+      {
+          TraceTarget::ITargetCall::PrepareState(
+              {TraceTarget::ITargetFunc::PREPARE, ITarget::ResumeType::CONTINUE,
+               true}),
+          TraceTarget::ITargetCall::ResumeState(
+              {TraceTarget::ITargetFunc::RESUME, true}),
+          TraceTarget::ITargetCall::WaitState({TraceTarget::ITargetFunc::WAIT,
+                                               ITarget::ResumeRes::NONE,
+                                               ITarget::WaitRes::TIMEOUT}),
+          TraceTarget::ITargetCall::WaitState(
+              {TraceTarget::ITargetFunc::WAIT, ITarget::ResumeRes::INTERRUPTED,
+               ITarget::WaitRes::EVENT_OCCURRED}),
+      });
+  GdbServer server(&conn, &target, &flags, EXIT_ON_KILL);
+
+  conn.setInBursts({"$QNonStop:1#8d+$vCont;c#a8+",
+                    "$vStopped#55+$vKill;1#6e+"});
+  server.rspServer();
+  EXPECT_EQ("+$OK#9a"
+            "+$OK#9a"
+            "%Stop:S05#98"
+            "+$OK#9a"
+            "+$OK#9a",
+            conn.getOutBuf());
+}
+
+// A running core is stopped with vCont;t, and reported with signal 0
+TEST(GdbServerNonStopTest, HaltCore) {
+  TraceFlags flags;
+  TraceConnection conn(&flags);
+  NonStopTraceTarget target(
+      &flags,
+      {
+          TraceTarget::ITargetCall::PrepareState(
+              {TraceTarget::ITargetFunc::PREPARE, ITarget::ResumeType::CONTINUE,
+               true}),
+          TraceTarget::ITargetCall::ResumeState(
+              {TraceTarget::ITargetFunc::RESUME, true}),
+          TraceTarget::ITargetCall::HaltCpuState(
+              {TraceTarget::ITargetFunc::HALT_CPU, 0, true}),
+      });
+  GdbServer server(&conn, &target, &flags, EXIT_ON_KILL);
+
+  conn.setInBursts({"$QNonStop:1#8d+$vCont;c#a8+$vCont;t#b9+",
+                    "$vStopped#55+$vKill;1#6e+"});
+  server.rspServer();
+  EXPECT_EQ("+$OK#9a"
+            "+$OK#9a"
+            "+%Stop:S00#93$OK#9a"
+            "+$OK#9a"
+            "+$OK#9a",
+            conn.getOutBuf());
+}
+
+// In non-stop mode '?' reports the first stopped core, and the others are
+// collected with vStopped
+TEST(GdbServerNonStopTest, StopReasons) {
+  TraceFlags flags;
+  TraceConnection conn(&flags);
+  NonStopTraceTarget target(&flags, {});
+  GdbServer server(&conn, &target, &flags, EXIT_ON_KILL);
+
+  conn.setInBuf("$QNonStop:1#8d+$?#3f+$vStopped#55+$vKill;1#6e+");
+  server.rspServer();
+  EXPECT_EQ("+$OK#9a+$S05#b8+$OK#9a+$OK#9a", conn.getOutBuf());
+}
+
+// A non-stop target with two cores, whose only register holds the core
+// number plus one. Any resume stops the second core.
+class TwoCoreNonStopTarget : public TraceTarget {
+public:
+  TwoCoreNonStopTarget(const TraceFlags *traceFlags)
+      : TraceTarget(traceFlags, 1, 1, {}), mCore(0) {}
+
+  bool setNonStop(const bool EMBDEBUG_ATTR_UNUSED enable) override {
+    return true;
+  }
+
+  unsigned int getCpuCount() override { return 2; }
+  unsigned int getCurrentCpu() override { return mCore; }
+  void setCurrentCpu(unsigned int index) override { mCore = index; }
+
+  std::size_t readRegister(const int EMBDEBUG_ATTR_UNUSED reg,
+                           uint_reg_t &value) override {
+    value = mCore + 1;
+    return 1;
+  }
+
+  bool prepare(const std::vector<ResumeType> EMBDEBUG_ATTR_UNUSED
+                   &actions) override {
+    return true;
+  }
+
+  bool resume(void) override { return true; }
+
+  WaitRes wait(std::vector<ResumeRes> &results) override {
+    results = {ResumeRes::NONE, ResumeRes::INTERRUPTED};
+    return WaitRes::EVENT_OCCURRED;
+  }
+
+private:
+  unsigned int mCore;
+};
+
+// Resuming and reporting the stop of another core leaves the core the
+// client selected with Hg selected.
+TEST(GdbServerNonStopTest, KeepSelectedCore) {
+  TraceFlags flags;
+  TraceConnection conn(&flags);
+  TwoCoreNonStopTarget target(&flags);
+  GdbServer server(&conn, &target, &flags, EXIT_ON_KILL);
+
+  conn.setInBursts({"$QNonStop:1#8d+$Hgp1.1#af+$vCont;c:p2.1#e3+",
+                    "$vStopped#55+$g#67+$vKill;1#6e+$vKill;2#6f+"});
+  server.rspServer();
+  EXPECT_EQ("+$OK#9a"
+            "+$OK#9a"
+            "+$OK#9a"
+            "%Stop:S05#98"
+            "+$OK#9a"
+            "+$01#61"
+            "+$OK#9a"
+            "+$OK#9a",
+            conn.getOutBuf());
+}
+
+// Tests of breakpoints and watchpoints. Software breakpoints the target
+// declines are emulated with breakpoint instructions, which are hidden from
+// the client.
+GdbServerTestCase testMatchpointTarget = {
+    "$Z0,100,4#a7+$z0,100,4#c7+$D#44+$vKill;1#6e+",
+    "+$OK#9a+$OK#9a+$OK#9a+$OK#9a",
+    {
+        TraceTarget::ITargetCall::MatchpointState(
+            {TraceTarget::ITargetFunc::INSERT_MATCHPOINT, 0x100,
+             ITarget::MatchType::BREAK, true}),
+        TraceTarget::ITargetCall::MatchpointState(
+            {TraceTarget::ITargetFunc::REMOVE_MATCHPOINT, 0x100,
+             ITarget::MatchType::BREAK, true}),
+    },
+};
+GdbServerTestCase testMatchpointEmulated = {
+    "$Z0,100,4#a7+$m100,4#5e+$z0,100,4#c7+$D#44+$vKill;1#6e+",
+    "+$OK#9a+$13000000#84+$OK#9a+$OK#9a+$OK#9a",
+    {
+        TraceTarget::ITargetCall::MatchpointState(
+            {TraceTarget::ITargetFunc::INSERT_MATCHPOINT, 0x100,
+             ITarget::MatchType::BREAK, false}),
+        TraceTarget::ITargetCall::ReadState(
+            {TraceTarget::ITargetFunc::READ, 0x100, 4,
+             (const uint8_t *)"\x13\x00\x00\x00", 4}),
+        TraceTarget::ITargetCall::WriteState(
+            {TraceTarget::ITargetFunc::WRITE, 0x100,
+             (const uint8_t *)"\x73\x00\x10\x00", 4, 4}),
+        TraceTarget::ITargetCall::ReadState(
+            {TraceTarget::ITargetFunc::READ, 0x100, 4,
+             (const uint8_t *)"\x73\x00\x10\x00", 4}),
+        TraceTarget::ITargetCall::WriteState(
+            {TraceTarget::ITargetFunc::WRITE, 0x100,
+             (const uint8_t *)"\x13\x00\x00\x00", 4, 4}),
+    },
+};
+GdbServerTestCase testMatchpointEmulatedCompressed = {
+    "$Z0,102,2#a7+$m102,2#5e+$z0,102,2#c7+$D#44+$vKill;1#6e+",
+    "+$OK#9a+$1300#c4+$OK#9a+$OK#9a+$OK#9a",
+    {
+        TraceTarget::ITargetCall::MatchpointState(
+            {TraceTarget::ITargetFunc::INSERT_MATCHPOINT, 0x102,
+             ITarget::MatchType::BREAK, false}),
+        TraceTarget::ITargetCall::ReadState(
+            {TraceTarget::ITargetFunc::READ, 0x102, 2,
+             (const uint8_t *)"\x13\x00", 2}),
+        TraceTarget::ITargetCall::WriteState(
+            {TraceTarget::ITargetFunc::WRITE, 0x102,
+             (const uint8_t *)"\x02\x90", 2, 2}),
+        TraceTarget::ITargetCall::ReadState(
+            {TraceTarget::ITargetFunc::READ, 0x102, 2,
+             (const uint8_t *)"\x02\x90", 2}),
+        TraceTarget::ITargetCall::WriteState(
+            {TraceTarget::ITargetFunc::WRITE, 0x102,
+             (const uint8_t *)"\x13\x00", 2, 2}),
+    },
+};
+GdbServerTestCase testMatchpointWriteOver = {
+    "$Z0,100,4#a7+$M100,4:01020304#02+$z0,100,4#c7+$D#44+$vKill;1#6e+",
+    "+$OK#9a+$OK#9a+$OK#9a+$OK#9a+$OK#9a",
+    {
+        TraceTarget::ITargetCall::MatchpointState(
+            {TraceTarget::ITargetFunc::INSERT_MATCHPOINT, 0x100,
+             ITarget::MatchType::BREAK, false}),
+        TraceTarget::ITargetCall::ReadState(
+            {TraceTarget::ITargetFunc::READ, 0x100, 4,
+             (const uint8_t *)"\x13\x00\x00\x00", 4}),
+        TraceTarget::ITargetCall::WriteState(
+            {TraceTarget::ITargetFunc::WRITE, 0x100,
+             (const uint8_t *)"\x73\x00\x10\x00", 4, 4}),
+        TraceTarget::ITargetCall::WriteState(
+            {TraceTarget::ITargetFunc::WRITE, 0x100,
+             (const uint8_t *)"\x73\x00\x10\x00", 4, 4}),
+        TraceTarget::ITargetCall::WriteState(
+            {TraceTarget::ITargetFunc::WRITE, 0x100,
+             (const uint8_t *)"\x01\x02\x03\x04", 4, 4}),
+    },
+};
+GdbServerTestCase testMatchpointBadKind = {
+    "$Z0,100,3#a6+$vKill;1#6e+",
+    "+$E01#a6+$OK#9a",
+    {
+        TraceTarget::ITargetCall::MatchpointState(
+            {TraceTarget::ITargetFunc::INSERT_MATCHPOINT, 0x100,
+             ITarget::MatchType::BREAK, false}),
+    },
+};
+GdbServerTestCase testMatchpointHardwareDeclined = {
+    "$Z1,200,4#a9+$vKill;1#6e+",
+    "+$E01#a6+$OK#9a",
+    {
+        TraceTarget::ITargetCall::MatchpointState(
+            {TraceTarget::ITargetFunc::INSERT_MATCHPOINT, 0x200,
+             ITarget::MatchType::BREAK_HW, false}),
+    },
+};
+GdbServerTestCase testMatchpointWatch = {
+    "$Z2,300,4#ab+$z2,300,4#cb+$D#44+$vKill;1#6e+",
+    "+$OK#9a+$OK#9a+$OK#9a+$OK#9a",
+    {
+        TraceTarget::ITargetCall::MatchpointState(
+            {TraceTarget::ITargetFunc::INSERT_MATCHPOINT, 0x300,
+             ITarget::MatchType::WATCH_WRITE, true}),
+        TraceTarget::ITargetCall::MatchpointState(
+            {TraceTarget::ITargetFunc::REMOVE_MATCHPOINT, 0x300,
+             ITarget::MatchType::WATCH_WRITE, true}),
+    },
+};
+// Removing and inserting a breakpoint again before resuming leaves the
+// target alone. Otherwise removals are made when the target is resumed.
+GdbServerTestCase testMatchpointReinsert = {
+    "$Z0,100,4#a7+$z0,100,4#c7+$Z0,100,4#a7+$c#63+$vKill;1#6e+",
+    "+$OK#9a+$OK#9a+$OK#9a+$S05#b8+$OK#9a",
+    {
+        TraceTarget::ITargetCall::MatchpointState(
+            {TraceTarget::ITargetFunc::INSERT_MATCHPOINT, 0x100,
+             ITarget::MatchType::BREAK, true}),
+        TraceTarget::ITargetCall::PrepareState(
+            {TraceTarget::ITargetFunc::PREPARE, ITarget::ResumeType::CONTINUE,
+             true}),
+        TraceTarget::ITargetCall::CycleCountState(
+            {TraceTarget::ITargetFunc::CYCLE_COUNT, 1234}),
+        TraceTarget::ITargetCall::ResumeState(
+            {TraceTarget::ITargetFunc::RESUME, true}),
+        TraceTarget::ITargetCall::WaitState({TraceTarget::ITargetFunc::WAIT,
+                                             ITarget::ResumeRes::INTERRUPTED,
+                                             ITarget::WaitRes::EVENT_OCCURRED}),
+    },
+};
+GdbServerTestCase testMatchpointRemoveOnResume = {
+    "$Z0,100,4#a7+$z0,100,4#c7+$c#63+$vKill;1#6e+",
+    "+$OK#9a+$OK#9a+$S05#b8+$OK#9a",
+    {
+        TraceTarget::ITargetCall::MatchpointState(
+            {TraceTarget::ITargetFunc::INSERT_MATCHPOINT, 0x100,
+             ITarget::MatchType::BREAK, true}),
+        TraceTarget::ITargetCall::PrepareState(
+            {TraceTarget::ITargetFunc::PREPARE, ITarget::ResumeType::CONTINUE,
+             true}),
+        TraceTarget::ITargetCall::CycleCountState(
+            {TraceTarget::ITargetFunc::CYCLE_COUNT, 1234}),
+        TraceTarget::ITargetCall::MatchpointState(
+            {TraceTarget::ITargetFunc::REMOVE_MATCHPOINT, 0x100,
+             ITarget::MatchType::BREAK, true}),
+        TraceTarget::ITargetCall::ResumeState(
+            {TraceTarget::ITargetFunc::RESUME, true}),
+        TraceTarget::ITargetCall::WaitState({TraceTarget::ITargetFunc::WAIT,
+                                             ITarget::ResumeRes::INTERRUPTED,
+                                             ITarget::WaitRes::EVENT_OCCURRED}),
+    },
+};
+GdbServerTestCase testMatchpointRemoveTwice = {
+    "$Z0,100,4#a7+$z0,100,4#c7+$z0,100,4#c7+$vKill;1#6e+",
+    "+$OK#9a+$OK#9a+$E01#a6+$OK#9a",
+    {
+        TraceTarget::ITargetCall::MatchpointState(
+            {TraceTarget::ITargetFunc::INSERT_MATCHPOINT, 0x100,
+             ITarget::MatchType::BREAK, true}),
+    },
+};
+GdbServerTestCase testMatchpointCondition = {
+    "$Z0,100,4;X3,220127X3,220027#ab+$Z0,100,4;cmds:0,X3,220027;X3,220027#22+"
+    "$vKill;1#6e+",
+    "+$OK#9a+$OK#9a+$OK#9a",
+    {
+        TraceTarget::ITargetCall::MatchpointState(
+            {TraceTarget::ITargetFunc::INSERT_MATCHPOINT, 0x100,
+             ITarget::MatchType::BREAK, true}),
+    },
+};
+GdbServerTestCase testMatchpointConditionTruncated = {
+    "$Z0,100,4;X3,2200#5d+$vKill;1#6e+", "+$E01#a6+$OK#9a", {}};
+GdbServerTestCase testMatchpointConditionUnsupported = {
+    "$Z0,100,4;X2,3427#68+$vKill;1#6e+", "+$E01#a6+$OK#9a", {}};
+GdbServerTestCase testMatchpointUnknownType = {
+    "$Z5,100,4#ac+$vKill;1#6e+", "+$#00+$OK#9a", {}};
+GdbServerTestCase testMatchpointRemoveUnknown = {
+    "$z0,104,4#cb+$vKill;1#6e+", "+$E01#a6+$OK#9a", {}};
+GdbServerTestCase testMatchpointInvalid = {
+    "$Z0,100#47+$vKill;1#6e+", "+$E01#a6+$OK#9a", {}};
+
+INSTANTIATE_TEST_CASE_P(
+    RSPMatchpointTest, GdbServerTest,
+    ::testing::Values(testMatchpointTarget, testMatchpointEmulated,
+                      testMatchpointEmulatedCompressed, testMatchpointWriteOver,
+                      testMatchpointBadKind, testMatchpointHardwareDeclined,
+                      testMatchpointWatch, testMatchpointReinsert,
+                      testMatchpointRemoveOnResume, testMatchpointRemoveTwice,
+                      testMatchpointCondition, testMatchpointConditionTruncated,
+                      testMatchpointConditionUnsupported,
+                      testMatchpointUnknownType, testMatchpointRemoveUnknown,
+                      testMatchpointInvalid));
+
+// Stopping at a breakpoint is reported as such to a client which supports it.
+TEST(GdbServerExpeditedTest, BreakpointStopReason) {
+  TraceFlags flags;
+  TraceConnection conn(&flags);
+  ExpeditingTraceTarget target(
+      &flags,
+      {
+          TraceTarget::ITargetCall::MatchpointState(
+              {TraceTarget::ITargetFunc::INSERT_MATCHPOINT, 0x100,
+               ITarget::MatchType::BREAK, true}),
+          TraceTarget::ITargetCall::PrepareState(
+              {TraceTarget::ITargetFunc::PREPARE, ITarget::ResumeType::CONTINUE,
+               true}),
+          TraceTarget::ITargetCall::CycleCountState(
+              {TraceTarget::ITargetFunc::CYCLE_COUNT, 1234}),
+          TraceTarget::ITargetCall::ResumeState(
+              {TraceTarget::ITargetFunc::RESUME, true}),
+          TraceTarget::ITargetCall::WaitState(
+              {TraceTarget::ITargetFunc::WAIT, ITarget::ResumeRes::INTERRUPTED,
+               ITarget::WaitRes::EVENT_OCCURRED}),
+          TraceTarget::ITargetCall::ReadRegisterState(
+              {TraceTarget::ITargetFunc::READ_REGISTER, 32, 0x100, 4}),
+          TraceTarget::ITargetCall::ReadRegisterState(
+              {TraceTarget::ITargetFunc::READ_REGISTER, 2, 0xfff0, 4}),
+          TraceTarget::ITargetCall::ReadRegisterState(
+              {TraceTarget::ITargetFunc::READ_REGISTER, 8, 0x0, 4}),
+          TraceTarget::ITargetCall::ReadRegisterState(
+              {TraceTarget::ITargetFunc::READ_REGISTER, 5, 0x7, 4}),
+      });
+  GdbServer server(&conn, &target, &flags, EXIT_ON_KILL);
+
+  conn.setInBuf("$qSupported:swbreak+#8b+$Z0,100,4#a7+$vCont;c#a8+"
+                "$vKill;1#6e+");
+  server.rspServer();
+  EXPECT_EQ("+$PacketSize=40000;QNonStop+;VContSupported+;QStartNoAckMode+;"
+            "binary-upload+;swbreak+;hwbreak+;ConditionalBreakpoints+;"
+            "BreakpointCommands+;qXfer:features:read+#f2"
+            "+$OK#9a"
+            "+$T05swbreak:;20:00010000;2:f0ff0000;8:00000000;5:07000000;#9c"
+            "+$OK#9a",
+            conn.getOutBuf());
+}
+
+// Stops at a breakpoint whose condition is false are not reported. The core
+// is stepped past the breakpoint and continued.
+TEST(GdbServerExpeditedTest, ConditionalBreakpoint) {
+  TraceFlags flags;
+  TraceConnection conn(&flags);
+  ExpeditingTraceTarget target(
+      &flags,
+      {
+          TraceTarget::ITargetCall::MatchpointState(
+              {TraceTarget::ITargetFunc::INSERT_MATCHPOINT, 0x100,
+               ITarget::MatchType::BREAK, true}),
+          TraceTarget::ITargetCall::PrepareState(
+              {TraceTarget::ITargetFunc::PREPARE, ITarget::ResumeType::CONTINUE,
+               true}),
+          TraceTarget::ITargetCall::CycleCountState(
+              {TraceTarget::ITargetFunc::CYCLE_COUNT, 1234}),
+          TraceTarget::ITargetCall::ResumeState(
+              {TraceTarget::ITargetFunc::RESUME, true}),
+          TraceTarget::ITargetCall::WaitState(
+              {TraceTarget::ITargetFunc::WAIT, ITarget::ResumeRes::INTERRUPTED,
+               ITarget::WaitRes::EVENT_OCCURRED}),
+          // Condition is false
+          TraceTarget::ITargetCall::ReadRegisterState(
+              {TraceTarget::ITargetFunc::READ_REGISTER, 32, 0x100, 4}),
+          TraceTarget::ITargetCall::ReadRegisterState(
+              {TraceTarget::ITargetFunc::READ_REGISTER, 5, 0x3, 4}),
+          // Step over the breakpoint
+          TraceTarget::ITargetCall::MatchpointState(
+              {TraceTarget::ITargetFunc::REMOVE_MATCHPOINT, 0x100,
+               ITarget::MatchType::BREAK, true}),
+          TraceTarget::ITargetCall::PrepareState(
+              {TraceTarget::ITargetFunc::PREPARE, ITarget::ResumeType::STEP,
+               true}),
+          TraceTarget::ITargetCall::ResumeState(
+              {TraceTarget::ITargetFunc::RESUME, true}),
+          TraceTarget::ITargetCall::WaitState(
+              {TraceTarget::ITargetFunc::WAIT, ITarget::ResumeRes::STEPPED,
+               ITarget::WaitRes::EVENT_OCCURRED}),
+          TraceTarget::ITargetCall::MatchpointState(
+              {TraceTarget::ITargetFunc::INSERT_MATCHPOINT, 0x100,
+               ITarget::MatchType::BREAK, true}),
+          // Continue again
+          TraceTarget::ITargetCall::PrepareState(
+              {TraceTarget::ITargetFunc::PREPARE, ITarget::ResumeType::CONTINUE,
+               true}),
+          TraceTarget::ITargetCall::ResumeState(
+              {TraceTarget::ITargetFunc::RESUME, true}),
+          TraceTarget::ITargetCall::WaitState(
+              {TraceTarget::ITargetFunc::WAIT, ITarget::ResumeRes::INTERRUPTED,
+               ITarget::WaitRes::EVENT_OCCURRED}),
+          // Condition is true
+          TraceTarget::ITargetCall::ReadRegisterState(
+              {TraceTarget::ITargetFunc::READ_REGISTER, 32, 0x100, 4}),
+          TraceTarget::ITargetCall::ReadRegisterState(
+              {TraceTarget::ITargetFunc::READ_REGISTER, 5, 0x7, 4}),
+          TraceTarget::ITargetCall::ReadRegisterState(
+              {TraceTarget::ITargetFunc::READ_REGISTER, 2, 0xfff0, 4}),
+          TraceTarget::ITargetCall::ReadRegisterState(
+              {TraceTarget::ITargetFunc::READ_REGISTER, 8, 0x0, 4}),
+      });
+  GdbServer server(&conn, &target, &flags, EXIT_ON_KILL);
+
+  // Break if register 5 is 7
+  conn.setInBuf("$Z0,100,4;X7,26000522071327#62+$vCont;c#a8+$vKill;1#6e+");
+  server.rspServer();
+  EXPECT_EQ("+$OK#9a"
+            "+$T0520:00010000;2:f0ff0000;8:00000000;5:07000000;#38"
+            "+$OK#9a",
+            conn.getOutBuf());
+}
+
+// A breakpoint whose condition is never true does not stop the timeout
+// from taking effect.
+TEST(GdbServerExpeditedTest, ConditionalBreakpointTimeout) {
+  TraceFlags flags;
+  TraceConnection conn(&flags);
+  ExpeditingTraceTarget target(
+      &flags,
+      {
+          TraceTarget::ITargetCall::MatchpointState(
+              {TraceTarget::ITargetFunc::INSERT_MATCHPOINT, 0x100,
+               ITarget::MatchType::BREAK, true}),
+          TraceTarget::ITargetCall::PrepareState(
+              {TraceTarget::ITargetFunc::PREPARE, ITarget::ResumeType::CONTINUE,
+               true}),
+          TraceTarget::ITargetCall::CycleCountState(
+              {TraceTarget::ITargetFunc::CYCLE_COUNT, 1234}),
+          TraceTarget::ITargetCall::ResumeState(
+              {TraceTarget::ITargetFunc::RESUME, true}),
+          TraceTarget::ITargetCall::WaitState(
+              {TraceTarget::ITargetFunc::WAIT, ITarget::ResumeRes::INTERRUPTED,
+               ITarget::WaitRes::EVENT_OCCURRED}),
+          // Condition is false
+          TraceTarget::ITargetCall::ReadRegisterState(
+              {TraceTarget::ITargetFunc::READ_REGISTER, 32, 0x100, 4}),
+          TraceTarget::ITargetCall::ReadRegisterState(
+              {TraceTarget::ITargetFunc::READ_REGISTER, 5, 0x3, 4}),
+          // Step over the breakpoint
+          TraceTarget::ITargetCall::MatchpointState(
+              {TraceTarget::ITargetFunc::REMOVE_MATCHPOINT, 0x100,
+               ITarget::MatchType::BREAK, true}),
+          TraceTarget::ITargetCall::PrepareState(
+              {TraceTarget::ITargetFunc::PREPARE, ITarget::ResumeType::STEP,
+               true}),
+          TraceTarget::ITargetCall::ResumeState(
+              {TraceTarget::ITargetFunc::RESUME, true}),
+          TraceTarget::ITargetCall::WaitState(
+              {TraceTarget::ITargetFunc::WAIT, ITarget::ResumeRes::STEPPED,
+               ITarget::WaitRes::EVENT_OCCURRED}),
+          TraceTarget::ITargetCall::MatchpointState(
+              {TraceTarget::ITargetFunc::INSERT_MATCHPOINT, 0x100,
+               ITarget::MatchType::BREAK, true}),
+          TraceTarget::ITargetCall::PrepareState(
+              {TraceTarget::ITargetFunc::PREPARE, ITarget::ResumeType::CONTINUE,
+               true}),
+          // The timeout has passed
+          TraceTarget::ITargetCall::CycleCountState(
+              {TraceTarget::ITargetFunc::CYCLE_COUNT, 0x2000}),
+          TraceTarget::ITargetCall::ReadRegisterState(
+              {TraceTarget::ITargetFunc::READ_REGISTER, 32, 0x104, 4}),
+          TraceTarget::ITargetCall::ReadRegisterState(
+              {TraceTarget::ITargetFunc::READ_REGISTER, 2, 0xfff0, 4}),
+          TraceTarget::ITargetCall::ReadRegisterState(
+              {TraceTarget::ITargetFunc::READ_REGISTER, 8, 0x0, 4}),
+          TraceTarget::ITargetCall::ReadRegisterState(
+              {TraceTarget::ITargetFunc::READ_REGISTER, 5, 0x3, 4}),
+      });
+  GdbServer server(&conn, &target, &flags, EXIT_ON_KILL);
+
+  // monitor cycle-timeout 10, then break if register 5 is 7
+  conn.setInBuf("$qRcmd,6379636c652d74696d656f7574203130#7a+"
+                "$Z0,100,4;X7,26000522071327#62+$vCont;c#a8+$vKill;1#6e+");
+  server.rspServer();
+  EXPECT_EQ("+$OK#9a"
+            "+$OK#9a"
+            "+$T1820:04010000;2:f0ff0000;8:00000000;5:03000000;#3c"
+            "+$OK#9a",
+            conn.getOutBuf());
+}
+
+// The commands of a breakpoint are run by the server, which sends their
+// output to the client, and the stop is not reported.
+TEST(GdbServerExpeditedTest, BreakpointCommands) {
+  TraceFlags flags;
+  TraceConnection conn(&flags);
+  ExpeditingTraceTarget target(
+      &flags,
+      {
+          TraceTarget::ITargetCall::MatchpointState(
+              {TraceTarget::ITargetFunc::INSERT_MATCHPOINT, 0x100,
+               ITarget::MatchType::BREAK, true}),
+          TraceTarget::ITargetCall::PrepareState(
+              {TraceTarget::ITargetFunc::PREPARE, ITarget::ResumeType::CONTINUE,
+               true}),
+          TraceTarget::ITargetCall::CycleCountState(
+              {TraceTarget::ITargetFunc::CYCLE_COUNT, 1234}),
+          TraceTarget::ITargetCall::ResumeState(
+              {TraceTarget::ITargetFunc::RESUME, true}),
+          TraceTarget::ITargetCall::WaitState(
+              {TraceTarget::ITargetFunc::WAIT, ITarget::ResumeRes::INTERRUPTED,
+               ITarget::WaitRes::EVENT_OCCURRED}),
+          // Run the printf
+          TraceTarget::ITargetCall::ReadRegisterState(
+              {TraceTarget::ITargetFunc::READ_REGISTER, 32, 0x100, 4}),
+          TraceTarget::ITargetCall::ReadRegisterState(
+              {TraceTarget::ITargetFunc::READ_REGISTER, 5, 0x7, 4}),
+          // Step over the breakpoint
+          TraceTarget::ITargetCall::MatchpointState(
+              {TraceTarget::ITargetFunc::REMOVE_MATCHPOINT, 0x100,
+               ITarget::MatchType::BREAK, true}),
+          TraceTarget::ITargetCall::PrepareState(
+              {TraceTarget::ITargetFunc::PREPARE, ITarget::ResumeType::STEP,
+               true}),
+          TraceTarget::ITargetCall::ResumeState(
+              {TraceTarget::ITargetFunc::RESUME, true}),
+          TraceTarget::ITargetCall::WaitState(
+              {TraceTarget::ITargetFunc::WAIT, ITarget::ResumeRes::STEPPED,
+               ITarget::WaitRes::EVENT_OCCURRED}),
+          TraceTarget::ITargetCall::MatchpointState(
+              {TraceTarget::ITargetFunc::INSERT_MATCHPOINT, 0x100,
+               ITarget::MatchType::BREAK, true}),
+          // Continue again, stopping elsewhere
+          TraceTarget::ITargetCall::PrepareState(
+              {TraceTarget::ITargetFunc::PREPARE, ITarget::ResumeType::CONTINUE,
+               true}),
+          TraceTarget::ITargetCall::ResumeState(
+              {TraceTarget::ITargetFunc::RESUME, true}),
+          TraceTarget::ITargetCall::WaitState(
+              {TraceTarget::ITargetFunc::WAIT, ITarget::ResumeRes::INTERRUPTED,
+               ITarget::WaitRes::EVENT_OCCURRED}),
+          TraceTarget::ITargetCall::ReadRegisterState(
+              {TraceTarget::ITargetFunc::READ_REGISTER, 32, 0x200, 4}),
+          TraceTarget::ITargetCall::ReadRegisterState(
+              {TraceTarget::ITargetFunc::READ_REGISTER, 2, 0xfff0, 4}),
+          TraceTarget::ITargetCall::ReadRegisterState(
+              {TraceTarget::ITargetFunc::READ_REGISTER, 8, 0x0, 4}),
+          TraceTarget::ITargetCall::ReadRegisterState(
+              {TraceTarget::ITargetFunc::READ_REGISTER, 5, 0x7, 4}),
+      });
+  GdbServer server(&conn, &target, &flags, EXIT_ON_KILL);
+
+  // dprintf "x=%d\n", $x5
+  conn.setInBuf("$Z0,100,4;cmds:0,X12,2600052200220034010006783d25640a0027#7a+"
+                "$vCont;c#a8++$vKill;1#6e+");
+  server.rspServer();
+  EXPECT_EQ("+$OK#9a"
+            "+$O783d370a#50"
+            "$T0520:00020000;2:f0ff0000;8:00000000;5:07000000;#39"
+            "+$OK#9a",
+            conn.getOutBuf());
+}
 
 // Tests of syscall handling and the associated RSP communication
 GdbServerTestCase testSyscallClose = {
@@ -768,20 +1654,78 @@ GdbServerTestCase testSyscallOpen = {
             {TraceTarget::ITargetFunc::READ_REGISTER, 12, 0x0, 4}),
 
         // Read the path string "neat" from target memory (to get its length)
+        TraceTarget::ITargetCall::ReadState(
+            {TraceTarget::ITargetFunc::READ, 0xbeef, 17,
+             (const uint8_t *)"neat\0garbagegarba", 17}),
+
+        // Write result
+        TraceTarget::ITargetCall::WriteRegisterState(
+            {TraceTarget::ITargetFunc::WRITE_REGISTER, 10, 0, 4}),
+
+        TraceTarget::ITargetCall::CycleCountState(
+            {TraceTarget::ITargetFunc::CYCLE_COUNT, 1234}),
+        TraceTarget::ITargetCall::ResumeState(
+            {TraceTarget::ITargetFunc::RESUME, true}),
+        TraceTarget::ITargetCall::WaitState({TraceTarget::ITargetFunc::WAIT,
+                                             ITarget::ResumeRes::INTERRUPTED,
+                                             ITarget::WaitRes::EVENT_OCCURRED}),
+    },
+};
+GdbServerTestCase testSyscallOpenChunks = {
+    /*reg count*/ 32,
+    /*reg size*/ 4,
+    /* syscall id location */
+    ITarget::SyscallArgLoc::RegisterLoc(
+        {ITarget::SyscallArgLocType::REGISTER, 17}),
+    /* syscall argument locations */
+    {
+        ITarget::SyscallArgLoc::RegisterLoc(
+            {ITarget::SyscallArgLocType::REGISTER, 10}),
+        ITarget::SyscallArgLoc::RegisterLoc(
+            {ITarget::SyscallArgLocType::REGISTER, 11}),
+        ITarget::SyscallArgLoc::RegisterLoc(
+            {ITarget::SyscallArgLocType::REGISTER, 12}),
+    },
+    /* syscall return location */
+    ITarget::SyscallArgLoc::RegisterLoc(
+        {ITarget::SyscallArgLocType::REGISTER, 10}),
+    /* test case */
+    "$vCont;c#a8+$F0#76+$vKill;1#6e+",
+    "+$Fopen,befd/5,0,0#d1+$S05#b8+$OK#9a",
+    {
+        TraceTarget::ITargetCall::PrepareState(
+            {TraceTarget::ITargetFunc::PREPARE, ITarget::ResumeType::CONTINUE,
+             true}),
+        TraceTarget::ITargetCall::CycleCountState(
+            {TraceTarget::ITargetFunc::CYCLE_COUNT, 1234}),
+        TraceTarget::ITargetCall::ResumeState(
+            {TraceTarget::ITargetFunc::RESUME, true}),
+        TraceTarget::ITargetCall::WaitState({TraceTarget::ITargetFunc::WAIT,
+                                             ITarget::ResumeRes::SYSCALL,
+                                             ITarget::WaitRes::EVENT_OCCURRED}),
+
+        TraceTarget::ITargetCall::ReadRegisterState(
+            {TraceTarget::ITargetFunc::READ_REGISTER, 17, /*Fopen*/ 1024, 4}),
+        TraceTarget::ITargetCall::ReadRegisterState(
+            {TraceTarget::ITargetFunc::READ_REGISTER, 10, 0xbefd, 4}),
+        TraceTarget::ITargetCall::ReadRegisterState(
+            {TraceTarget::ITargetFunc::READ_REGISTER, 11, 0x0, 4}),
+        TraceTarget::ITargetCall::ReadRegisterState(
+            {TraceTarget::ITargetFunc::READ_REGISTER, 12, 0x0, 4}),
+
+        // Read the path string "neat" from target memory (to get its length)
+        // in two chunks, the second of which can only be read bytewise.
         TraceTarget::ITargetCall::ReadState({TraceTarget::ITargetFunc::READ,
-                                             0xbeef, 1, (const uint8_t *)"n",
-                                             1}),
-        TraceTarget::ITargetCall::ReadState({TraceTarget::ITargetFunc::READ,
-                                             0xbef0, 1, (const uint8_t *)"e",
-                                             1}),
+                                             0xbefd, 3, (const uint8_t *)"nea",
+                                             3}),
         TraceTarget::ITargetCall::ReadState({TraceTarget::ITargetFunc::READ,
-                                             0xbef1, 1, (const uint8_t *)"a",
-                                             1}),
+                                             0xbf00, 256, (const uint8_t *)"",
+                                             0}),
         TraceTarget::ITargetCall::ReadState({TraceTarget::ITargetFunc::READ,
-                                             0xbef2, 1, (const uint8_t *)"t",
+                                             0xbf00, 1, (const uint8_t *)"t",
                                              1}),
         TraceTarget::ITargetCall::ReadState({TraceTarget::ITargetFunc::READ,
-                                             0xbef3, 1, (const uint8_t *)"\0",
+                                             0xbf01, 1, (const uint8_t *)"\0",
                                              1}),
 
         // Write result
@@ -840,6 +1784,7 @@ GdbServerTestCase testSyscallUnknown = {
 
 INSTANTIATE_TEST_CASE_P(RSPSysCallTest, GdbServerTest,
                         ::testing::Values(testSyscallClose, testSyscallOpen,
+                                          testSyscallOpenChunks,
                                           testSyscallUnknown));
 
 // Tests of various qRcmd packets
@@ -956,6 +1901,22 @@ GdbServerTestCase testCmdSetAndShowKillCoreOnExit = {
     "+$OK#9a",
     {},
 };
+GdbServerTestCase testCmdSetAndShowMaxInterruptLatency = {
+    // qRcmd,set max-interrupt-latency 20
+    "$qRcmd,736574206d61782d696e746572727570742d6c6174656e6379203230#c5"
+    // qRcmd,show max-interrupt-latency
+    "+$qRcmd,73686f77206d61782d696e746572727570742d6c6174656e6379#3d"
+    // qRcmd,set max-interrupt-latency 0
+    "++$qRcmd,736574206d61782d696e746572727570742d6c6174656e63792030#60"
+    "+$vKill;1#6e+",
+    // expected output rsp
+    "+$OK#9a"
+    // max-interrupt-latency: 20 ms\n
+    "+$O6d61782d696e746572727570742d6c6174656e63793a203230206d730a#da$OK#9a"
+    "+$E02#a7"
+    "+$OK#9a",
+    {},
+};
 GdbServerTestCase testCmdSetUnknownCommand = {
     // qRcmd,set unknown
     "$qRcmd,73657420756e6b6e6f776e#a4+$vKill;1#6e+",
@@ -977,7 +1938,8 @@ INSTANTIATE_TEST_CASE_P(
         testCmdShowDebugInvalidFlag, testCmdSetDebugFlagInvalidLevel,
         testCmdSetAndShowDebugRspFlag, testCmdSetAndShowDebugConnFlag,
         testCmdSetAndShowDebugDisasFlag, testCmdSetAndShowKillCoreOnExit,
-        testCmdSetUnknownCommand, testCmdShowUnknownCommand));
+        testCmdSetAndShowMaxInterruptLatency, testCmdSetUnknownCommand,
+        testCmdShowUnknownCommand));
 
 // Test of Target XML loading through ITarget
 GdbServerTestCase testXMLWhole = {
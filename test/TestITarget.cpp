@@ -0,0 +1,139 @@
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+#include "StubTarget.h"
+#include "embdebug/ITarget.h"
+
+#include "gtest/gtest.h"
+
+using namespace EmbDebug;
+
+// A target with some registers and memory, implementing only the single
+// register and single range accessors, so that the default bulk accessors
+// are used.
+class SimpleTarget : public StubTarget {
+public:
+  static const int REG_COUNT = 8;
+  static const std::size_t MEM_SIZE = 256;
+
+  SimpleTarget() : StubTarget(nullptr), mReads(0), mWrites(0) {
+    for (int i = 0; i < REG_COUNT; i++)
+      mRegs[i] = 0x100 + i;
+    for (std::size_t i = 0; i < MEM_SIZE; i++)
+      mMem[i] = static_cast<uint8_t>(i);
+  }
+
+  std::size_t readRegister(const int reg, uint_reg_t &value) override {
+    mReads++;
+    value = mRegs[reg];
+    return 4;
+  }
+  std::size_t writeRegister(const int reg, const uint_reg_t value) override {
+    mWrites++;
+    mRegs[reg] = value;
+    return 4;
+  }
+  std::size_t read(const uint_addr_t addr, uint8_t *buffer,
+                   const std::size_t size) override {
+    mReads++;
+    if (addr + size > MEM_SIZE)
+      return 0;
+    ::memcpy(buffer, &mMem[addr], size);
+    return size;
+  }
+  std::size_t write(const uint_addr_t addr, const uint8_t *buffer,
+                    const std::size_t size) override {
+    mWrites++;
+    if (addr + size > MEM_SIZE)
+      return 0;
+    ::memcpy(&mMem[addr], buffer, size);
+    return size;
+  }
+
+  uint_reg_t mRegs[REG_COUNT];
+  uint8_t mMem[MEM_SIZE];
+  int mReads;
+  int mWrites;
+};
+
+TEST(ITargetDefaultsTest, ReadRegisters) {
+  SimpleTarget target;
+  uint_reg_t values[3];
+  std::size_t sizes[3];
+  EXPECT_EQ(3, target.readRegisters(2, 3, values, sizes));
+  EXPECT_EQ(3, target.mReads);
+  for (int i = 0; i < 3; i++) {
+    EXPECT_EQ(0x102u + i, values[i]);
+    EXPECT_EQ(4u, sizes[i]);
+  }
+}
+
+TEST(ITargetDefaultsTest, WriteRegisters) {
+  SimpleTarget target;
+  const uint_reg_t values[2] = {0xaa, 0xbb};
+  std::size_t sizes[2];
+  EXPECT_EQ(2, target.writeRegisters(5, 2, values, sizes));
+  EXPECT_EQ(2, target.mWrites);
+  EXPECT_EQ(0xaau, target.mRegs[5]);
+  EXPECT_EQ(0xbbu, target.mRegs[6]);
+  EXPECT_EQ(4u, sizes[0]);
+  EXPECT_EQ(4u, sizes[1]);
+}
+
+TEST(ITargetDefaultsTest, Readv) {
+  SimpleTarget target;
+  const ITarget::MemoryRange ranges[] = {{0x10, 2}, {0x80, 3}};
+  uint8_t buf[5];
+  EXPECT_EQ(5u, target.readv(ranges, 2, buf));
+  const uint8_t expected[] = {0x10, 0x11, 0x80, 0x81, 0x82};
+  EXPECT_EQ(0, ::memcmp(expected, buf, sizeof(expected)));
+}
+
+// Reading stops at the first range which is not read completely.
+TEST(ITargetDefaultsTest, ReadvPartial) {
+  SimpleTarget target;
+  const ITarget::MemoryRange ranges[] = {
+      {0x10, 2}, {SimpleTarget::MEM_SIZE - 1, 2}, {0x20, 2}};
+  uint8_t buf[6];
+  EXPECT_EQ(2u, target.readv(ranges, 3, buf));
+  EXPECT_EQ(2, target.mReads);
+}
+
+TEST(ITargetDefaultsTest, Writev) {
+  SimpleTarget target;
+  const ITarget::MemoryRange ranges[] = {{0x10, 1}, {0x40, 2}};
+  const uint8_t buf[] = {0xde, 0xad, 0xbe};
+  EXPECT_EQ(3u, target.writev(ranges, 2, buf));
+  EXPECT_EQ(0xde, target.mMem[0x10]);
+  EXPECT_EQ(0xad, target.mMem[0x40]);
+  EXPECT_EQ(0xbe, target.mMem[0x41]);
+}
+
+TEST(ITargetDefaultsTest, SetStepRange) {
+  SimpleTarget target;
+  EXPECT_FALSE(target.setStepRange(0x10, 0x20));
+}
+
+TEST(ITargetDefaultsTest, GetEventFd) {
+  SimpleTarget target;
+  EXPECT_EQ(-1, target.getEventFd());
+}
+
+TEST(ITargetDefaultsTest, InterruptWait) {
+  SimpleTarget target;
+  // Does nothing, and in particular does not touch the target
+  target.interruptWait();
+  EXPECT_EQ(0, target.mReads);
+  EXPECT_EQ(0, target.mWrites);
+}
+
+TEST(ITargetDefaultsTest, SetWaitBudget) {
+  SimpleTarget target;
+  EXPECT_FALSE(target.setWaitBudget(10000, std::chrono::milliseconds(100)));
+}
+
+TEST(ITargetDefaultsTest, IsCacheable) {
+  SimpleTarget target;
+  EXPECT_FALSE(target.isCacheable(0x10, 4));
+}
@@ -0,0 +1,215 @@
+#include <cstring>
+#include <vector>
+
+#include "MemoryCache.h"
+#include "StubTarget.h"
+
+#include "gtest/gtest.h"
+
+using namespace EmbDebug;
+
+// A target with 4KiB of memory per core, which records each read, and with
+// 256 bytes of memory mapped I/O which is not cacheable.
+class MemoryTarget : public StubTarget {
+public:
+  static const std::size_t MEM_SIZE = 0x1000;
+  static const uint_addr_t MMIO_ADDR = 0xd00;
+  static const std::size_t MMIO_SIZE = 0x100;
+
+  struct Access {
+    uint_addr_t addr;
+    std::size_t size;
+  };
+
+  MemoryTarget() : StubTarget(nullptr), mCore(0), mMem(2) {
+    for (auto &mem : mMem)
+      for (std::size_t i = 0; i < MEM_SIZE; i++)
+        mem.push_back(static_cast<uint8_t>(i * 7));
+  }
+
+  void setCurrentCpu(unsigned int core) override { mCore = core; }
+
+  std::size_t read(const uint_addr_t addr, uint8_t *buffer,
+                   const std::size_t size) override {
+    mReads.push_back(Access{addr, size});
+    if (addr + size > MEM_SIZE)
+      return 0;
+    ::memcpy(buffer, &mMem[mCore][addr], size);
+    return size;
+  }
+  std::size_t write(const uint_addr_t addr, const uint8_t *buffer,
+                    const std::size_t size) override {
+    if (addr + size > MEM_SIZE)
+      return 0;
+    ::memcpy(&mMem[mCore][addr], buffer, size);
+    return size;
+  }
+  bool isCacheable(const uint_addr_t addr,
+                   const std::size_t size) const override {
+    return (addr + size <= MMIO_ADDR) || (addr >= MMIO_ADDR + MMIO_SIZE);
+  }
+
+  unsigned int mCore;
+  std::vector<std::vector<uint8_t>> mMem;
+  std::vector<Access> mReads;
+};
+
+class MemoryCacheTest : public ::testing::Test {
+protected:
+  MemoryCacheTest() : mCache(&mTarget, 2) {}
+
+  // Read through the cache and check the result against the target
+  void checkRead(uint_addr_t addr, std::size_t size) {
+    std::vector<uint8_t> buf(size);
+    ASSERT_EQ(size, mCache.read(addr, buf.data(), size));
+    ASSERT_EQ(0, ::memcmp(buf.data(), &mTarget.mMem[mTarget.mCore][addr],
+                          size));
+  }
+
+  MemoryTarget mTarget;
+  MemoryCache mCache;
+};
+
+// A miss reads whole pages; later reads of the same pages are hits.
+TEST_F(MemoryCacheTest, ReadFillsPages) {
+  checkRead(0x123, 4);
+  ASSERT_EQ(1u, mTarget.mReads.size());
+  EXPECT_EQ(0x100u, mTarget.mReads[0].addr);
+  EXPECT_EQ(0x100u, mTarget.mReads[0].size);
+
+  checkRead(0x100, 0x100);
+  checkRead(0x1fc, 4);
+  EXPECT_EQ(1u, mTarget.mReads.size());
+}
+
+// Consecutive missing pages are read together, and cached pages are not
+// read again.
+TEST_F(MemoryCacheTest, ReadSpansPages) {
+  checkRead(0x280, 4);
+  checkRead(0x1f0, 0x220);
+  ASSERT_EQ(3u, mTarget.mReads.size());
+  EXPECT_EQ(0x100u, mTarget.mReads[1].addr);
+  EXPECT_EQ(0x100u, mTarget.mReads[1].size);
+  EXPECT_EQ(0x300u, mTarget.mReads[2].addr);
+  EXPECT_EQ(0x200u, mTarget.mReads[2].size);
+}
+
+TEST_F(MemoryCacheTest, WriteUpdatesCache) {
+  checkRead(0x200, 0x200);
+  const uint8_t data[] = {1, 2, 3, 4};
+  ASSERT_EQ(4u, mTarget.write(0x2fe, data, 4));
+  mCache.write(0x2fe, data, 4);
+  checkRead(0x2f0, 0x20);
+  EXPECT_EQ(1u, mTarget.mReads.size());
+}
+
+TEST_F(MemoryCacheTest, Invalidate) {
+  checkRead(0x0, 4);
+  mTarget.mMem[0][0] = 0xff;
+  mCache.invalidate();
+  checkRead(0x0, 4);
+  EXPECT_EQ(2u, mTarget.mReads.size());
+}
+
+TEST_F(MemoryCacheTest, Uncacheable) {
+  checkRead(MemoryTarget::MMIO_ADDR + 4, 4);
+  checkRead(MemoryTarget::MMIO_ADDR + 4, 4);
+  ASSERT_EQ(2u, mTarget.mReads.size());
+  EXPECT_EQ(MemoryTarget::MMIO_ADDR + 4, mTarget.mReads[1].addr);
+  EXPECT_EQ(4u, mTarget.mReads[1].size);
+}
+
+TEST_F(MemoryCacheTest, Disabled) {
+  mCache.setEnabled(false);
+  EXPECT_FALSE(mCache.isEnabled());
+  checkRead(0x10, 4);
+  checkRead(0x10, 4);
+  ASSERT_EQ(2u, mTarget.mReads.size());
+  EXPECT_EQ(0x10u, mTarget.mReads[1].addr);
+}
+
+// If whole pages cannot be read, just the bytes asked for are read.
+TEST_F(MemoryCacheTest, PageReadFails) {
+  std::vector<uint8_t> buf(8);
+  EXPECT_EQ(0u, mCache.read(MemoryTarget::MEM_SIZE - 4, buf.data(), 8));
+  ASSERT_EQ(2u, mTarget.mReads.size());
+  EXPECT_EQ(MemoryTarget::MEM_SIZE - 4, mTarget.mReads[1].addr);
+  EXPECT_EQ(8u, mTarget.mReads[1].size);
+}
+
+TEST_F(MemoryCacheTest, PerCore) {
+  mTarget.mMem[1][0x40] = 0xaa;
+  checkRead(0x40, 1);
+  mTarget.setCurrentCpu(1);
+  mCache.setCore(1);
+  checkRead(0x40, 1);
+  EXPECT_EQ(2u, mTarget.mReads.size());
+}
+
+// The pages of other cores dropped on a write are reused, so that the
+// cache does not fill up with them and empty itself.
+TEST_F(MemoryCacheTest, WriteFreesOtherCorePages) {
+  checkRead(0x0, 1);
+  uint8_t val = 0x55;
+  for (int i = 0; i < 2000; i++) {
+    mTarget.setCurrentCpu(1);
+    mCache.setCore(1);
+    checkRead(0x800, 1);
+    mTarget.setCurrentCpu(0);
+    mCache.setCore(0);
+    mTarget.write(0x800, &val, 1);
+    mCache.write(0x800, &val, 1);
+  }
+
+  std::size_t reads = mTarget.mReads.size();
+  checkRead(0x0, 1);
+  EXPECT_EQ(reads, mTarget.mReads.size());
+}
+
+// Sequential reads read ahead, doubling the pages read ahead each time.
+TEST_F(MemoryCacheTest, SequentialReadAhead) {
+  for (uint_addr_t addr = 0; addr < 0x800; addr += 0x80)
+    checkRead(addr, 0x80);
+  ASSERT_EQ(3u, mTarget.mReads.size());
+  EXPECT_EQ(0x0u, mTarget.mReads[0].addr);
+  EXPECT_EQ(0x100u, mTarget.mReads[0].size);
+  EXPECT_EQ(0x100u, mTarget.mReads[1].addr);
+  EXPECT_EQ(0x300u, mTarget.mReads[1].size);
+  EXPECT_EQ(0x400u, mTarget.mReads[2].addr);
+  EXPECT_EQ(0x900u, mTarget.mReads[2].size);
+}
+
+// A read which does not follow on from the last resets the read ahead.
+TEST_F(MemoryCacheTest, NonSequentialNoReadAhead) {
+  checkRead(0x0, 0x100);
+  checkRead(0x100, 0x100);
+  checkRead(0x800, 0x100);
+  ASSERT_EQ(3u, mTarget.mReads.size());
+  EXPECT_EQ(0x800u, mTarget.mReads[2].addr);
+  EXPECT_EQ(0x100u, mTarget.mReads[2].size);
+}
+
+// Reading ahead stops short of uncacheable memory and the end of memory.
+TEST_F(MemoryCacheTest, ReadAheadLimits) {
+  checkRead(MemoryTarget::MMIO_ADDR - 0x200, 0x100);
+  checkRead(MemoryTarget::MMIO_ADDR - 0x100, 0x100);
+  ASSERT_EQ(2u, mTarget.mReads.size());
+  EXPECT_EQ(0x100u, mTarget.mReads[1].size);
+
+  uint_addr_t top = MemoryTarget::MEM_SIZE - 0x100;
+  checkRead(top - 0x100, 0x100);
+  checkRead(top, 0x100);
+  ASSERT_EQ(5u, mTarget.mReads.size());
+  EXPECT_EQ(top, mTarget.mReads[3].addr);
+  EXPECT_EQ(0x200u, mTarget.mReads[3].size);
+  EXPECT_EQ(top, mTarget.mReads[4].addr);
+  EXPECT_EQ(0x100u, mTarget.mReads[4].size);
+}
+
+TEST_F(MemoryCacheTest, InvalidateResetsReadAhead) {
+  checkRead(0x0, 0x100);
+  mCache.invalidate();
+  checkRead(0x100, 0x100);
+  ASSERT_EQ(2u, mTarget.mReads.size());
+  EXPECT_EQ(0x100u, mTarget.mReads[1].size);
+}
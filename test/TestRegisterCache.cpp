@@ -0,0 +1,94 @@
+#include "RegisterCache.h"
+
+#include "gtest/gtest.h"
+
+using namespace EmbDebug;
+
+TEST(RegisterCacheTest, InitiallyEmpty) {
+  RegisterCache cache(2, 4);
+  uint_reg_t value;
+  std::size_t size;
+  EXPECT_EQ(0u, cache.getCore());
+  for (int reg = 0; reg < 4; reg++)
+    EXPECT_FALSE(cache.lookup(reg, value, size));
+}
+
+TEST(RegisterCacheTest, StoreAndLookup) {
+  RegisterCache cache(1, 4);
+  uint_reg_t value;
+  std::size_t size;
+  cache.store(2, 0x1234, 4);
+  ASSERT_TRUE(cache.lookup(2, value, size));
+  EXPECT_EQ(0x1234u, value);
+  EXPECT_EQ(4u, size);
+  EXPECT_FALSE(cache.lookup(1, value, size));
+}
+
+// Values are truncated to the register size, as the target would do.
+TEST(RegisterCacheTest, StoreTruncates) {
+  RegisterCache cache(1, 4);
+  uint_reg_t value;
+  std::size_t size;
+  cache.store(0, 0x123456, 2);
+  ASSERT_TRUE(cache.lookup(0, value, size));
+  EXPECT_EQ(0x3456u, value);
+}
+
+// A failed access (size zero) is not cached.
+TEST(RegisterCacheTest, ZeroSizeNotCached) {
+  RegisterCache cache(1, 4);
+  uint_reg_t value;
+  std::size_t size;
+  cache.store(0, 1, 4);
+  cache.store(0, 2, 0);
+  EXPECT_FALSE(cache.lookup(0, value, size));
+}
+
+TEST(RegisterCacheTest, OutOfRangeNotCached) {
+  RegisterCache cache(1, 4);
+  uint_reg_t value;
+  std::size_t size;
+  cache.store(4, 1, 4);
+  cache.store(-1, 1, 4);
+  EXPECT_FALSE(cache.lookup(4, value, size));
+  EXPECT_FALSE(cache.lookup(-1, value, size));
+}
+
+TEST(RegisterCacheTest, PerCore) {
+  RegisterCache cache(2, 4);
+  uint_reg_t value;
+  std::size_t size;
+  cache.store(1, 10, 4);
+  cache.setCore(1);
+  EXPECT_FALSE(cache.lookup(1, value, size));
+  cache.store(1, 11, 4);
+  cache.setCore(0);
+  ASSERT_TRUE(cache.lookup(1, value, size));
+  EXPECT_EQ(10u, value);
+  cache.setCore(1);
+  ASSERT_TRUE(cache.lookup(1, value, size));
+  EXPECT_EQ(11u, value);
+}
+
+TEST(RegisterCacheTest, Invalidate) {
+  RegisterCache cache(2, 4);
+  uint_reg_t value;
+  std::size_t size;
+  for (unsigned int core = 0; core < 2; core++) {
+    cache.setCore(core);
+    for (int reg = 0; reg < 4; reg++)
+      cache.store(reg, reg, 4);
+  }
+
+  cache.invalidate(2);
+  EXPECT_FALSE(cache.lookup(2, value, size));
+  EXPECT_TRUE(cache.lookup(3, value, size));
+
+  cache.invalidateCore();
+  EXPECT_FALSE(cache.lookup(3, value, size));
+  cache.setCore(0);
+  EXPECT_TRUE(cache.lookup(3, value, size));
+
+  cache.invalidateAll();
+  EXPECT_FALSE(cache.lookup(3, value, size));
+}
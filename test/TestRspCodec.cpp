@@ -0,0 +1,205 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "RspCodec.h"
+
+#include "gtest/gtest.h"
+
+using namespace EmbDebug;
+
+// Each test is run with every implementation supported on the host, and the
+// results checked against simple reference code. Lengths and alignments are
+// chosen to exercise both the vector loops and the scalar tails.
+
+class RspCodecTest : public ::testing::TestWithParam<RspCodec::Impl> {
+protected:
+  void SetUp() override {
+    mOldImpl = RspCodec::getImpl();
+    if (!RspCodec::setImpl(GetParam()))
+      mSkip = true;
+
+    // A repeatable mix of all byte values
+    uint32_t seed = 12345;
+    for (std::size_t i = 0; i < 512; i++) {
+      seed = seed * 1103515245 + 12345;
+      mData.push_back(static_cast<uint8_t>(seed >> 16));
+    }
+  }
+  void TearDown() override { RspCodec::setImpl(mOldImpl); }
+
+  RspCodec::Impl mOldImpl;
+  bool mSkip = false;
+  std::vector<uint8_t> mData;
+};
+
+TEST_P(RspCodecTest, Checksum) {
+  if (mSkip)
+    return;
+  const char *buf = reinterpret_cast<const char *>(mData.data());
+  for (std::size_t off = 0; off < 4; off++)
+    for (std::size_t len = 0; len + off <= mData.size(); len++) {
+      uint8_t expected = 0;
+      for (std::size_t i = 0; i < len; i++)
+        expected = static_cast<uint8_t>(expected + mData[off + i]);
+      ASSERT_EQ(expected, RspCodec::checksum(buf + off, len))
+          << "off " << off << " len " << len;
+    }
+}
+
+TEST_P(RspCodecTest, FindEscape) {
+  if (mSkip)
+    return;
+  const char special[] = {'$', '#', '*', '}'};
+  for (char c : special)
+    for (std::size_t pos = 0; pos < 100; pos++) {
+      std::string buf(100, 'a');
+      buf[pos] = c;
+      ASSERT_EQ(pos, RspCodec::findEscape(buf.data(), buf.size()))
+          << "char " << c << " pos " << pos;
+      ASSERT_EQ(pos, RspCodec::findEscape(buf.data(), pos + 1));
+      ASSERT_EQ(pos, RspCodec::findEscape(buf.data(), pos));
+    }
+}
+
+TEST_P(RspCodecTest, Escape) {
+  if (mSkip)
+    return;
+  const char *src = reinterpret_cast<const char *>(mData.data());
+  for (std::size_t len = 0; len <= mData.size(); len += 7) {
+    std::string expected;
+    for (std::size_t i = 0; i < len; i++) {
+      char c = src[i];
+      if (c == '$' || c == '#' || c == '*' || c == '}') {
+        expected += '}';
+        expected += static_cast<char>(c ^ 0x20);
+      } else {
+        expected += c;
+      }
+    }
+
+    std::vector<char> dest(len * 2);
+    std::size_t destLen = RspCodec::escape(src, len, dest.data());
+    ASSERT_EQ(expected, std::string(dest.data(), destLen)) << "len " << len;
+  }
+}
+
+TEST_P(RspCodecTest, Bin2Hex) {
+  if (mSkip)
+    return;
+  static const char digits[] = "0123456789abcdef";
+  for (std::size_t off = 0; off < 4; off++)
+    for (std::size_t len = 0; len + off <= mData.size(); len += 3) {
+      std::string expected;
+      for (std::size_t i = 0; i < len; i++) {
+        expected += digits[mData[off + i] >> 4];
+        expected += digits[mData[off + i] & 0xf];
+      }
+
+      std::vector<char> dest(len * 2);
+      RspCodec::bin2Hex(mData.data() + off, len, dest.data());
+      ASSERT_EQ(expected, std::string(dest.data(), len * 2))
+          << "off " << off << " len " << len;
+    }
+}
+
+TEST_P(RspCodecTest, Hex2Bin) {
+  if (mSkip)
+    return;
+  for (std::size_t len = 0; len <= mData.size(); len += 5) {
+    std::vector<char> hex(len * 2);
+    RspCodec::bin2Hex(mData.data(), len, hex.data());
+
+    // Mix in some upper case digits
+    for (std::size_t i = 0; i < hex.size(); i += 3)
+      hex[i] = static_cast<char>(toupper(hex[i]));
+
+    std::vector<uint8_t> dest(len);
+    ASSERT_TRUE(RspCodec::hex2Bin(hex.data(), len, dest.data()))
+        << "len " << len;
+    ASSERT_TRUE(std::equal(dest.begin(), dest.end(), mData.begin()))
+        << "len " << len;
+  }
+}
+
+TEST_P(RspCodecTest, Hex2BinInvalid) {
+  if (mSkip)
+    return;
+  const char bad[] = {'g', 'G', '/', ':', '@', '`', ' ', '\0', '\xff'};
+  for (char c : bad)
+    for (std::size_t pos = 0; pos < 128; pos++) {
+      std::string hex(128, '5');
+      hex[pos] = c;
+      uint8_t dest[64];
+      ASSERT_FALSE(RspCodec::hex2Bin(hex.data(), 64, dest))
+          << "char " << static_cast<int>(c) << " pos " << pos;
+    }
+}
+
+// Undo run-length encoding, as GDB does when reading a packet.
+static std::string runLengthDecode(const std::string &buf) {
+  std::string out;
+  for (std::size_t i = 0; i < buf.size(); i++) {
+    if ((buf[i] == '*') && !out.empty() && (i + 1 < buf.size())) {
+      int count = buf[++i] - 29;
+      EXPECT_GE(count, 3) << "Offset " << i;
+      EXPECT_LE(count, 97) << "Offset " << i;
+      EXPECT_NE('#', buf[i]) << "Offset " << i;
+      EXPECT_NE('$', buf[i]) << "Offset " << i;
+      out.append(count, out.back());
+    } else {
+      out += buf[i];
+    }
+  }
+  return out;
+}
+
+static std::string runLengthEncode(std::string buf) {
+  std::size_t len = RspCodec::runLengthEncode(&buf[0], buf.size());
+  buf.resize(len);
+  return buf;
+}
+
+TEST(RspCodecRunLengthTest, ShortRunsUnchanged) {
+  EXPECT_EQ("", runLengthEncode(""));
+  EXPECT_EQ("a", runLengthEncode("a"));
+  EXPECT_EQ("aabbbc", runLengthEncode("aabbbc"));
+}
+
+TEST(RspCodecRunLengthTest, Runs) {
+  EXPECT_EQ("0* ", runLengthEncode("0000"));
+  EXPECT_EQ("x0*%x", runLengthEncode("x" + std::string(9, '0') + "x"));
+  EXPECT_EQ("0*~", runLengthEncode(std::string(98, '0')));
+  EXPECT_EQ("0*~0", runLengthEncode(std::string(99, '0')));
+}
+
+// Counts of 6 and 7 would be '#' and '$', so must be avoided.
+TEST(RspCodecRunLengthTest, ForbiddenCounts) {
+  EXPECT_EQ("0*\"0", runLengthEncode(std::string(7, '0')));
+  EXPECT_EQ("0*\"00", runLengthEncode(std::string(8, '0')));
+}
+
+// The escaped char of an escape sequence must not start a run, since the
+// decoder would repeat the wrong char.
+TEST(RspCodecRunLengthTest, Escapes) {
+  EXPECT_EQ("}]}]}]}]", runLengthEncode("}]}]}]}]"));
+  EXPECT_EQ("}]]* ", runLengthEncode("}]]]]]"));
+  EXPECT_EQ("a* }]", runLengthEncode("aaaa}]"));
+}
+
+TEST(RspCodecRunLengthTest, RoundTrip) {
+  for (std::size_t run = 1; run < 300; run++) {
+    std::string buf = "a" + std::string(run, '0') + "}\x04" +
+                      std::string(run, 'f') + "}";
+    std::string encoded = runLengthEncode(buf);
+    ASSERT_EQ(buf, runLengthDecode(encoded)) << "Run " << run;
+    ASSERT_LE(encoded.size(), buf.size()) << "Run " << run;
+  }
+}
+
+INSTANTIATE_TEST_CASE_P(Implementations, RspCodecTest,
+                        ::testing::Values(RspCodec::Impl::SCALAR,
+                                          RspCodec::Impl::SSE2,
+                                          RspCodec::Impl::AVX2));
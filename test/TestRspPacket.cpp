@@ -33,3 +33,78 @@ TEST_F(RspPacketTest, vContMessage) {
   EXPECT_EQ(std::string("vCont;c;C;s;S"), _pkt128->getRawData());
   EXPECT_EQ(13, _pkt128->getLen());
 }
+
+TEST_F(RspPacketTest, MoveShortPacket) {
+  RspPacket src("OK");
+  RspPacket dst(std::move(src));
+  EXPECT_EQ(std::string("OK"), dst.getRawData());
+  EXPECT_EQ(2, dst.getLen());
+  EXPECT_EQ(0, src.getLen());
+  EXPECT_EQ(std::string(""), src.getRawData());
+}
+
+TEST_F(RspPacketTest, MoveLongPacket) {
+  std::string data(1000, 'a');
+  RspPacket src(data.c_str(), data.size());
+  const char *buf = src.getRawData();
+  *_pkt128 = std::move(src);
+  EXPECT_EQ(buf, _pkt128->getRawData());
+  EXPECT_EQ(data, _pkt128->getRawData());
+  EXPECT_EQ(0, src.getLen());
+}
+
+TEST_F(RspPacketTest, FromBuilder) {
+  RspPacketBuilder builder;
+  builder.addData("qSupported:");
+  builder += 'x';
+  RspPacket pkt(std::move(builder));
+  EXPECT_EQ(std::string("qSupported:x"), pkt.getRawData());
+  EXPECT_EQ(12, pkt.getLen());
+}
+
+TEST_F(RspPacketTest, FormattedLong) {
+  std::string data(200, 'b');
+  RspPacket pkt = RspPacket::CreateFormatted("T%s;%d", data.c_str(), 42);
+  EXPECT_EQ("T" + data + ";42", pkt.getRawData());
+  EXPECT_EQ(data.size() + 4, pkt.getLen());
+}
+
+TEST_F(RspPacketTest, BuilderGrows) {
+  std::string data;
+  RspPacketBuilder builder;
+  for (int i = 0; i < 20000; i++) {
+    char c = static_cast<char>('a' + i % 26);
+    builder += c;
+    data += c;
+  }
+  builder.addData("end");
+  data += "end";
+  EXPECT_EQ(data.size(), builder.getSize());
+  RspPacket pkt(std::move(builder));
+  EXPECT_EQ(data, pkt.getRawData());
+}
+
+TEST_F(RspPacketTest, BuilderLimitedToMaxPacketSize) {
+  std::size_t oldSize = RspPacket::getMaxPacketSize();
+  RspPacket::setMaxPacketSize(1000);
+  {
+    RspPacketBuilder builder;
+    builder.addData(std::string(600, 'a').c_str());
+    builder.addData(std::string(600, 'b').c_str());
+    EXPECT_EQ(600, builder.getSize());
+    EXPECT_EQ(400, builder.getRemaining());
+    builder.addData(std::string(400, 'c').c_str());
+    EXPECT_EQ(1000, builder.getSize());
+    builder += 'd';
+    EXPECT_EQ(1000, builder.getSize());
+  }
+  RspPacket::setMaxPacketSize(oldSize);
+}
+
+// Packets may be much larger than the old fixed 10000 char buffers.
+TEST_F(RspPacketTest, LargePacket) {
+  std::string data(RspPacket::DEFAULT_MAX_PACKET_SIZE, 'x');
+  RspPacket pkt(data.c_str(), data.size());
+  EXPECT_EQ(data.size(), pkt.getLen());
+  EXPECT_EQ(data, pkt.getRawData());
+}
@@ -82,3 +82,20 @@ TEST(hex2CharMultipleDigits, ReturnsNullChar) {
   for (uint8_t d = 0; d <= 239; d++)
     EXPECT_DEATH(Utils::hex2Char(d + 16), "d <= 0xf");
 }
+
+TEST(rspUnescape, InPlace) {
+  char buf[] = "a}\x04" "b}]c";
+  std::size_t len = Utils::rspUnescape(buf, sizeof(buf) - 1);
+  EXPECT_EQ(5u, len);
+  EXPECT_EQ(std::string("a$b}c"), std::string(buf, len));
+}
+
+TEST(rspUnescape, ToBuffer) {
+  const char src[] = "}\x03" "xy}\x0a";
+  uint8_t dest[sizeof(src)];
+  std::size_t len = Utils::rspUnescape(src, sizeof(src) - 1, dest);
+  EXPECT_EQ(4u, len);
+  EXPECT_EQ(std::string("#xy*"),
+            std::string(reinterpret_cast<char *>(dest), len));
+  EXPECT_EQ(std::string("}\x03" "xy}\x0a"), src);
+}
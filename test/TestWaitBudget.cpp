@@ -0,0 +1,119 @@
+#include <chrono>
+
+#include "StubTarget.h"
+#include "WaitBudget.h"
+
+#include "gtest/gtest.h"
+
+using namespace EmbDebug;
+
+using std::chrono::duration;
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+
+// A target which takes a wait budget if asked to, recording each budget.
+class BudgetTarget : public StubTarget {
+public:
+  BudgetTarget(bool takesBudget)
+      : StubTarget(nullptr), mTakesBudget(takesBudget), mBudgets(0),
+        mInstructions(0), mTime(duration<double>::zero()), mInstrCount(0) {}
+
+  bool setWaitBudget(const uint64_t instructions,
+                     const duration<double> time) override {
+    mBudgets++;
+    mInstructions = instructions;
+    mTime = time;
+    return mTakesBudget;
+  }
+
+  uint64_t getInstrCount() const override { return mInstrCount; }
+
+  bool mTakesBudget;
+  int mBudgets;
+  uint64_t mInstructions;
+  duration<double> mTime;
+  uint64_t mInstrCount;
+};
+
+TEST(WaitBudgetTest, Defaults) {
+  WaitBudget budget;
+  EXPECT_EQ(10000u, budget.instructions());
+  EXPECT_EQ(milliseconds(100), budget.maxLatency());
+}
+
+// Runs which are short compared to the overhead get longer, but not all at
+// once.
+TEST(WaitBudgetTest, Grow) {
+  WaitBudget budget;
+  budget.adapt(10000, milliseconds(1), microseconds(100));
+  EXPECT_EQ(40000u, budget.instructions());
+}
+
+// Runs which would take longer than the maximum latency get shorter.
+TEST(WaitBudgetTest, Shrink) {
+  WaitBudget budget;
+  budget.adapt(10000, milliseconds(1000), milliseconds(10));
+  EXPECT_EQ(2500u, budget.instructions());
+  budget.adapt(2500, milliseconds(250), milliseconds(10));
+  EXPECT_EQ(1000u, budget.instructions());
+}
+
+// At a steady rate, the runs settle at OVERHEAD_RATIO times the overhead.
+TEST(WaitBudgetTest, Converge) {
+  WaitBudget budget;
+  const double rate = 1e7; // Instructions per second
+  for (int i = 0; i < 10; i++) {
+    uint64_t n = budget.instructions();
+    budget.adapt(n, duration<double>(static_cast<double>(n) / rate),
+                 microseconds(50));
+  }
+  EXPECT_NEAR(50000.0, static_cast<double>(budget.instructions()), 1.0);
+}
+
+TEST(WaitBudgetTest, MaxLatency) {
+  WaitBudget budget;
+  budget.maxLatency(milliseconds(1));
+  budget.adapt(10000, milliseconds(1), milliseconds(1));
+  EXPECT_EQ(10000u, budget.instructions());
+}
+
+TEST(WaitBudgetTest, Limits) {
+  WaitBudget budget;
+  for (int i = 0; i < 10; i++)
+    budget.adapt(budget.instructions(), milliseconds(1000), microseconds(1));
+  EXPECT_EQ(100u, budget.instructions());
+
+  for (int i = 0; i < 20; i++)
+    budget.adapt(budget.instructions(), microseconds(1), milliseconds(1));
+  EXPECT_EQ(1000000000u, budget.instructions());
+
+  // Nothing is learnt from a wait which ran nothing.
+  budget.adapt(0, milliseconds(1), milliseconds(1));
+  EXPECT_EQ(1000000000u, budget.instructions());
+}
+
+// The budget is only sent when it has changed, and a target which does not
+// take it is not asked again, nor measured.
+TEST(WaitBudgetTest, Send) {
+  BudgetTarget target(true);
+  WaitBudget budget;
+  budget.startWait(&target);
+  budget.endWait(&target, true);
+  budget.startWait(&target);
+  EXPECT_EQ(1, target.mBudgets);
+  EXPECT_EQ(10000u, target.mInstructions);
+  EXPECT_EQ(milliseconds(100), target.mTime);
+
+  budget.maxLatency(milliseconds(20));
+  budget.startWait(&target);
+  EXPECT_EQ(2, target.mBudgets);
+  EXPECT_EQ(milliseconds(20), target.mTime);
+
+  BudgetTarget other(false);
+  WaitBudget otherBudget;
+  for (int i = 0; i < 3; i++) {
+    otherBudget.startWait(&other);
+    otherBudget.endWait(&other, true);
+  }
+  EXPECT_EQ(1, other.mBudgets);
+}
@@ -21,6 +21,7 @@
 #endif
 
 #include "Init.h"
+#include "RspPacket.h"
 #include "TraceFlags.h"
 #include "embdebug/config.h"
 #include "embdebug/ITarget.h"
@@ -133,7 +134,7 @@ int main(int argc, char *argv[]) {
   TraceFlags traceFlags;
   bool withLockstep;
   int rspPort = 0;
-  std::size_t rspBufSize = 10000;
+  std::size_t rspBufSize = RspPacket::DEFAULT_MAX_PACKET_SIZE;
 
   cxxopts::Options options("embdebug", "GDBServer");
   options.add_options()("q,silent",
@@ -149,7 +150,7 @@ int main(int argc, char *argv[]) {
       "l,lockstep", "Enable lockstep debugging",
       cxxopts::value<bool>(withLockstep)->default_value("false"));
   options.add_options()(
-       "bufsize", "Set RSP buffer size in bytes (default 10,000)",
+       "bufsize", "Set RSP buffer size in bytes (default 262,144)",
        cxxopts::value<string>(), "<size>");
   options.add_options()("soname", "Shared object containing model",
                         cxxopts::value<string>(soName), "<shared object>");